@@ -0,0 +1,720 @@
+
+// This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
+// Copyright (c) 2011-2017 Adi Gostin, distributed under Apache License v2.0.
+
+// Command-line benchmark for the STP library. It creates a number of bridges, wires them in one of a few topologies,
+// delivers the BPDUs between them in memory, and reports:
+//  - time to converge: simulated seconds until the last port role / forwarding change, and the CPU time spent until then;
+//  - CPU time per call of STP_OnOneSecondTick and per call of STP_OnBpduReceived, and BPDUs per second of CPU time,
+//    measured while the converged network keeps running;
+//  - CPU time and BPDU count of a link flap storm: for a number of seconds, an eighth of the links (at least one),
+//    picked at random, go down or come back up each second. The links are picked the same way on every run.
+// With "-batch 1" the BPDUs are delivered with STP_OnBpdusReceived: those queued for a bridge at the same time
+// are passed in one call, the way an application draining a receive queue would do it. The bridges then also
+// transmit through the transmitBatch callback. Compare the two modes on the convergence phase, where all links
+// come up at once, and on the flap storm, where BPDUs arrive in bursts.
+//
+// It uses only standard C++, so it builds anywhere, together with the library sources. For example:
+//		g++ -O2 -DNDEBUG -I../mstp-lib Benchmark.cpp ../mstp-lib/*.cpp ../mstp-lib/802.1Q-2011/*.cpp -o Benchmark
+//
+// The library build options that change its speed must be given to this file too, on the same command line,
+// and the "build" column shows them: "M" followed by STP_MAX_MSTI_COUNT and "L" followed by STP_USE_LOG.
+// For instance an RSTP-only build, "M0 L1", to compare with the default "M64 L1" on the RSTP rows; adding -flto
+// shows what inlining the state machine calls would give:
+//		g++ -O2 -DNDEBUG -DSTP_MAX_MSTI_COUNT=0 -I../mstp-lib Benchmark.cpp ../mstp-lib/*.cpp ../mstp-lib/802.1Q-2011/*.cpp -o Benchmark
+// Or a build without logging code, "M64 L0", to compare with the default on the BPDU column. The bridges here
+// have logging disabled at runtime, so this is the cost left by the tests of loggingEnabled. To compare the code
+// size of the two, compile the library alone with and without -DSTP_USE_LOG=0 and add up the text of the objects:
+//		g++ -O2 -DNDEBUG -DSTP_USE_LOG=0 -c -I../mstp-lib ../mstp-lib/*.cpp ../mstp-lib/802.1Q-2011/*.cpp && size -t *.o
+//
+// Usage: Benchmark [-topology ring|chain|mesh|fattree] [-bridges N] [-version rstp|mstp] [-msti N] [-seconds N] [-flaps N] [-batch 0|1]
+//        Benchmark -mstconfig N
+// Without arguments it runs all topologies with RSTP and with MSTP for a few MSTI counts, skipping the MSTI counts
+// above STP_MAX_MSTI_COUNT.
+// With -mstconfig it measures instead the CPU time of N changes to the MST Config Table, which are
+// dominated by the computation of the configuration digest, once with STP_SetMstConfigTable and once
+// with STP_SetMstConfigTableEntries.
+
+#include "stp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <deque>
+#include <vector>
+
+// The defaults of the library, see stp_bridge.h and stp_log.h.
+#ifndef STP_MAX_MSTI_COUNT
+	#define STP_MAX_MSTI_COUNT 64
+#endif
+
+#ifndef STP_USE_LOG
+	#define STP_USE_LOG 1
+#endif
+
+enum TOPOLOGY
+{
+	TOPOLOGY_RING,
+	TOPOLOGY_CHAIN,
+	TOPOLOGY_MESH,
+	TOPOLOGY_FAT_TREE,
+};
+
+static const char* const TopologyNames[] = { "ring", "chain", "mesh", "fattree" };
+
+struct PEER
+{
+	int bridgeIndex; // -1 if the port is not connected
+	unsigned int portIndex;
+};
+
+struct PENDING_BPDU
+{
+	unsigned int bridgeIndex;
+	unsigned int portIndex;
+	std::vector<unsigned char> data;
+};
+
+struct NETWORK
+{
+	std::vector<STP_BRIDGE*> bridges;
+	std::vector<std::vector<PEER> > peers; // [bridge][port]
+	std::deque<PENDING_BPDU> pendingBpdus;
+
+	// The library calls onPortRoleChanged each time a port enters a role state, even when it's the same role as before
+	// (for instance a Root Port on every received BPDU), so we keep the last role and forwarding state of each port and tree
+	// and count only actual changes.
+	unsigned int treeCount;
+	std::vector<std::vector<unsigned char> > roles;			// [bridge][port * treeCount + tree]
+	std::vector<std::vector<unsigned char> > forwarding;	// [bridge][port * treeCount + tree]
+	unsigned int portChangeCount;
+
+	bool batch;
+};
+
+static NETWORK network;
+
+static unsigned char transmitBuffer [2048];
+static unsigned int transmitPortIndex;
+static unsigned int transmitBpduSize;
+
+// ============================================================================
+
+static unsigned int GetBridgeIndex (const STP_BRIDGE* bridge)
+{
+	return (unsigned int) (size_t) STP_GetApplicationContext (bridge);
+}
+
+static void EnableLearning (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, unsigned int enable, unsigned int timestamp)
+{
+}
+
+static void EnableForwarding (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, unsigned int enable, unsigned int timestamp)
+{
+	unsigned char& value = network.forwarding [GetBridgeIndex (bridge)][portIndex * network.treeCount + treeIndex];
+	if (value != (unsigned char) enable)
+	{
+		value = (unsigned char) enable;
+		network.portChangeCount++;
+	}
+}
+
+static void* TransmitGetBuffer (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int bpduSize, unsigned int timestamp)
+{
+	if (bpduSize > sizeof (transmitBuffer))
+		return NULL;
+
+	transmitPortIndex = portIndex;
+	transmitBpduSize = bpduSize;
+	return transmitBuffer;
+}
+
+static void QueueTransmittedBpdu (const STP_BRIDGE* bridge, unsigned int portIndex, const unsigned char* bpdu, unsigned int bpduSize)
+{
+	const PEER& peer = network.peers [GetBridgeIndex (bridge)][portIndex];
+	if (peer.bridgeIndex == -1)
+		return;
+
+	network.pendingBpdus.push_back (PENDING_BPDU ());
+	PENDING_BPDU& pending = network.pendingBpdus.back ();
+	pending.bridgeIndex = peer.bridgeIndex;
+	pending.portIndex = peer.portIndex;
+	pending.data.assign (bpdu, bpdu + bpduSize);
+}
+
+static void TransmitReleaseBuffer (const STP_BRIDGE* bridge, void* bufferReturnedByGetBuffer)
+{
+	QueueTransmittedBpdu (bridge, transmitPortIndex, transmitBuffer, transmitBpduSize);
+}
+
+static void TransmitBatch (const STP_BRIDGE* bridge, const STP_TRANSMITTED_BPDU* entries, unsigned int entryCount, unsigned int timestamp)
+{
+	for (unsigned int i = 0; i < entryCount; i++)
+		QueueTransmittedBpdu (bridge, entries [i].portIndex, entries [i].bpdu, entries [i].bpduSize);
+}
+
+static void FlushFdb (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, enum STP_FLUSH_FDB_TYPE flushType)
+{
+}
+
+static void DebugStrOut (const STP_BRIDGE* bridge, int portIndex, int treeIndex, const char* nullTerminatedString, unsigned int stringLength, unsigned int flush)
+{
+}
+
+static void OnTopologyChange (const STP_BRIDGE* bridge)
+{
+}
+
+static void OnNotifiedTopologyChange (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, unsigned int timestamp)
+{
+}
+
+static void OnPortRoleChanged (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, enum STP_PORT_ROLE role, unsigned int timestamp)
+{
+	unsigned char& value = network.roles [GetBridgeIndex (bridge)][portIndex * network.treeCount + treeIndex];
+	if (value != (unsigned char) role)
+	{
+		value = (unsigned char) role;
+		network.portChangeCount++;
+	}
+}
+
+static void OnConfigChanged (const STP_BRIDGE* bridge, unsigned int timestamp)
+{
+}
+
+static void* AllocAndZeroMemory (unsigned int size)
+{
+	return calloc (1, size);
+}
+
+static void FreeMemory (void* p)
+{
+	free (p);
+}
+
+static const STP_CALLBACKS Callbacks =
+{
+	EnableLearning,
+	EnableForwarding,
+	TransmitGetBuffer,
+	TransmitReleaseBuffer,
+	FlushFdb,
+	DebugStrOut,
+	OnTopologyChange,
+	OnNotifiedTopologyChange,
+	OnPortRoleChanged,
+	OnConfigChanged,
+	AllocAndZeroMemory,
+	FreeMemory,
+	NULL, // transmitBatch - set in RunBenchmark when running with -batch 1
+};
+
+// ============================================================================
+
+struct LINK
+{
+	unsigned int bridgeA;
+	unsigned int bridgeB;
+};
+
+// A fat tree here is a two-tier folded Clos network: a quarter of the bridges (at least two) are spines,
+// the rest are leaves, and each leaf is connected to each spine.
+static unsigned int GetFatTreeSpineCount (unsigned int bridgeCount)
+{
+	return (bridgeCount / 4 >= 2) ? (bridgeCount / 4) : 2;
+}
+
+static std::vector<LINK> GetLinks (TOPOLOGY topology, unsigned int bridgeCount)
+{
+	std::vector<LINK> links;
+
+	if ((topology == TOPOLOGY_RING) || (topology == TOPOLOGY_CHAIN))
+	{
+		unsigned int linkCount = (topology == TOPOLOGY_RING) ? bridgeCount : (bridgeCount - 1);
+		for (unsigned int i = 0; i < linkCount; i++)
+		{
+			LINK link = { i, (i + 1) % bridgeCount };
+			links.push_back (link);
+		}
+	}
+	else if (topology == TOPOLOGY_MESH)
+	{
+		for (unsigned int i = 0; i < bridgeCount; i++)
+		{
+			for (unsigned int j = i + 1; j < bridgeCount; j++)
+			{
+				LINK link = { i, j };
+				links.push_back (link);
+			}
+		}
+	}
+	else
+	{
+		unsigned int spineCount = GetFatTreeSpineCount (bridgeCount);
+		for (unsigned int leaf = spineCount; leaf < bridgeCount; leaf++)
+		{
+			for (unsigned int spine = 0; spine < spineCount; spine++)
+			{
+				LINK link = { spine, leaf };
+				links.push_back (link);
+			}
+		}
+	}
+
+	return links;
+}
+
+// ============================================================================
+
+static unsigned int DeliverPendingBpdusInBatches (unsigned int timestamp)
+{
+	unsigned int count = 0;
+
+	while (!network.pendingBpdus.empty ())
+	{
+		// Take everything queued so far; the calls below will queue more BPDUs, to be delivered in the next round.
+		std::deque<PENDING_BPDU> round;
+		round.swap (network.pendingBpdus);
+
+		for (unsigned int bridgeIndex = 0; bridgeIndex < network.bridges.size (); bridgeIndex++)
+		{
+			std::vector<STP_RECEIVED_BPDU> entries;
+			for (size_t i = 0; i < round.size (); i++)
+			{
+				if (round [i].bridgeIndex == bridgeIndex)
+				{
+					STP_RECEIVED_BPDU entry = { round [i].portIndex, &round [i].data [0], (unsigned int) round [i].data.size () };
+					entries.push_back (entry);
+				}
+			}
+
+			if (!entries.empty ())
+				STP_OnBpdusReceived (network.bridges [bridgeIndex], &entries [0], (unsigned int) entries.size (), timestamp);
+		}
+
+		count += (unsigned int) round.size ();
+	}
+
+	return count;
+}
+
+static unsigned int DeliverPendingBpdus (unsigned int timestamp)
+{
+	if (network.batch)
+		return DeliverPendingBpdusInBatches (timestamp);
+
+	unsigned int count = 0;
+
+	while (!network.pendingBpdus.empty ())
+	{
+		// Copy it out of the queue, as the call below will queue more BPDUs.
+		PENDING_BPDU pending = network.pendingBpdus.front ();
+		network.pendingBpdus.pop_front ();
+
+		STP_OnBpduReceived (network.bridges [pending.bridgeIndex], pending.portIndex, &pending.data [0], (unsigned int) pending.data.size (), timestamp);
+		count++;
+	}
+
+	return count;
+}
+
+static double GetSeconds (clock_t start, clock_t end)
+{
+	return (double) (end - start) / CLOCKS_PER_SEC;
+}
+
+// xorshift32, so that the flap storm is the same on all platforms and in both delivery modes.
+static unsigned int Random (unsigned int* state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+// ============================================================================
+
+static void RunBenchmark (TOPOLOGY topology, unsigned int bridgeCount, enum STP_VERSION version, unsigned int mstiCount, unsigned int steadySeconds, unsigned int flapSeconds)
+{
+	std::vector<LINK> links = GetLinks (topology, bridgeCount);
+
+	// Each link uses the next free port on each of its two bridges.
+	std::vector<unsigned int> portCounts (bridgeCount, 0);
+	for (size_t i = 0; i < links.size (); i++)
+	{
+		portCounts [links [i].bridgeA]++;
+		portCounts [links [i].bridgeB]++;
+	}
+
+	unsigned int portCount = 1;
+	for (unsigned int i = 0; i < bridgeCount; i++)
+	{
+		if (portCounts [i] > portCount)
+			portCount = portCounts [i];
+	}
+
+	unsigned int maxVlanNumber = (version == STP_VERSION_MSTP) ? 4094 : 0;
+
+	network.bridges.clear ();
+	network.peers.assign (bridgeCount, std::vector<PEER> (portCount));
+	network.pendingBpdus.clear ();
+	network.treeCount = 1 + mstiCount;
+	network.roles.assign (bridgeCount, std::vector<unsigned char> (portCount * network.treeCount, STP_PORT_ROLE_UNKNOWN));
+	network.forwarding.assign (bridgeCount, std::vector<unsigned char> (portCount * network.treeCount, 0));
+	network.portChangeCount = 0;
+
+	std::vector<STP_CONFIG_TABLE_ENTRY> configTable (1 + maxVlanNumber);
+	for (unsigned int vlanNumber = 1; vlanNumber <= maxVlanNumber; vlanNumber++)
+		configTable [vlanNumber].treeIndex = (unsigned char) (vlanNumber % (1 + mstiCount));
+
+	STP_CALLBACKS callbacks = Callbacks;
+	if (network.batch)
+		callbacks.transmitBatch = TransmitBatch;
+
+	unsigned int timestamp = 0;
+
+	for (unsigned int bridgeIndex = 0; bridgeIndex < bridgeCount; bridgeIndex++)
+	{
+		for (unsigned int portIndex = 0; portIndex < portCount; portIndex++)
+			network.peers [bridgeIndex][portIndex].bridgeIndex = -1;
+
+		unsigned char address[6] = { 0x00, 0xAA, 0xBB, 0x00, (unsigned char) (bridgeIndex >> 8), (unsigned char) bridgeIndex };
+		STP_BRIDGE* bridge = STP_CreateBridge (portCount, mstiCount, maxVlanNumber, &callbacks, address, 256);
+		STP_SetApplicationContext (bridge, (void*) (size_t) bridgeIndex);
+		STP_SetStpVersion (bridge, version, timestamp);
+		if ((version == STP_VERSION_MSTP) && (mstiCount > 0))
+			STP_SetMstConfigTable (bridge, &configTable [0], (unsigned int) configTable.size (), timestamp);
+		network.bridges.push_back (bridge);
+	}
+
+	std::vector<unsigned int> nextPort (bridgeCount, 0);
+	std::vector<unsigned int> linkPortsA (links.size ());
+	std::vector<unsigned int> linkPortsB (links.size ());
+	for (size_t i = 0; i < links.size (); i++)
+	{
+		unsigned int a = links [i].bridgeA;
+		unsigned int b = links [i].bridgeB;
+		linkPortsA [i] = nextPort [a];
+		linkPortsB [i] = nextPort [b];
+		PEER& peerOfA = network.peers [a][nextPort [a]];
+		PEER& peerOfB = network.peers [b][nextPort [b]];
+		peerOfA.bridgeIndex = b;
+		peerOfA.portIndex = nextPort [b];
+		peerOfB.bridgeIndex = a;
+		peerOfB.portIndex = nextPort [a];
+		nextPort [a]++;
+		nextPort [b]++;
+	}
+
+	// ------------------------------------------------------------------------
+	// Convergence: start all bridges and bring up all links at once, then let the network run until port roles
+	// and forwarding states have been stable for longer than it takes a port to go through Learning to Forwarding.
+
+	clock_t convergeStart = clock ();
+
+	for (unsigned int bridgeIndex = 0; bridgeIndex < bridgeCount; bridgeIndex++)
+		STP_StartBridge (network.bridges [bridgeIndex], timestamp);
+
+	for (unsigned int bridgeIndex = 0; bridgeIndex < bridgeCount; bridgeIndex++)
+	{
+		for (unsigned int portIndex = 0; portIndex < portCount; portIndex++)
+		{
+			if (network.peers [bridgeIndex][portIndex].bridgeIndex != -1)
+				STP_OnPortEnabled (network.bridges [bridgeIndex], portIndex, 1000, true, timestamp);
+		}
+	}
+
+	DeliverPendingBpdus (timestamp);
+
+	static const unsigned int StableSeconds = 2 * 15 + 10;
+	static const unsigned int MaxConvergeSeconds = 1000;
+	unsigned int second = 0;
+	unsigned int lastChangeSecond = 0;
+	clock_t lastChangeClock = clock ();
+	unsigned int lastChangeCount = network.portChangeCount;
+
+	while ((second - lastChangeSecond < StableSeconds) && (second < MaxConvergeSeconds))
+	{
+		second++;
+		timestamp = second * 1000;
+
+		for (unsigned int bridgeIndex = 0; bridgeIndex < bridgeCount; bridgeIndex++)
+			STP_OnOneSecondTick (network.bridges [bridgeIndex], timestamp);
+
+		DeliverPendingBpdus (timestamp);
+
+		if (network.portChangeCount != lastChangeCount)
+		{
+			lastChangeCount = network.portChangeCount;
+			lastChangeSecond = second;
+			lastChangeClock = clock ();
+		}
+	}
+
+	double convergeCpuSeconds = GetSeconds (convergeStart, lastChangeClock);
+	bool converged = (second - lastChangeSecond >= StableSeconds);
+
+	// ------------------------------------------------------------------------
+	// Steady state: time the ticks and the deliveries separately.
+
+	clock_t tickClocks = 0;
+	clock_t deliverClocks = 0;
+	unsigned int tickCount = 0;
+	unsigned int bpduCount = 0;
+
+	for (unsigned int i = 0; i < steadySeconds; i++)
+	{
+		second++;
+		timestamp = second * 1000;
+
+		clock_t t0 = clock ();
+
+		for (unsigned int bridgeIndex = 0; bridgeIndex < bridgeCount; bridgeIndex++)
+			STP_OnOneSecondTick (network.bridges [bridgeIndex], timestamp);
+
+		clock_t t1 = clock ();
+
+		bpduCount += DeliverPendingBpdus (timestamp);
+
+		clock_t t2 = clock ();
+
+		tickClocks += t1 - t0;
+		deliverClocks += t2 - t1;
+		tickCount += bridgeCount;
+	}
+
+	double tickSeconds = (double) tickClocks / CLOCKS_PER_SEC;
+	double deliverSeconds = (double) deliverClocks / CLOCKS_PER_SEC;
+
+	// ------------------------------------------------------------------------
+	// Link flap storm: each second, toggle some random links, delivering the BPDUs after each toggle, then tick.
+
+	std::vector<bool> linkUp (links.size (), true);
+	unsigned int togglesPerSecond = (links.size () / 8 >= 1) ? (unsigned int) (links.size () / 8) : 1;
+	unsigned int randomState = 1;
+	unsigned int stormBpduCount = 0;
+
+	clock_t stormStart = clock ();
+
+	for (unsigned int i = 0; i < flapSeconds; i++)
+	{
+		second++;
+		timestamp = second * 1000;
+
+		for (unsigned int t = 0; t < togglesPerSecond; t++)
+		{
+			unsigned int linkIndex = Random (&randomState) % links.size ();
+			STP_BRIDGE* bridgeA = network.bridges [links [linkIndex].bridgeA];
+			STP_BRIDGE* bridgeB = network.bridges [links [linkIndex].bridgeB];
+			if (linkUp [linkIndex])
+			{
+				STP_OnPortDisabled (bridgeA, linkPortsA [linkIndex], timestamp);
+				STP_OnPortDisabled (bridgeB, linkPortsB [linkIndex], timestamp);
+			}
+			else
+			{
+				STP_OnPortEnabled (bridgeA, linkPortsA [linkIndex], 1000, true, timestamp);
+				STP_OnPortEnabled (bridgeB, linkPortsB [linkIndex], 1000, true, timestamp);
+			}
+
+			linkUp [linkIndex] = !linkUp [linkIndex];
+			stormBpduCount += DeliverPendingBpdus (timestamp);
+		}
+
+		for (unsigned int bridgeIndex = 0; bridgeIndex < bridgeCount; bridgeIndex++)
+			STP_OnOneSecondTick (network.bridges [bridgeIndex], timestamp);
+
+		stormBpduCount += DeliverPendingBpdus (timestamp);
+	}
+
+	double stormCpuSeconds = GetSeconds (stormStart, clock ());
+
+	char versionText [16];
+	if (version == STP_VERSION_MSTP)
+		sprintf (versionText, "MSTP/%u", mstiCount);
+	else
+		sprintf (versionText, "%s", STP_GetVersionString (version));
+
+	char buildText [16];
+	sprintf (buildText, "M%u L%u", (unsigned int) STP_MAX_MSTI_COUNT, (unsigned int) STP_USE_LOG);
+
+	printf ("%-7s %-8s %6u %-9s %6u%s %10.3f %12.3f %12.3f %12.0f %12.3f %12u\n",
+			buildText, TopologyNames [topology], bridgeCount, versionText,
+			lastChangeSecond, converged ? " " : "+",
+			convergeCpuSeconds * 1000,
+			(tickCount != 0) ? (tickSeconds * 1e6 / tickCount) : 0.0,
+			(bpduCount != 0) ? (deliverSeconds * 1e6 / bpduCount) : 0.0,
+			(deliverSeconds > 0) ? (bpduCount / deliverSeconds) : 0.0,
+			stormCpuSeconds * 1000, stormBpduCount);
+	fflush (stdout);
+
+	for (unsigned int bridgeIndex = 0; bridgeIndex < bridgeCount; bridgeIndex++)
+		STP_DestroyBridge (network.bridges [bridgeIndex]);
+
+	network.bridges.clear ();
+}
+
+// ============================================================================
+
+static void RunMstConfigBenchmark (unsigned int maxVlanNumber, unsigned int changeCount)
+{
+	static const unsigned int MstiCount = STP_MAX_MSTI_COUNT;
+
+	unsigned char address[6] = { 0x00, 0xAA, 0xBB, 0x00, 0x00, 0x00 };
+	STP_BRIDGE* bridge = STP_CreateBridge (1, MstiCount, maxVlanNumber, &Callbacks, address, 256);
+	STP_SetStpVersion (bridge, STP_VERSION_MSTP, 0);
+
+	std::vector<STP_CONFIG_TABLE_ENTRY> configTable (1 + maxVlanNumber);
+
+	// Change each time a single VLAN in the given range, the way a provisioning system would map VLANs one by one.
+	// The first and the last hundred VLANs are clamped to 1..maxVlanNumber for bridges with fewer than 100 VLANs.
+	unsigned int first100End = (maxVlanNumber < 100) ? maxVlanNumber : 100;
+	unsigned int last100Start = (maxVlanNumber < 100) ? 1 : (maxVlanNumber - 99);
+	const unsigned int ranges[][2] = { { 1, first100End }, { 1, maxVlanNumber }, { last100Start, maxVlanNumber } };
+
+	for (unsigned int r = 0; r < sizeof (ranges) / sizeof (ranges [0]); r++)
+	{
+		unsigned int firstVlan = ranges [r][0];
+		unsigned int vlanCount = ranges [r][1] - ranges [r][0] + 1;
+
+		clock_t start = clock ();
+		for (unsigned int i = 0; i < changeCount; i++)
+		{
+			unsigned int vlanNumber = firstVlan + i % vlanCount;
+			configTable [vlanNumber].treeIndex = (unsigned char) ((configTable [vlanNumber].treeIndex + 1) % (1 + MstiCount));
+			STP_SetMstConfigTable (bridge, &configTable [0], (unsigned int) configTable.size (), i);
+		}
+		clock_t end = clock ();
+
+		// The same changes, passed to the library one entry at a time.
+		clock_t entriesStart = clock ();
+		for (unsigned int i = 0; i < changeCount; i++)
+		{
+			unsigned int vlanNumber = firstVlan + i % vlanCount;
+			configTable [vlanNumber].treeIndex = (unsigned char) ((configTable [vlanNumber].treeIndex + 1) % (1 + MstiCount));
+			STP_SetMstConfigTableEntries (bridge, vlanNumber, 1, &configTable [vlanNumber].treeIndex, i);
+		}
+		clock_t entriesEnd = clock ();
+
+		printf ("%4u        %4u..%-4u      %12.3f %12.3f\n", maxVlanNumber, ranges [r][0], ranges [r][1],
+				GetSeconds (start, end) * 1e6 / changeCount, GetSeconds (entriesStart, entriesEnd) * 1e6 / changeCount);
+	}
+
+	STP_DestroyBridge (bridge);
+}
+
+// ============================================================================
+
+static void PrintHeader ()
+{
+	printf ("build   Topology bridges version   converged (s) CPU (ms)   tick (us)    BPDU (us)    BPDUs/s   storm (ms)  storm BPDUs\n");
+}
+
+static void PrintUsage ()
+{
+	fprintf (stderr, "Usage: Benchmark [-topology ring|chain|mesh|fattree] [-bridges N] [-version rstp|mstp] [-msti N] [-seconds N] [-flaps N] [-batch 0|1]\n");
+	fprintf (stderr, "       Benchmark -mstconfig N\n");
+}
+
+int main (int argc, char* argv[])
+{
+	if (argc == 1)
+	{
+		static const TOPOLOGY topologies[] = { TOPOLOGY_RING, TOPOLOGY_CHAIN, TOPOLOGY_MESH, TOPOLOGY_FAT_TREE };
+		static const unsigned int bridgeCounts[] = { 32, 32, 12, 24 };
+		static const unsigned int mstiCounts[] = { 0, 4, 16, 64 };
+
+		PrintHeader ();
+		for (unsigned int t = 0; t < sizeof (topologies) / sizeof (topologies [0]); t++)
+		{
+			RunBenchmark (topologies [t], bridgeCounts [t], STP_VERSION_RSTP, 0, 100, 100);
+
+			for (unsigned int m = 0; m < sizeof (mstiCounts) / sizeof (mstiCounts [0]); m++)
+			{
+				if (mstiCounts [m] <= STP_MAX_MSTI_COUNT)
+					RunBenchmark (topologies [t], bridgeCounts [t], STP_VERSION_MSTP, mstiCounts [m], 100, 100);
+			}
+		}
+
+		return 0;
+	}
+
+	if ((argc == 3) && (strcmp (argv [1], "-mstconfig") == 0))
+	{
+		if (STP_MAX_MSTI_COUNT == 0)
+		{
+			fprintf (stderr, "-mstconfig needs a build with MSTIs.\n");
+			return 1;
+		}
+
+		printf ("maxVlan     VLANs changed   us per change (whole table / entries)\n");
+		RunMstConfigBenchmark (4094, (unsigned int) atoi (argv [2]));
+		RunMstConfigBenchmark (1024, (unsigned int) atoi (argv [2]));
+		return 0;
+	}
+
+	TOPOLOGY topology = TOPOLOGY_RING;
+	unsigned int bridgeCount = 16;
+	enum STP_VERSION version = STP_VERSION_RSTP;
+	unsigned int mstiCount = 0;
+	unsigned int steadySeconds = 100;
+	unsigned int flapSeconds = 100;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (i + 1 >= argc)
+		{
+			PrintUsage ();
+			return 1;
+		}
+
+		const char* name = argv [i];
+		const char* value = argv [++i];
+
+		if (strcmp (name, "-topology") == 0)
+		{
+			unsigned int t;
+			for (t = 0; t < sizeof (TopologyNames) / sizeof (TopologyNames [0]); t++)
+			{
+				if (strcmp (value, TopologyNames [t]) == 0)
+					break;
+			}
+
+			if (t == sizeof (TopologyNames) / sizeof (TopologyNames [0]))
+			{
+				PrintUsage ();
+				return 1;
+			}
+
+			topology = (TOPOLOGY) t;
+		}
+		else if (strcmp (name, "-bridges") == 0)
+			bridgeCount = (unsigned int) atoi (value);
+		else if (strcmp (name, "-version") == 0)
+			version = (strcmp (value, "mstp") == 0) ? STP_VERSION_MSTP : STP_VERSION_RSTP;
+		else if (strcmp (name, "-msti") == 0)
+			mstiCount = (unsigned int) atoi (value);
+		else if (strcmp (name, "-seconds") == 0)
+			steadySeconds = (unsigned int) atoi (value);
+		else if (strcmp (name, "-flaps") == 0)
+			flapSeconds = (unsigned int) atoi (value);
+		else if (strcmp (name, "-batch") == 0)
+			network.batch = (atoi (value) != 0);
+		else
+		{
+			PrintUsage ();
+			return 1;
+		}
+	}
+
+	if ((bridgeCount < 2) || (mstiCount > STP_MAX_MSTI_COUNT) || ((mstiCount > 0) && (version != STP_VERSION_MSTP)))
+	{
+		PrintUsage ();
+		return 1;
+	}
+
+	PrintHeader ();
+	RunBenchmark (topology, bridgeCount, version, mstiCount, steadySeconds, flapSeconds);
+	return 0;
+}
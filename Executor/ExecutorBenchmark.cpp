@@ -0,0 +1,278 @@
+
+// This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
+// Copyright (c) 2011-2017 Adi Gostin, distributed under Apache License v2.0.
+
+// Scaling benchmark for STP_EXECUTOR. It creates many bridges, wired in rings like those of the Benchmark program,
+// hands them to an executor, and runs the same simulation with 1, 2, 4... worker threads, up to the given count.
+// The BPDUs go from bridge to bridge through the executor's queues, as they would in an application hosting the bridges
+// of several virtual switches. For each thread count it reports the wall-clock time, the number of events executed,
+// and a checksum of the final port roles, which must be the same for all thread counts.
+//
+// It needs C++11; the build command is, for example:
+//		g++ -std=c++11 -O2 -DNDEBUG -pthread -I../mstp-lib ExecutorBenchmark.cpp stp_executor.cpp ../mstp-lib/*.cpp ../mstp-lib/802.1Q-2011/*.cpp -o ExecutorBenchmark
+//
+// Usage: ExecutorBenchmark [-bridges N] [-ringsize N] [-version rstp|mstp] [-msti N] [-seconds N] [-threads N]
+
+#include "stp_executor.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+struct PEER
+{
+	int bridgeIndex; // -1 if the port is not connected
+	unsigned int portIndex;
+};
+
+// The callbacks of a bridge run on one thread at a time, so each bridge can have its own transmit buffer.
+struct BENCHMARK_BRIDGE
+{
+	std::vector<PEER> peers; // [port]
+	unsigned char transmitBuffer [2048];
+	unsigned int transmitPortIndex;
+	unsigned int transmitBpduSize;
+	unsigned int transmitTimestamp;
+};
+
+static STP_EXECUTOR* executor;
+
+// ============================================================================
+
+static BENCHMARK_BRIDGE* GetBenchmarkBridge (const STP_BRIDGE* bridge)
+{
+	return (BENCHMARK_BRIDGE*) STP_GetApplicationContext (bridge);
+}
+
+static void EnableLearning (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, unsigned int enable, unsigned int timestamp)
+{
+}
+
+static void EnableForwarding (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, unsigned int enable, unsigned int timestamp)
+{
+}
+
+static void* TransmitGetBuffer (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int bpduSize, unsigned int timestamp)
+{
+	BENCHMARK_BRIDGE* b = GetBenchmarkBridge (bridge);
+	if (bpduSize > sizeof (b->transmitBuffer))
+		return NULL;
+
+	b->transmitPortIndex = portIndex;
+	b->transmitBpduSize = bpduSize;
+	b->transmitTimestamp = timestamp;
+	return b->transmitBuffer;
+}
+
+static void TransmitReleaseBuffer (const STP_BRIDGE* bridge, void* bufferReturnedByGetBuffer)
+{
+	BENCHMARK_BRIDGE* b = GetBenchmarkBridge (bridge);
+	const PEER& peer = b->peers [b->transmitPortIndex];
+	if (peer.bridgeIndex != -1)
+		executor->PostBpduReceived (peer.bridgeIndex, peer.portIndex, b->transmitBuffer, b->transmitBpduSize, b->transmitTimestamp);
+}
+
+static void FlushFdb (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, enum STP_FLUSH_FDB_TYPE flushType)
+{
+}
+
+static void DebugStrOut (const STP_BRIDGE* bridge, int portIndex, int treeIndex, const char* nullTerminatedString, unsigned int stringLength, unsigned int flush)
+{
+}
+
+static void OnTopologyChange (const STP_BRIDGE* bridge)
+{
+}
+
+static void OnNotifiedTopologyChange (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, unsigned int timestamp)
+{
+}
+
+static void OnPortRoleChanged (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, enum STP_PORT_ROLE role, unsigned int timestamp)
+{
+}
+
+static void OnConfigChanged (const STP_BRIDGE* bridge, unsigned int timestamp)
+{
+}
+
+static void* AllocAndZeroMemory (unsigned int size)
+{
+	return calloc (1, size);
+}
+
+static void FreeMemory (void* p)
+{
+	free (p);
+}
+
+static const STP_CALLBACKS Callbacks =
+{
+	EnableLearning,
+	EnableForwarding,
+	TransmitGetBuffer,
+	TransmitReleaseBuffer,
+	FlushFdb,
+	DebugStrOut,
+	OnTopologyChange,
+	OnNotifiedTopologyChange,
+	OnPortRoleChanged,
+	OnConfigChanged,
+	AllocAndZeroMemory,
+	FreeMemory,
+	NULL, // transmitBatch
+};
+
+// ============================================================================
+
+static void StartBridge (STP_BRIDGE* bridge, void* context, unsigned int timestamp)
+{
+	STP_StartBridge (bridge, timestamp);
+}
+
+static void RunBenchmark (unsigned int threadCount, unsigned int bridgeCount, unsigned int ringSize, enum STP_VERSION version, unsigned int mstiCount, unsigned int seconds)
+{
+	executor = new STP_EXECUTOR (threadCount);
+
+	// Bridge i is connected through port 0 to port 1 of the next bridge in its ring.
+	std::vector<BENCHMARK_BRIDGE> benchmarkBridges (bridgeCount);
+	for (unsigned int i = 0; i < bridgeCount; i++)
+	{
+		unsigned int ringStart = i - i % ringSize;
+		unsigned int ringEnd = (ringStart + ringSize < bridgeCount) ? (ringStart + ringSize) : bridgeCount;
+		unsigned int next = (i + 1 < ringEnd) ? (i + 1) : ringStart;
+		unsigned int previous = (i > ringStart) ? (i - 1) : (ringEnd - 1);
+
+		benchmarkBridges [i].peers.resize (2);
+		PEER nextPeer = { (next != i) ? (int) next : -1, 1 };
+		PEER previousPeer = { (previous != i) ? (int) previous : -1, 0 };
+		benchmarkBridges [i].peers [0] = nextPeer;
+		benchmarkBridges [i].peers [1] = previousPeer;
+
+		unsigned char address[6] = { 0x00, 0xAA, 0xBB, 0x00, (unsigned char) (i >> 8), (unsigned char) i };
+		STP_BRIDGE* bridge = STP_CreateBridge (2, mstiCount, (version == STP_VERSION_MSTP) ? 4094 : 0, &Callbacks, address, 256);
+		STP_SetApplicationContext (bridge, &benchmarkBridges [i]);
+		STP_SetStpVersion (bridge, version, 0);
+		executor->AddBridge (bridge);
+	}
+
+	unsigned int timestamp = 0;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+
+	for (unsigned int i = 0; i < bridgeCount; i++)
+		executor->PostFunction (i, StartBridge, NULL, timestamp);
+
+	for (unsigned int i = 0; i < bridgeCount; i++)
+	{
+		for (unsigned int portIndex = 0; portIndex < 2; portIndex++)
+		{
+			if (benchmarkBridges [i].peers [portIndex].bridgeIndex != -1)
+				executor->PostPortEnabled (i, portIndex, 1000, 1, timestamp);
+		}
+	}
+
+	executor->WaitIdle ();
+
+	for (unsigned int s = 0; s < seconds; s++)
+	{
+		timestamp += 1000;
+		executor->PostOneSecondTick (timestamp);
+		executor->WaitIdle ();
+	}
+
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now ();
+	double wallSeconds = std::chrono::duration<double> (end - start).count ();
+
+	// The executor is idle, so we can look at the bridges from this thread.
+	unsigned int treeCount = (version == STP_VERSION_MSTP) ? (1 + mstiCount) : 1;
+	unsigned int checksum = 0;
+	for (unsigned int i = 0; i < bridgeCount; i++)
+	{
+		for (unsigned int portIndex = 0; portIndex < 2; portIndex++)
+		{
+			for (unsigned int treeIndex = 0; treeIndex < treeCount; treeIndex++)
+				checksum = checksum * 31 + STP_GetPortRole (executor->GetBridge (i), portIndex, treeIndex);
+		}
+	}
+
+	unsigned long long eventCount = executor->GetExecutedEventCount ();
+
+	delete executor;
+	executor = NULL;
+
+	static double oneThreadSeconds;
+	if (threadCount == 1)
+		oneThreadSeconds = wallSeconds;
+
+	printf ("%7u %12.3f %12llu %12.0f %9.2f     %08x\n", threadCount, wallSeconds, eventCount, eventCount / wallSeconds, oneThreadSeconds / wallSeconds, checksum);
+}
+
+// ============================================================================
+
+static void PrintUsage ()
+{
+	fprintf (stderr, "Usage: ExecutorBenchmark [-bridges N] [-ringsize N] [-version rstp|mstp] [-msti N] [-seconds N] [-threads N]\n");
+}
+
+int main (int argc, char* argv[])
+{
+	unsigned int bridgeCount = 512;
+	unsigned int ringSize = 16;
+	enum STP_VERSION version = STP_VERSION_RSTP;
+	unsigned int mstiCount = 0;
+	unsigned int seconds = 30;
+	unsigned int maxThreadCount = std::thread::hardware_concurrency ();
+	if (maxThreadCount == 0)
+		maxThreadCount = 1;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (i + 1 >= argc)
+		{
+			PrintUsage ();
+			return 1;
+		}
+
+		const char* value = argv [i + 1];
+		if (strcmp (argv [i], "-bridges") == 0)
+			bridgeCount = (unsigned int) atoi (value);
+		else if (strcmp (argv [i], "-ringsize") == 0)
+			ringSize = (unsigned int) atoi (value);
+		else if (strcmp (argv [i], "-version") == 0)
+			version = (strcmp (value, "mstp") == 0) ? STP_VERSION_MSTP : STP_VERSION_RSTP;
+		else if (strcmp (argv [i], "-msti") == 0)
+			mstiCount = (unsigned int) atoi (value);
+		else if (strcmp (argv [i], "-seconds") == 0)
+			seconds = (unsigned int) atoi (value);
+		else if (strcmp (argv [i], "-threads") == 0)
+			maxThreadCount = (unsigned int) atoi (value);
+		else
+		{
+			PrintUsage ();
+			return 1;
+		}
+
+		i++;
+	}
+
+	if ((bridgeCount == 0) || (ringSize == 0) || (maxThreadCount == 0))
+	{
+		PrintUsage ();
+		return 1;
+	}
+
+	printf ("%u bridges in rings of %u, %s", bridgeCount, ringSize, STP_GetVersionString (version));
+	if (version == STP_VERSION_MSTP)
+		printf (" with %u MSTIs", mstiCount);
+	printf (", %u simulated seconds\n", seconds);
+	printf ("threads    wall (s)       events     events/s   speedup     roles\n");
+
+	for (unsigned int threadCount = 1; threadCount < maxThreadCount; threadCount *= 2)
+		RunBenchmark (threadCount, bridgeCount, ringSize, version, mstiCount, seconds);
+
+	RunBenchmark (maxThreadCount, bridgeCount, ringSize, version, mstiCount, seconds);
+
+	return 0;
+}
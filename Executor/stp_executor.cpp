@@ -0,0 +1,281 @@
+
+// This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
+// Copyright (c) 2011-2017 Adi Gostin, distributed under Apache License v2.0.
+
+#include "stp_executor.h"
+#include <assert.h>
+
+// The executor owning the worker running on the current thread, or NULL if it's not a worker thread,
+// and the index of that worker. An application may create more than one executor.
+static thread_local const STP_EXECUTOR* currentExecutor = NULL;
+static thread_local unsigned int currentWorkerIndex;
+
+// ============================================================================
+
+STP_EXECUTOR::STP_EXECUTOR (unsigned int threadCount)
+	: readyBridgeCount(0), scheduledBridgeCount(0), nextWorkerIndex(0), executedEventCount(0), stopping(false)
+{
+	assert (threadCount > 0);
+
+	for (unsigned int i = 0; i < threadCount; i++)
+		workers.push_back (std::unique_ptr<WORKER> (new WORKER()));
+
+	// Start them only after the vector is complete, as each worker looks at the lists of the others.
+	for (unsigned int i = 0; i < threadCount; i++)
+		workers [i]->thread = std::thread (&STP_EXECUTOR::WorkerThread, this, i);
+}
+
+STP_EXECUTOR::~STP_EXECUTOR ()
+{
+	{
+		std::lock_guard<std::mutex> lock (sleepMutex);
+		stopping = true;
+	}
+	wakeCondition.notify_all ();
+
+	for (size_t i = 0; i < workers.size (); i++)
+		workers [i]->thread.join ();
+
+	for (size_t i = 0; i < bridges.size (); i++)
+		STP_DestroyBridge (bridges [i]->bridge);
+}
+
+// ============================================================================
+
+unsigned int STP_EXECUTOR::AddBridge (STP_BRIDGE* bridge)
+{
+	// The workers read the vector without locking.
+	assert (scheduledBridgeCount == 0);
+
+	BRIDGE_SLOT* slot = new BRIDGE_SLOT();
+	slot->bridge = bridge;
+	slot->scheduled = false;
+	bridges.push_back (std::unique_ptr<BRIDGE_SLOT> (slot));
+	return (unsigned int) bridges.size () - 1;
+}
+
+// ============================================================================
+
+void STP_EXECUTOR::Post (unsigned int bridgeIndex, EVENT&& event)
+{
+	assert (bridgeIndex < bridges.size ());
+	BRIDGE_SLOT* slot = bridges [bridgeIndex].get ();
+
+	bool wasScheduled;
+	{
+		std::lock_guard<std::mutex> lock (slot->mutex);
+		slot->events.push_back (std::move (event));
+		wasScheduled = slot->scheduled;
+		slot->scheduled = true;
+	}
+
+	if (!wasScheduled)
+	{
+		scheduledBridgeCount++;
+		MakeReady (bridgeIndex, false);
+	}
+}
+
+void STP_EXECUTOR::PostBpduReceived (unsigned int bridgeIndex, unsigned int portIndex, const unsigned char* bpdu, unsigned int bpduSize, unsigned int timestamp)
+{
+	EVENT event = { EVENT_TYPE_BPDU_RECEIVED, timestamp, portIndex, 0, 0, NULL, NULL, { } };
+	event.bpdu.assign (bpdu, bpdu + bpduSize);
+	Post (bridgeIndex, std::move (event));
+}
+
+void STP_EXECUTOR::PostPortEnabled (unsigned int bridgeIndex, unsigned int portIndex, unsigned int speedMegabitsPerSecond, unsigned int detectedPointToPointMAC, unsigned int timestamp)
+{
+	Post (bridgeIndex, EVENT { EVENT_TYPE_PORT_ENABLED, timestamp, portIndex, speedMegabitsPerSecond, detectedPointToPointMAC, NULL, NULL, { } });
+}
+
+void STP_EXECUTOR::PostPortDisabled (unsigned int bridgeIndex, unsigned int portIndex, unsigned int timestamp)
+{
+	Post (bridgeIndex, EVENT { EVENT_TYPE_PORT_DISABLED, timestamp, portIndex, 0, 0, NULL, NULL, { } });
+}
+
+void STP_EXECUTOR::PostOneSecondTick (unsigned int timestamp)
+{
+	for (unsigned int bridgeIndex = 0; bridgeIndex < bridges.size (); bridgeIndex++)
+		Post (bridgeIndex, EVENT { EVENT_TYPE_ONE_SECOND_TICK, timestamp, 0, 0, 0, NULL, NULL, { } });
+}
+
+void STP_EXECUTOR::PostFunction (unsigned int bridgeIndex, FUNCTION function, void* context, unsigned int timestamp)
+{
+	Post (bridgeIndex, EVENT { EVENT_TYPE_FUNCTION, timestamp, 0, 0, 0, function, context, { } });
+}
+
+// ============================================================================
+
+// Puts a bridge in the list of a worker. A worker puts bridges in its own list: at the back, where it takes the next bridge
+// to run from, so that a bridge runs soon after the one that posted it an event; or, with yield, at the front, so that
+// a bridge that still has events after a run lets the others run first.
+void STP_EXECUTOR::MakeReady (unsigned int bridgeIndex, bool yield)
+{
+	unsigned int workerIndex;
+	if (currentExecutor == this)
+		workerIndex = currentWorkerIndex;
+	else
+		workerIndex = nextWorkerIndex++ % workers.size ();
+
+	WORKER* worker = workers [workerIndex].get ();
+	{
+		std::lock_guard<std::mutex> lock (worker->mutex);
+		if (yield)
+			worker->readyBridges.push_front (bridgeIndex);
+		else
+			worker->readyBridges.push_back (bridgeIndex);
+	}
+
+	readyBridgeCount++;
+
+	// Taking the mutex makes sure that a worker that just found no ready bridges is already waiting, and gets woken up.
+	{
+		std::lock_guard<std::mutex> lock (sleepMutex);
+	}
+	wakeCondition.notify_one ();
+}
+
+bool STP_EXECUTOR::TakeReadyBridge (unsigned int workerIndex, unsigned int* bridgeIndexOut)
+{
+	WORKER* worker = workers [workerIndex].get ();
+	{
+		std::lock_guard<std::mutex> lock (worker->mutex);
+		if (!worker->readyBridges.empty ())
+		{
+			*bridgeIndexOut = worker->readyBridges.back ();
+			worker->readyBridges.pop_back ();
+			readyBridgeCount--;
+			return true;
+		}
+	}
+
+	for (size_t i = 1; i < workers.size (); i++)
+	{
+		WORKER* victim = workers [(workerIndex + i) % workers.size ()].get ();
+		std::lock_guard<std::mutex> lock (victim->mutex);
+		if (!victim->readyBridges.empty ())
+		{
+			*bridgeIndexOut = victim->readyBridges.front ();
+			victim->readyBridges.pop_front ();
+			readyBridgeCount--;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// ============================================================================
+
+void STP_EXECUTOR::RunBridge (unsigned int bridgeIndex, std::vector<EVENT>& events, std::vector<STP_RECEIVED_BPDU>& received)
+{
+	BRIDGE_SLOT* slot = bridges [bridgeIndex].get ();
+
+	// Take all events queued so far; those posted while we run them will be taken by the next run.
+	{
+		std::lock_guard<std::mutex> lock (slot->mutex);
+		events.swap (slot->events);
+	}
+
+	for (size_t i = 0; i < events.size (); )
+	{
+		const EVENT& event = events [i];
+
+		if (event.type == EVENT_TYPE_BPDU_RECEIVED)
+		{
+			// Consecutive BPDUs go to the library in a single call, which runs the state machines only once for all of them.
+			received.clear ();
+			size_t end = i;
+			while ((end < events.size ()) && (events [end].type == EVENT_TYPE_BPDU_RECEIVED))
+			{
+				STP_RECEIVED_BPDU entry = { events [end].portIndex, events [end].bpdu.data (), (unsigned int) events [end].bpdu.size () };
+				received.push_back (entry);
+				end++;
+			}
+
+			STP_OnBpdusReceived (slot->bridge, received.data (), (unsigned int) received.size (), events [end - 1].timestamp);
+			i = end;
+			continue;
+		}
+
+		switch (event.type)
+		{
+			case EVENT_TYPE_PORT_ENABLED:
+				STP_OnPortEnabled (slot->bridge, event.portIndex, event.speedMegabitsPerSecond, event.detectedPointToPointMAC, event.timestamp);
+				break;
+
+			case EVENT_TYPE_PORT_DISABLED:
+				STP_OnPortDisabled (slot->bridge, event.portIndex, event.timestamp);
+				break;
+
+			case EVENT_TYPE_ONE_SECOND_TICK:
+				STP_OnOneSecondTick (slot->bridge, event.timestamp);
+				break;
+
+			case EVENT_TYPE_FUNCTION:
+				event.function (slot->bridge, event.context, event.timestamp);
+				break;
+
+			default:
+				assert (false);
+		}
+
+		i++;
+	}
+
+	executedEventCount += events.size ();
+	events.clear ();
+
+	bool hasMoreEvents;
+	{
+		std::lock_guard<std::mutex> lock (slot->mutex);
+		hasMoreEvents = !slot->events.empty ();
+		if (!hasMoreEvents)
+			slot->scheduled = false;
+	}
+
+	if (hasMoreEvents)
+	{
+		MakeReady (bridgeIndex, true);
+	}
+	else if (--scheduledBridgeCount == 0)
+	{
+		std::lock_guard<std::mutex> lock (sleepMutex);
+		idleCondition.notify_all ();
+	}
+}
+
+// ============================================================================
+
+void STP_EXECUTOR::WorkerThread (unsigned int workerIndex)
+{
+	currentExecutor = this;
+	currentWorkerIndex = workerIndex;
+
+	// Reused from one run to the next, to avoid allocating memory on each run.
+	std::vector<EVENT> events;
+	std::vector<STP_RECEIVED_BPDU> received;
+
+	while (!stopping)
+	{
+		unsigned int bridgeIndex;
+		if (TakeReadyBridge (workerIndex, &bridgeIndex))
+		{
+			RunBridge (bridgeIndex, events, received);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock (sleepMutex);
+		wakeCondition.wait (lock, [this] { return stopping || (readyBridgeCount > 0); });
+	}
+}
+
+// ============================================================================
+
+void STP_EXECUTOR::WaitIdle ()
+{
+	assert (currentExecutor != this);
+
+	std::unique_lock<std::mutex> lock (sleepMutex);
+	idleCondition.wait (lock, [this] { return scheduledBridgeCount == 0; });
+}
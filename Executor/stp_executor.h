@@ -0,0 +1,128 @@
+
+// This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
+// Copyright (c) 2011-2017 Adi Gostin, distributed under Apache License v2.0.
+
+#ifndef MSTP_LIB_EXECUTOR_H
+#define MSTP_LIB_EXECUTOR_H
+
+// Optional runtime for applications that host many bridges in one process (one per virtual switch, for instance).
+// It owns the bridges, keeps a queue of events (received BPDUs, port events, ticks, arbitrary calls) for each of them,
+// and executes the queues on a pool of worker threads. The events of a bridge are executed in the order they were
+// posted, and never on two threads at once, so the library and the callbacks of a bridge need no locking;
+// different bridges run in parallel.
+//
+// Each worker keeps its own list of bridges ready to run. A bridge that receives an event posted from a callback
+// running on a worker of the same executor goes to the list of that worker, as it likely shares data with the bridge
+// that posted it; events posted from other threads, including the workers of other executors, are spread over
+// the workers in turn. A worker whose list is empty takes
+// the oldest bridge from the list of another worker.
+//
+// Unlike the library, which is C++03, this needs C++11 for its threads. It's not needed to build the library.
+
+#include "stp.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class STP_EXECUTOR
+{
+public:
+	typedef void (*FUNCTION) (STP_BRIDGE* bridge, void* context, unsigned int timestamp);
+
+	explicit STP_EXECUTOR (unsigned int threadCount);
+
+	// Lets the worker threads finish the bridges they are running and stops them, then destroys the bridges.
+	// Events still queued are dropped.
+	~STP_EXECUTOR ();
+
+	// Hands a bridge over to the executor, which will destroy it. Call this before posting the first event.
+	// Returns the index by which the other functions refer to the bridge: 0 for the first bridge, 1 for the second and so on.
+	unsigned int AddBridge (STP_BRIDGE* bridge);
+
+	unsigned int GetBridgeCount () const { return (unsigned int) bridges.size (); }
+
+	// Don't call library functions on the returned bridge while the executor may be running it; post a function instead.
+	STP_BRIDGE* GetBridge (unsigned int bridgeIndex) const { return bridges [bridgeIndex]->bridge; }
+
+	// These can be called from any thread, including from the STP callbacks of any bridge.
+	// They queue a call to the library function with the same name. BPDUs are copied.
+	void PostBpduReceived (unsigned int bridgeIndex, unsigned int portIndex, const unsigned char* bpdu, unsigned int bpduSize, unsigned int timestamp);
+	void PostPortEnabled (unsigned int bridgeIndex, unsigned int portIndex, unsigned int speedMegabitsPerSecond, unsigned int detectedPointToPointMAC, unsigned int timestamp);
+	void PostPortDisabled (unsigned int bridgeIndex, unsigned int portIndex, unsigned int timestamp);
+	void PostOneSecondTick (unsigned int timestamp); // to all bridges
+
+	// Queues a call to any function; use this for the configuration functions of the library.
+	void PostFunction (unsigned int bridgeIndex, FUNCTION function, void* context, unsigned int timestamp);
+
+	// Waits until the queues of all bridges are empty, including the events posted by the callbacks in the meantime.
+	// Must not be called from a callback.
+	void WaitIdle ();
+
+	// Number of events executed so far, for statistics.
+	unsigned long long GetExecutedEventCount () const { return executedEventCount; }
+
+private:
+	enum EVENT_TYPE
+	{
+		EVENT_TYPE_BPDU_RECEIVED,
+		EVENT_TYPE_PORT_ENABLED,
+		EVENT_TYPE_PORT_DISABLED,
+		EVENT_TYPE_ONE_SECOND_TICK,
+		EVENT_TYPE_FUNCTION,
+	};
+
+	struct EVENT
+	{
+		EVENT_TYPE type;
+		unsigned int timestamp;
+		unsigned int portIndex;
+		unsigned int speedMegabitsPerSecond;
+		unsigned int detectedPointToPointMAC;
+		FUNCTION function;
+		void* context;
+		std::vector<unsigned char> bpdu;
+	};
+
+	struct BRIDGE_SLOT
+	{
+		STP_BRIDGE* bridge;
+		std::mutex mutex;
+		std::vector<EVENT> events;
+		bool scheduled; // true from the moment the bridge has events until a worker finds its queue empty
+	};
+
+	struct WORKER
+	{
+		std::mutex mutex;
+		std::deque<unsigned int> readyBridges; // the owner takes from the back, other workers from the front
+		std::thread thread;
+	};
+
+	std::vector<std::unique_ptr<BRIDGE_SLOT> > bridges;
+	std::vector<std::unique_ptr<WORKER> > workers;
+
+	std::atomic<unsigned int> readyBridgeCount;		// bridges in the readyBridges lists of all workers
+	std::atomic<unsigned int> scheduledBridgeCount;	// bridges with BRIDGE_SLOT::scheduled set
+	std::atomic<unsigned int> nextWorkerIndex;
+	std::atomic<unsigned long long> executedEventCount;
+	std::atomic<bool> stopping;
+
+	std::mutex sleepMutex;
+	std::condition_variable wakeCondition;	// workers wait on this for ready bridges
+	std::condition_variable idleCondition;	// WaitIdle waits on this for scheduledBridgeCount to become zero
+
+	void Post (unsigned int bridgeIndex, EVENT&& event);
+	void MakeReady (unsigned int bridgeIndex, bool yield);
+	bool TakeReadyBridge (unsigned int workerIndex, unsigned int* bridgeIndexOut);
+	void RunBridge (unsigned int bridgeIndex, std::vector<EVENT>& events, std::vector<STP_RECEIVED_BPDU>& received);
+	void WorkerThread (unsigned int workerIndex);
+
+	STP_EXECUTOR (const STP_EXECUTOR&);
+	STP_EXECUTOR& operator= (const STP_EXECUTOR&);
+};
+
+#endif
@@ -0,0 +1,300 @@
+// This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
+// Copyright (c) 2011-2017 Adi Gostin, distributed under Apache License v2.0.
+
+// Randomized equivalence test for Cmp() in stp_base_types.cpp. On GCC, Clang and MSVC, Cmp compares eight bytes
+// at a time; this program checks it against the byte-by-byte loop it replaced, on random inputs of all sizes
+// and alignments up to a few priority vectors long, and on inputs that are equal up to a random position
+// (the common case when comparing priority vectors of the same root).
+//
+// It also checks the packed keys of the priority vectors (PRIORITY_VECTOR_KEY) against the vectors: the keys must order
+// them as Cmp does and find the same messages superior, which depends on the whole 12-bit port number of the Designated
+// Port Identifier. Port numbers of 256 and above keep their high four bits in the same byte as the port priority,
+// so all of them are checked to come back out of PORT_ID unchanged.
+//
+// Build it with STP_CROSS_CHECK_CMP defined, so that the library also checks each call against its own byte loop:
+//		g++ -O2 -DSTP_CROSS_CHECK_CMP -I../mstp-lib CmpTest.cpp ../mstp-lib/*.cpp ../mstp-lib/802.1Q-2011/*.cpp -o CmpTest
+//
+// Usage: CmpTest [-count N] [-seed N]
+// Prints the number of comparisons and exits with 0 if all of them matched, or prints the first mismatch and exits with 1.
+
+#include "stp_base_types.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const int MaxSize = 3 * (int) sizeof (PRIORITY_VECTOR);
+static const int MaxOffset = 8;
+
+static unsigned int randomState;
+
+// ============================================================================
+
+// xorshift32, so that a seed gives the same inputs on all platforms.
+static unsigned int Random ()
+{
+	randomState ^= randomState << 13;
+	randomState ^= randomState >> 17;
+	randomState ^= randomState << 5;
+	return randomState;
+}
+
+// The Cmp of the library before the word-at-a-time fast path.
+static int CmpBytesReference (const unsigned char* p1, const unsigned char* p2, int size)
+{
+	for (int i = 0; i < size; i++)
+	{
+		if (p1 [i] > p2 [i])
+			return 1;
+
+		if (p1 [i] < p2 [i])
+			return -1;
+	}
+
+	return 0;
+}
+
+// Bytes at the extremes of the range and around the sign bit catch signed loads and comparisons.
+static unsigned char RandomByte ()
+{
+	static const unsigned char SpecialBytes[] = { 0x00, 0x01, 0x7F, 0x80, 0x81, 0xFE, 0xFF };
+
+	unsigned int r = Random ();
+	if ((r & 3) == 0)
+		return SpecialBytes [(r >> 2) % sizeof (SpecialBytes)];
+
+	return (unsigned char) (r >> 8);
+}
+
+// ============================================================================
+
+static bool CheckOne (const unsigned char* p1, const unsigned char* p2, int size)
+{
+	int expected = CmpBytesReference (p1, p2, size);
+	int result = Cmp (p1, p2, size);
+	if (result == expected)
+		return true;
+
+	printf ("Mismatch for size %d: Cmp returned %d, the byte loop %d.\n", size, result, expected);
+	for (int i = 0; i < size; i++)
+		printf ("%02X%s", p1 [i], (i + 1 < size) ? " " : "\n");
+	for (int i = 0; i < size; i++)
+		printf ("%02X%s", p2 [i], (i + 1 < size) ? " " : "\n");
+	return false;
+}
+
+// Compares the two buffers at the given offsets, and also with their arguments swapped.
+static bool Check (const unsigned char* p1, const unsigned char* p2, int size)
+{
+	return CheckOne (p1, p2, size) && CheckOne (p2, p1, size) && CheckOne (p1, p1, size);
+}
+
+static bool RunTest (unsigned int count)
+{
+	unsigned char buffer1 [MaxSize + MaxOffset];
+	unsigned char buffer2 [MaxSize + MaxOffset];
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		int size = (int) (Random () % (MaxSize + 1));
+		unsigned char* p1 = &buffer1 [Random () % MaxOffset];
+		unsigned char* p2 = &buffer2 [Random () % MaxOffset];
+
+		for (int j = 0; j < size; j++)
+			p1 [j] = RandomByte ();
+
+		unsigned int kind = Random () % 4;
+		if (kind == 0)
+		{
+			// Unrelated random bytes; they nearly always differ in the first byte.
+			for (int j = 0; j < size; j++)
+				p2 [j] = RandomByte ();
+		}
+		else
+		{
+			// Equal up to a random position, then one differing byte (or none, for kind 1), then random bytes.
+			memcpy (p2, p1, size);
+			if ((kind != 1) && (size > 0))
+			{
+				int position = (int) (Random () % size);
+				p2 [position] = RandomByte ();
+				if (kind == 3)
+				{
+					for (int j = position + 1; j < size; j++)
+						p2 [j] = RandomByte ();
+				}
+			}
+		}
+
+		if (!Check (p1, p2, size))
+			return false;
+	}
+
+	// And exhaustively, all single-byte differences of two bytes at each position of a priority vector,
+	// with the other bytes all 0x00 or all 0xFF.
+	for (int fill = 0; fill <= 0xFF; fill += 0xFF)
+	{
+		for (int position = 0; position < (int) sizeof (PRIORITY_VECTOR); position++)
+		{
+			for (int a = 0; a <= 0xFF; a++)
+			{
+				for (int b = 0; b <= 0xFF; b++)
+				{
+					memset (buffer1, fill, sizeof (PRIORITY_VECTOR));
+					memset (buffer2, fill, sizeof (PRIORITY_VECTOR));
+					buffer1 [position] = (unsigned char) a;
+					buffer2 [position] = (unsigned char) b;
+					if (!CheckOne (buffer1, buffer2, (int) sizeof (PRIORITY_VECTOR)))
+						return false;
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+// ============================================================================
+
+static bool CheckPortIds ()
+{
+	for (unsigned int priority = 0; priority <= 0xF0; priority += 0x10)
+	{
+		for (unsigned int portNumber = 1; portNumber <= 0xFFF; portNumber++)
+		{
+			PORT_ID portId;
+			portId.Set ((unsigned char) priority, (unsigned short) portNumber);
+
+			if ((portId.GetPortNumber () != portNumber) || (portId.GetPriority () != priority)
+				|| (portId.GetPortIdentifier () != ((priority << 8) | portNumber)))
+			{
+				printf ("Port priority 0x%02X and port number %u came back as priority 0x%02X, port number %u, identifier 0x%04X.\n",
+						priority, portNumber, portId.GetPriority (), portId.GetPortNumber (), portId.GetPortIdentifier ());
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+// Fills the vector with random bytes and returns the port number of its Designated Port Identifier,
+// which must not be zero, as that means an uninitialized PORT_ID.
+static unsigned short RandomPriorityVector (PRIORITY_VECTOR* vector)
+{
+	unsigned char* p = (unsigned char*) vector;
+	for (unsigned int i = 0; i < sizeof (PRIORITY_VECTOR); i++)
+		p [i] = RandomByte ();
+
+	unsigned short portNumber = (unsigned short) (1 + Random () % 0xFFF);
+	vector->DesignatedPortId.Set (RandomByte () & 0xF0, portNumber);
+	return portNumber;
+}
+
+static int Sign (int value)
+{
+	return (value > 0) ? 1 : ((value < 0) ? -1 : 0);
+}
+
+static bool CheckKeys (unsigned int count)
+{
+	for (unsigned int i = 0; i < count; i++)
+	{
+		PRIORITY_VECTOR a;
+		PRIORITY_VECTOR b;
+		unsigned short portNumberA = RandomPriorityVector (&a);
+		unsigned short portNumberB = RandomPriorityVector (&b);
+
+		unsigned int kind = Random () % 4;
+		if (kind == 0)
+		{
+			// Unrelated vectors.
+		}
+		else
+		{
+			// The same Designated Bridge address, with other bridge and port priorities, and the same port number
+			// or one that differs only in its high four bits. For kind 3, all other components are the same too.
+			if (kind == 3)
+				b = a;
+
+			b.DesignatedBridgeId.SetAddress (a.DesignatedBridgeId.GetAddress ().bytes);
+			b.DesignatedBridgeId.SetPriority ((unsigned short) ((Random () % 16) * 4096), (unsigned short) (Random () % 4096));
+
+			portNumberB = portNumberA;
+			if ((kind == 2) && (portNumberA > 0xFF))
+				portNumberB = portNumberA ^ (unsigned short) (0x100 << (Random () % 4));
+			if ((portNumberB == 0) || (portNumberB > 0xFFF))
+				portNumberB = portNumberA;
+
+			b.DesignatedPortId.Set (RandomByte () & 0xF0, portNumberB);
+		}
+
+		PRIORITY_VECTOR_KEY keyA;
+		PRIORITY_VECTOR_KEY keyB;
+		keyA.Set (a);
+		keyB.Set (b);
+
+		int expected = Sign (Cmp (&a, &b, (int) sizeof (PRIORITY_VECTOR)));
+		int result = Sign (keyA.Compare (keyB));
+		bool expectedSuperior = a.IsSuperiorTo (b);
+		bool superior = (result < 0) || keyA.msti.IsFromSameDesignatedPort (keyB.msti);
+
+		if ((result != expected) || (superior != expectedSuperior))
+		{
+			printf ("Key mismatch for port numbers %u and %u: Compare returned %d, Cmp %d; IsSuperiorTo returned %d for the keys, %d for the vectors.\n",
+					portNumberA, portNumberB, result, expected, superior, expectedSuperior);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// ============================================================================
+
+static void PrintUsage ()
+{
+	fprintf (stderr, "Usage: CmpTest [-count N] [-seed N]\n");
+}
+
+int main (int argc, char* argv[])
+{
+	unsigned int count = 5000000;
+	unsigned int seed = 1;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (i + 1 >= argc)
+		{
+			PrintUsage ();
+			return 1;
+		}
+
+		const char* name = argv [i];
+		const char* value = argv [++i];
+
+		if (strcmp (name, "-count") == 0)
+			count = (unsigned int) atoi (value);
+		else if (strcmp (name, "-seed") == 0)
+			seed = (unsigned int) atoi (value);
+		else
+		{
+			PrintUsage ();
+			return 1;
+		}
+	}
+
+	// xorshift gets stuck at zero.
+	randomState = (seed != 0) ? seed : 1;
+
+	if (!RunTest (count))
+		return 1;
+
+	printf ("%u random inputs and %u single-byte differences compared, all the same as the byte loop.\n",
+			count, 2 * (unsigned int) sizeof (PRIORITY_VECTOR) * 256 * 256);
+
+	if (!CheckPortIds () || !CheckKeys (count))
+		return 1;
+
+	printf ("All port identifiers and %u pairs of priority vectors checked, the keys give the same results as the vectors.\n", count);
+	return 0;
+}
@@ -0,0 +1,566 @@
+// This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
+// Copyright (c) 2011-2017 Adi Gostin, distributed under Apache License v2.0.
+
+// Regression tests for the state machines. Each scenario runs a single bridge and plays its neighbors itself,
+// by handing it BPDUs built here byte by byte, so it can put the bridge in the exact situation where the library
+// once went wrong: a state machine that never stops changing state, an assert, or information that never ages out.
+//
+// A state machine that never stops changing state would make the library call hang. The bridge logs every
+// state transition, so a call that logs more than MaxLogLinesPerCall lines is taken as one; the library must be
+// built with the default STP_USE_LOG for this. The asserts of the library must be enabled too, so build it without NDEBUG:
+//		g++ -O2 -I../mstp-lib ScenarioTest.cpp ../mstp-lib/*.cpp ../mstp-lib/802.1Q-2011/*.cpp -o ScenarioTest
+//
+// Usage: ScenarioTest
+// Prints the result of each scenario and exits with 0 if all of them passed, or with 1 if one failed.
+
+#ifdef NDEBUG
+	#error Build this test without NDEBUG, as some of the scenarios check asserts of the library.
+#endif
+
+#include "stp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+static const unsigned int MaxPortCount = 4;
+static const unsigned int MaxVlanNumber = 16;
+static const unsigned int MaxLogLinesPerCall = 100000;
+
+// 14.6: the flags of the CIST and of the MSTI Configuration Messages.
+static const unsigned char FlagTc             = 0x01;
+static const unsigned char FlagProposal       = 0x02;
+static const unsigned char FlagRoleMaster     = 0 << 2;
+static const unsigned char FlagRoleAlternate  = 1 << 2;
+static const unsigned char FlagRoleRoot       = 2 << 2;
+static const unsigned char FlagRoleDesignated = 3 << 2;
+static const unsigned char FlagLearning       = 0x10;
+static const unsigned char FlagForwarding     = 0x20;
+static const unsigned char FlagAgreement      = 0x40;
+static const unsigned char FlagTcAckOrMaster  = 0x80;
+
+// Bridge identifiers are written as a 16-bit priority (with the MSTID) followed by the 48-bit address.
+static const unsigned long long AddressMask = 0x0000FFFFFFFFFFFFULL;
+
+// What a neighbor sends for the CIST, in the units of the BPDUs (times in 1/256 s).
+struct CIST_MESSAGE
+{
+	unsigned char flags;
+	unsigned long long rootId;
+	unsigned int externalRootPathCost;
+	unsigned long long regionalRootId;
+	unsigned int internalRootPathCost;
+	unsigned long long bridgeId;
+	unsigned short portId;
+	unsigned short messageAge;
+	unsigned char remainingHops;
+};
+
+struct MSTI_MESSAGE
+{
+	unsigned char flags;
+	unsigned long long regionalRootId;
+	unsigned int internalRootPathCost;
+	unsigned char bridgePriority;
+	unsigned char portPriority;
+	unsigned char remainingHops;
+};
+
+static STP_BRIDGE* bridge;
+static const char* currentScenario;
+static unsigned int currentSecond;
+static unsigned int logLineCount;
+static std::vector<unsigned char> transmittedBpdus [MaxPortCount];
+
+static unsigned char transmitBuffer [1024];
+static unsigned int transmitPortIndex;
+static unsigned int transmitBpduSize;
+
+// ============================================================================
+
+static void EnableLearning (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, unsigned int enable, unsigned int timestamp)
+{
+}
+
+static void EnableForwarding (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, unsigned int enable, unsigned int timestamp)
+{
+}
+
+static void* TransmitGetBuffer (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int bpduSize, unsigned int timestamp)
+{
+	if (bpduSize > sizeof (transmitBuffer))
+		return NULL;
+
+	transmitPortIndex = portIndex;
+	transmitBpduSize = bpduSize;
+	return transmitBuffer;
+}
+
+static void TransmitReleaseBuffer (const STP_BRIDGE* bridge, void* bufferReturnedByGetBuffer)
+{
+	transmittedBpdus [transmitPortIndex].assign (transmitBuffer, transmitBuffer + transmitBpduSize);
+}
+
+static void FlushFdb (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, enum STP_FLUSH_FDB_TYPE flushType)
+{
+}
+
+static void DebugStrOut (const STP_BRIDGE* bridge, int portIndex, int treeIndex, const char* nullTerminatedString, unsigned int stringLength, unsigned int flush)
+{
+	logLineCount++;
+	if (logLineCount > MaxLogLinesPerCall)
+	{
+		printf ("%s: FAILED, second %u: the state machines don't stop changing state. Last line logged:\n%s",
+				currentScenario, currentSecond, nullTerminatedString);
+		exit (1);
+	}
+}
+
+static void OnTopologyChange (const STP_BRIDGE* bridge)
+{
+}
+
+static void OnNotifiedTopologyChange (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, unsigned int timestamp)
+{
+}
+
+static void OnPortRoleChanged (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, enum STP_PORT_ROLE role, unsigned int timestamp)
+{
+}
+
+static void OnConfigChanged (const STP_BRIDGE* bridge, unsigned int timestamp)
+{
+}
+
+static void* AllocAndZeroMemory (unsigned int size)
+{
+	return calloc (1, size);
+}
+
+static void FreeMemory (void* p)
+{
+	free (p);
+}
+
+static const STP_CALLBACKS Callbacks =
+{
+	EnableLearning,
+	EnableForwarding,
+	TransmitGetBuffer,
+	TransmitReleaseBuffer,
+	FlushFdb,
+	DebugStrOut,
+	OnTopologyChange,
+	OnNotifiedTopologyChange,
+	OnPortRoleChanged,
+	OnConfigChanged,
+	AllocAndZeroMemory,
+	FreeMemory,
+	NULL,
+};
+
+// ============================================================================
+
+static void PutUInt2 (std::vector<unsigned char>& bpdu, unsigned int offset, unsigned int value)
+{
+	bpdu [offset]     = (unsigned char) (value >> 8);
+	bpdu [offset + 1] = (unsigned char) value;
+}
+
+static void PutUInt4 (std::vector<unsigned char>& bpdu, unsigned int offset, unsigned int value)
+{
+	PutUInt2 (bpdu, offset, value >> 16);
+	PutUInt2 (bpdu, offset + 2, value & 0xFFFF);
+}
+
+static void PutBridgeId (std::vector<unsigned char>& bpdu, unsigned int offset, unsigned long long bridgeId)
+{
+	PutUInt4 (bpdu, offset, (unsigned int) (bridgeId >> 32));
+	PutUInt4 (bpdu, offset + 4, (unsigned int) bridgeId);
+}
+
+// 14.4, 14.5 and 14.6 in 802.1Q-2011. An STP Configuration BPDU uses the fields up to the Forward Delay,
+// an RST BPDU also the Version 1 Length, and an MST BPDU all of them. The times are those of a bridge
+// with the default Max Age, Hello Time and Forward Delay.
+static std::vector<unsigned char> MakeBpdu (unsigned char version, const CIST_MESSAGE& cist, const MSTI_MESSAGE* mstis, unsigned int mstiCount)
+{
+	std::vector<unsigned char> bpdu ((version == 0) ? 35 : ((version == 2) ? 36 : (102 + 16 * mstiCount)), 0);
+	bpdu [2] = version;
+	bpdu [3] = (version == 0) ? 0 : 2;
+	bpdu [4] = cist.flags;
+	PutBridgeId (bpdu, 5, cist.rootId);
+	PutUInt4 (bpdu, 13, cist.externalRootPathCost);
+	PutBridgeId (bpdu, 17, (version == 3) ? cist.regionalRootId : cist.bridgeId);
+	PutUInt2 (bpdu, 25, cist.portId);
+	PutUInt2 (bpdu, 27, cist.messageAge);
+	PutUInt2 (bpdu, 29, 20 * 256);
+	PutUInt2 (bpdu, 31, 2 * 256);
+	PutUInt2 (bpdu, 33, 15 * 256);
+
+	if (version == 3)
+	{
+		PutUInt2 (bpdu, 36, 64 + 16 * mstiCount);
+		memcpy (&bpdu [38], STP_GetMstConfigId (bridge), 51);
+		PutUInt4 (bpdu, 89, cist.internalRootPathCost);
+		PutBridgeId (bpdu, 93, cist.bridgeId);
+		bpdu [101] = cist.remainingHops;
+
+		for (unsigned int i = 0; i < mstiCount; i++)
+		{
+			unsigned int offset = 102 + 16 * i;
+			bpdu [offset] = mstis [i].flags;
+			PutBridgeId (bpdu, offset + 1, mstis [i].regionalRootId);
+			PutUInt4 (bpdu, offset + 9, mstis [i].internalRootPathCost);
+			bpdu [offset + 13] = mstis [i].bridgePriority;
+			bpdu [offset + 14] = mstis [i].portPriority;
+			bpdu [offset + 15] = mstis [i].remainingHops;
+		}
+	}
+
+	return bpdu;
+}
+
+static std::vector<unsigned char> MakeTcnBpdu ()
+{
+	std::vector<unsigned char> bpdu (4, 0);
+	bpdu [3] = 0x80;
+	return bpdu;
+}
+
+// ============================================================================
+
+// The bridge under test has the address 00:AA:00:00:00:10 and the default priorities, so the neighbors
+// are better or worse than it depending on their priority. Its ports come up with 100 Mbps links.
+static void CreateBridge (unsigned int portCount, unsigned int mstiCount, enum STP_VERSION version)
+{
+	static const unsigned char Address[6] = { 0x00, 0xAA, 0x00, 0x00, 0x00, 0x10 };
+
+	currentSecond = 0;
+	logLineCount = 0;
+	for (unsigned int portIndex = 0; portIndex < MaxPortCount; portIndex++)
+		transmittedBpdus [portIndex].clear ();
+
+	bridge = STP_CreateBridge (portCount, mstiCount, MaxVlanNumber, &Callbacks, Address, 256);
+	STP_EnableLogging (bridge, true);
+	STP_SetStpVersion (bridge, version, 0);
+	STP_StartBridge (bridge, 0);
+	for (unsigned int portIndex = 0; portIndex < portCount; portIndex++)
+		STP_OnPortEnabled (bridge, portIndex, 100, true, 0);
+}
+
+static void DestroyBridge ()
+{
+	STP_DestroyBridge (bridge);
+	bridge = NULL;
+}
+
+static void Receive (unsigned int portIndex, const std::vector<unsigned char>& bpdu)
+{
+	logLineCount = 0;
+	STP_OnBpduReceived (bridge, portIndex, &bpdu [0], (unsigned int) bpdu.size (), currentSecond * 1000);
+}
+
+static void Tick ()
+{
+	logLineCount = 0;
+	currentSecond++;
+	STP_OnOneSecondTick (bridge, currentSecond * 1000);
+}
+
+static bool CheckRole (unsigned int portIndex, unsigned int treeIndex, enum STP_PORT_ROLE expectedRole)
+{
+	enum STP_PORT_ROLE role = STP_GetPortRole (bridge, portIndex, treeIndex);
+	if (role == expectedRole)
+		return true;
+
+	printf ("%s: FAILED, second %u: port %u has the %s role in tree %u, expected %s.\n", currentScenario, currentSecond,
+			portIndex, STP_GetPortRoleString (role), treeIndex, STP_GetPortRoleString (expectedRole));
+	return false;
+}
+
+// ============================================================================
+
+// rcvdTcn and rcvdTcAck are per-port variables, and only the CIST instance of the Topology Change state machine
+// clears them. A neighbor in the same region is the CIST Root Bridge and reaches us through both ports, so port 1
+// is an Alternate Port in the CIST; it is the worst bridge in MSTI 1, so port 1 is a Designated Port there.
+// When port 1 receives a TCN, the CIST instance, INACTIVE, doesn't clear rcvdTcn. The MSTI instance used to go
+// through NOTIFIED_TCN and NOTIFIED_TC forever, or to re-enter LEARNING forever after its role changed.
+static bool TcnOnCistAlternateMstiDesignatedPort ()
+{
+	static const unsigned long long NeighborId = 0x800000AA00000001ULL;
+
+	CreateBridge (2, 1, STP_VERSION_MSTP);
+
+	CIST_MESSAGE cist = { FlagRoleDesignated | FlagLearning | FlagForwarding, NeighborId, 0, NeighborId, 0, NeighborId, 0, 0, 20 };
+	MSTI_MESSAGE msti = { 0, 0xF00100AA00000001ULL, 0, 0xF0, 0x80, 20 };
+
+	for (unsigned int second = 0; second < 40; second++)
+	{
+		for (unsigned int portIndex = 0; portIndex < 2; portIndex++)
+		{
+			// In MSTI 1 the neighbor has its Root Port on our port 0 and an Alternate Port on our port 1.
+			cist.portId = (unsigned short) (0x8001 + portIndex);
+			msti.flags = (portIndex == 0) ? (FlagRoleRoot | FlagLearning | FlagForwarding) : FlagRoleAlternate;
+			Receive (portIndex, MakeBpdu (3, cist, &msti, 1));
+		}
+
+		Tick ();
+	}
+
+	bool passed = CheckRole (0, 0, STP_PORT_ROLE_ROOT) && CheckRole (1, 0, STP_PORT_ROLE_ALTERNATE)
+		&& CheckRole (1, 1, STP_PORT_ROLE_DESIGNATED);
+	if (passed && !STP_GetPortForwarding (bridge, 1, 1))
+	{
+		printf ("%s: FAILED: port 1 is not forwarding in MSTI 1.\n", currentScenario);
+		passed = false;
+	}
+
+	if (passed)
+	{
+		Receive (1, MakeTcnBpdu ());
+		Tick ();
+	}
+
+	DestroyBridge ();
+	return passed;
+}
+
+// A TCN BPDU carries no priority vector, times or flags. A neighbor running STP, the Designated Bridge for our port 0,
+// turns its port into a Root Port, stops sending Configuration BPDUs and sends TCNs, which we don't acknowledge
+// as we run RSTP. Port 0 must age out the information of the neighbor and become a Designated Port. A TCN used
+// to look like the last Configuration BPDU to the Port Information state machine, restarting rcvdInfoWhile.
+static bool TcnsAfterConfigBpdus ()
+{
+	static const unsigned long long NeighborId = 0x800000AA00000001ULL;
+
+	CreateBridge (2, 0, STP_VERSION_RSTP);
+
+	CIST_MESSAGE cist = { 0, NeighborId, 0, 0, 0, NeighborId, 0x8001, 0, 0 };
+	for (unsigned int second = 0; second < 5; second++)
+	{
+		Receive (0, MakeBpdu (0, cist, NULL, 0));
+		Tick ();
+	}
+
+	bool passed = CheckRole (0, 0, STP_PORT_ROLE_ROOT);
+
+	for (unsigned int second = 0; passed && (second < 10); second++)
+	{
+		Receive (0, MakeTcnBpdu ());
+		Tick ();
+	}
+
+	passed = passed && CheckRole (0, 0, STP_PORT_ROLE_DESIGNATED);
+
+	DestroyBridge ();
+	return passed;
+}
+
+// rcvdInternal tells only whether the last BPDU received on a port came from the same region. A neighbor in our region
+// is the CIST Root Bridge and the Designated Bridge for our port 0. A bridge from another region on the same LAN sends
+// an inferior BPDU there, then port 1 goes down and the roles are selected again. The root priority vector must be
+// the one calculated from the information of the neighbor, recorded as coming from within the region (infoInternal).
+static bool InferiorBpduFromAnotherRegion ()
+{
+	static const unsigned long long NeighborId = 0x800000AA00000001ULL;
+	static const unsigned long long OtherRegionBridgeId = 0x900000AA00000099ULL;
+
+	CreateBridge (2, 0, STP_VERSION_MSTP);
+
+	CIST_MESSAGE cist = { FlagRoleDesignated | FlagLearning | FlagForwarding, NeighborId, 0, NeighborId, 0, NeighborId, 0x8001, 0, 20 };
+	for (unsigned int second = 0; second < 5; second++)
+	{
+		Receive (0, MakeBpdu (3, cist, NULL, 0));
+		Tick ();
+	}
+
+	unsigned char expectedVector[36];
+	unsigned short expectedMessageAge;
+	unsigned char expectedRemainingHops;
+	STP_GetRootPriorityVector (bridge, 0, expectedVector);
+	STP_GetRootTimes (bridge, 0, NULL, NULL, NULL, &expectedMessageAge, &expectedRemainingHops);
+	bool passed = CheckRole (0, 0, STP_PORT_ROLE_ROOT);
+
+	if (passed)
+	{
+		CIST_MESSAGE other = { FlagRoleAlternate, NeighborId, 200000, 0, 0, OtherRegionBridgeId, 0x8001, 256, 0 };
+		Receive (0, MakeBpdu (2, other, NULL, 0));
+
+		logLineCount = 0;
+		STP_OnPortDisabled (bridge, 1, currentSecond * 1000);
+
+		unsigned char vector[36];
+		unsigned short messageAge;
+		unsigned char remainingHops;
+		STP_GetRootPriorityVector (bridge, 0, vector);
+		STP_GetRootTimes (bridge, 0, NULL, NULL, NULL, &messageAge, &remainingHops);
+		passed = CheckRole (0, 0, STP_PORT_ROLE_ROOT);
+		if (passed && ((memcmp (vector, expectedVector, sizeof (vector)) != 0) || (messageAge != expectedMessageAge) || (remainingHops != expectedRemainingHops)))
+		{
+			printf ("%s: FAILED: the root priority vector or the root times changed after the inferior BPDU.\n", currentScenario);
+			passed = false;
+		}
+	}
+
+	DestroyBridge ();
+	return passed;
+}
+
+static bool CheckRemainingHops (unsigned int treeIndex, unsigned char expectedRemainingHops)
+{
+	unsigned char remainingHops;
+	STP_GetRootTimes (bridge, treeIndex, NULL, NULL, NULL, NULL, &remainingHops);
+	if (remainingHops == expectedRemainingHops)
+		return true;
+
+	printf ("%s: FAILED, second %u: the root times of tree %u have %u remaining hops, expected %u.\n", currentScenario, currentSecond,
+			treeIndex, remainingHops, expectedRemainingHops);
+	return false;
+}
+
+// A neighbor in our region is the Root Bridge of the CIST and of MSTI 1, and the Designated Bridge for our port 0.
+// It moves to another region, so its next BPDU doesn't set rcvdMsg for the MSTI, and the MSTI information recorded
+// from within the region stays on port 0 until rcvdInfoWhile expires. The roles are selected again with it,
+// and the root times of the MSTI must still have one hop less than the recorded information.
+static bool NeighborMovesToAnotherRegion ()
+{
+	static const unsigned long long NeighborId = 0x800000AA00000001ULL;
+
+	CreateBridge (2, 1, STP_VERSION_MSTP);
+
+	CIST_MESSAGE cist = { FlagRoleDesignated | FlagLearning | FlagForwarding, NeighborId, 0, NeighborId, 0, NeighborId, 0x8001, 0, 20 };
+	MSTI_MESSAGE msti = { FlagRoleDesignated | FlagLearning | FlagForwarding, 0x800100AA00000001ULL, 0, 0x80, 0x80, 20 };
+	for (unsigned int second = 0; second < 5; second++)
+	{
+		Receive (0, MakeBpdu (3, cist, &msti, 1));
+		Tick ();
+	}
+
+	bool passed = CheckRole (0, 0, STP_PORT_ROLE_ROOT) && CheckRole (0, 1, STP_PORT_ROLE_ROOT) && CheckRemainingHops (1, 19);
+
+	if (passed)
+	{
+		std::vector<unsigned char> bpdu = MakeBpdu (3, cist, &msti, 1);
+		bpdu [39] ^= 1; // the first character of the MST Configuration Name
+		Receive (0, bpdu);
+
+		logLineCount = 0;
+		STP_OnPortDisabled (bridge, 1, currentSecond * 1000);
+
+		passed = CheckRole (0, 0, STP_PORT_ROLE_ROOT) && CheckRemainingHops (1, 19);
+	}
+
+	DestroyBridge ();
+	return passed;
+}
+
+// The MSTI information of a neighbor in our region has no hops left. rcvdInfoWhile is calculated from the remainingHops
+// of the CIST (13.27.30), so the information stays current and is selected; our root times for the MSTI must have
+// no hops left either.
+static bool MstiMessageWithNoHopsLeft ()
+{
+	static const unsigned long long NeighborId = 0x800000AA00000001ULL;
+
+	CreateBridge (2, 1, STP_VERSION_MSTP);
+
+	CIST_MESSAGE cist = { FlagRoleDesignated | FlagLearning | FlagForwarding, NeighborId, 0, NeighborId, 0, NeighborId, 0x8001, 0, 20 };
+	MSTI_MESSAGE msti = { FlagRoleDesignated | FlagLearning | FlagForwarding, 0x800100AA00000001ULL, 0, 0x80, 0x80, 0 };
+	for (unsigned int second = 0; second < 5; second++)
+	{
+		Receive (0, MakeBpdu (3, cist, &msti, 1));
+		Tick ();
+	}
+
+	bool passed = CheckRole (0, 0, STP_PORT_ROLE_ROOT) && CheckRole (0, 1, STP_PORT_ROLE_ROOT) && CheckRemainingHops (1, 0);
+
+	DestroyBridge ();
+	return passed;
+}
+
+// A bridge from another region is the CIST Root Bridge and reaches us through port 0, so port 0 is a Master Port
+// in MSTI 1. A neighbor in our region, on port 1, is the Regional Root of MSTI 1. Once both ports forward, the neighbor
+// proposes in MSTI 1, and the sync that follows must take the Master Port through MASTER_DISCARD and MASTER_SYNCED.
+// The Root Port is synced by the agreements of the neighbor, so allSynced is true for the Master Port, which used to go
+// from MASTER_DISCARD to MASTER_LEARN and back forever.
+static bool ProposalWithForwardingMasterPort ()
+{
+	static const unsigned long long OtherRegionRootId = 0x100000AA00000099ULL;
+	static const unsigned long long BridgeId = 0x800000AA00000010ULL;
+	static const unsigned long long NeighborId = 0x800000AA00000001ULL;
+
+	CreateBridge (2, 1, STP_VERSION_MSTP);
+
+	CIST_MESSAGE root = { FlagRoleDesignated | FlagLearning | FlagForwarding, OtherRegionRootId, 0, 0, 0, OtherRegionRootId, 0x8001, 0, 0 };
+	CIST_MESSAGE cist = { FlagRoleRoot | FlagLearning | FlagForwarding, OtherRegionRootId, 200000, BridgeId, 200000, NeighborId, 0x8001, 256, 19 };
+	MSTI_MESSAGE msti = { FlagRoleDesignated | FlagLearning | FlagForwarding | FlagAgreement, 0x000100AA00000001ULL, 0, 0x00, 0x80, 20 };
+
+	for (unsigned int second = 0; second < 40; second++)
+	{
+		Receive (0, MakeBpdu (2, root, NULL, 0));
+		Receive (1, MakeBpdu (3, cist, &msti, 1));
+		Tick ();
+	}
+
+	bool passed = CheckRole (0, 0, STP_PORT_ROLE_ROOT) && CheckRole (0, 1, STP_PORT_ROLE_MASTER) && CheckRole (1, 1, STP_PORT_ROLE_ROOT);
+	if (passed && !STP_GetPortForwarding (bridge, 0, 1))
+	{
+		printf ("%s: FAILED: port 0 is not forwarding in MSTI 1.\n", currentScenario);
+		passed = false;
+	}
+
+	if (passed)
+	{
+		// Worse information from the same Designated Port clears agree, so the proposal has us sync the tree.
+		msti.flags |= FlagProposal;
+		msti.internalRootPathCost = 200000;
+		Receive (1, MakeBpdu (3, cist, &msti, 1));
+		Tick ();
+
+		if (!STP_GetPortForwarding (bridge, 0, 1))
+		{
+			printf ("%s: FAILED: port 0 doesn't forward again in MSTI 1 after the sync.\n", currentScenario);
+			passed = false;
+		}
+	}
+
+	DestroyBridge ();
+	return passed;
+}
+
+// ============================================================================
+
+struct SCENARIO
+{
+	const char* name;
+	bool (*run) ();
+};
+
+static const SCENARIO Scenarios[] =
+{
+	{ "TCN on a port that is Alternate in the CIST and Designated in an MSTI", TcnOnCistAlternateMstiDesignatedPort },
+	{ "TCNs after Configuration BPDUs", TcnsAfterConfigBpdus },
+	{ "Inferior BPDU from another region on a Root Port", InferiorBpduFromAnotherRegion },
+	{ "Neighbor moves to another region", NeighborMovesToAnotherRegion },
+	{ "MSTI message with no hops left", MstiMessageWithNoHopsLeft },
+	{ "Proposal in an MSTI with a forwarding Master Port", ProposalWithForwardingMasterPort },
+};
+
+int main (int argc, char* argv[])
+{
+	if (argc > 1)
+	{
+		fprintf (stderr, "Usage: ScenarioTest\n");
+		return 1;
+	}
+
+	for (unsigned int i = 0; i < sizeof (Scenarios) / sizeof (Scenarios [0]); i++)
+	{
+		currentScenario = Scenarios [i].name;
+		if (!Scenarios [i].run ())
+			return 1;
+
+		printf ("%s: passed.\n", currentScenario);
+	}
+
+	return 0;
+}
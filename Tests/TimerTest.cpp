@@ -0,0 +1,588 @@
+// This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
+// Copyright (c) 2011-2017 Adi Gostin, distributed under Apache License v2.0.
+
+// Randomized equivalence test for the ways of driving the timers of the library. It builds random networks (a ring of
+// bridges plus random extra links, with some ports left unconnected), brings links down and back up at random, and runs
+// each network five times with the same random choices:
+//  - calling STP_OnOneSecondTick every second for each bridge;
+//  - waking each bridge only when the deadline returned by STP_GetNextDeadline is reached, and before calling
+//    any other library function for it, with STP_OnSecondsElapsed;
+//  - with millisecond timers, calling STP_OnOneSecondTick every second;
+//  - with millisecond timers, calling STP_OnTimerTick with 1000 ms every second;
+//  - with millisecond timers, waking each bridge at its deadline as above, with STP_OnTimerTick.
+// The second and third runs are compared with the first, and the fifth with the fourth. STP_OnTimerTick applies
+// the time in ticks of 1/256 of a second, after which a timer held by a state machine (fdWhile of an Alternate Port,
+// for instance) is one such tick short of its value, instead of a whole second, so it can't be compared with
+// one-second ticks. The compared runs must transmit the same BPDUs at the same times, and must make the same changes
+// to port roles, learning and forwarding at the same times. The library calls onPortRoleChanged on each entry to
+// a role state, also when the role didn't change (a Root Port re-enters ROOT_PORT on every tick), and the tickless
+// runs skip most of those ticks, so for them the calls that don't change anything are not compared. The run with
+// millisecond timers and STP_OnOneSecondTick must make exactly the same calls as the first one.
+//
+//		g++ -O2 -I../mstp-lib TimerTest.cpp ../mstp-lib/*.cpp ../mstp-lib/802.1Q-2011/*.cpp -o TimerTest
+//
+// Usage: TimerTest [-runs N] [-seconds N] [-seed N]
+// Prints the number of networks run and exits with 0 if the runs matched, or prints the first difference and exits with 1.
+
+#include "stp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+enum MODE
+{
+	MODE_SECOND_TICKS,
+	MODE_TICKLESS,
+	MODE_MILLISECOND_SECOND_TICKS,
+	MODE_MILLISECOND_TIMER_TICKS,
+	MODE_MILLISECOND_TICKLESS,
+	MODE_COUNT,
+};
+
+static const char* const ModeNames[] = { "one-second ticks", "tickless", "ms timers, one-second ticks", "ms timers, 1000 ms ticks", "ms timers, tickless" };
+
+// The run each mode is compared with, or the mode itself for the runs that are only compared against.
+static const MODE ReferenceModes[] = { MODE_SECOND_TICKS, MODE_SECOND_TICKS, MODE_SECOND_TICKS, MODE_MILLISECOND_TIMER_TICKS, MODE_MILLISECOND_TIMER_TICKS };
+
+static const unsigned int MaxPortCount = 6;
+
+struct LINK
+{
+	unsigned int bridgeA;
+	unsigned int portA;
+	unsigned int bridgeB;
+	unsigned int portB;
+};
+
+struct FLAP
+{
+	unsigned int second;
+	unsigned int linkIndex;
+};
+
+struct SCENARIO
+{
+	unsigned int bridgeCount;
+	unsigned int portCount;
+	enum STP_VERSION version;
+	unsigned int mstiCount;
+	std::vector<unsigned short> bridgePriorities;
+	std::vector<LINK> links;
+	std::vector<FLAP> flaps; // sorted by second; each one brings a link down or back up
+	unsigned int seconds;
+};
+
+enum RECORD_TYPE
+{
+	RECORD_TYPE_ROLE,
+	RECORD_TYPE_LEARNING,
+	RECORD_TYPE_FORWARDING,
+	RECORD_TYPE_FLUSH_FDB,
+	RECORD_TYPE_NOTIFIED_TOPOLOGY_CHANGE,
+	RECORD_TYPE_BPDU,
+};
+
+static const char* const RecordTypeNames[] = { "role", "learning", "forwarding", "flush FDB", "notified TC", "BPDU" };
+
+// A callback invoked by the library. For the BPDUs, value is a hash of the contents.
+struct RECORD
+{
+	unsigned int second;
+	unsigned int bridgeIndex;
+	RECORD_TYPE type;
+	unsigned int portIndex;
+	unsigned int treeIndex;
+	unsigned int value;
+	bool unchanged; // a role, learning or forwarding callback that didn't change anything
+};
+
+struct PENDING_BPDU
+{
+	unsigned int bridgeIndex;
+	unsigned int portIndex;
+	std::vector<unsigned char> data;
+};
+
+// The state of the run in progress.
+static const SCENARIO* scenario;
+static MODE mode;
+static unsigned int currentSecond;
+static std::vector<STP_BRIDGE*> bridges;
+static std::vector<unsigned int> lastTimes;				// [bridge], the time up to which the timers were advanced, in seconds or ms
+static std::vector<std::vector<int> > linkOfPort;			// [bridge][port], -1 if the port is not connected
+static std::vector<bool> linkUp;
+static std::vector<std::vector<unsigned char> > states;	// [bridge][(type * portCount + port) * treeCount + tree]
+static std::deque<PENDING_BPDU> pendingBpdus;
+static std::vector<RECORD>* records;
+
+static unsigned char transmitBuffer [2048];
+static unsigned int transmitPortIndex;
+static unsigned int transmitBpduSize;
+
+static unsigned int randomState;
+
+// ============================================================================
+
+// xorshift32, so that a seed gives the same networks on all platforms.
+static unsigned int Random ()
+{
+	randomState ^= randomState << 13;
+	randomState ^= randomState >> 17;
+	randomState ^= randomState << 5;
+	return randomState;
+}
+
+static unsigned int GetBridgeIndex (const STP_BRIDGE* bridge)
+{
+	return (unsigned int) (size_t) STP_GetApplicationContext (bridge);
+}
+
+static unsigned int GetTreeCount ()
+{
+	return 1 + scenario->mstiCount;
+}
+
+static void AddRecord (const STP_BRIDGE* bridge, RECORD_TYPE type, unsigned int portIndex, unsigned int treeIndex, unsigned int value)
+{
+	RECORD record = { currentSecond, GetBridgeIndex (bridge), type, portIndex, treeIndex, value, false };
+
+	if ((type == RECORD_TYPE_ROLE) || (type == RECORD_TYPE_LEARNING) || (type == RECORD_TYPE_FORWARDING))
+	{
+		unsigned char& state = states [record.bridgeIndex][(type * scenario->portCount + portIndex) * GetTreeCount () + treeIndex];
+		record.unchanged = (state == (unsigned char) value);
+		state = (unsigned char) value;
+	}
+
+	records->push_back (record);
+}
+
+// ============================================================================
+
+static void EnableLearning (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, unsigned int enable, unsigned int timestamp)
+{
+	AddRecord (bridge, RECORD_TYPE_LEARNING, portIndex, treeIndex, enable);
+}
+
+static void EnableForwarding (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, unsigned int enable, unsigned int timestamp)
+{
+	AddRecord (bridge, RECORD_TYPE_FORWARDING, portIndex, treeIndex, enable);
+}
+
+static void* TransmitGetBuffer (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int bpduSize, unsigned int timestamp)
+{
+	if (bpduSize > sizeof (transmitBuffer))
+		return NULL;
+
+	transmitPortIndex = portIndex;
+	transmitBpduSize = bpduSize;
+	return transmitBuffer;
+}
+
+static void TransmitReleaseBuffer (const STP_BRIDGE* bridge, void* bufferReturnedByGetBuffer)
+{
+	unsigned int hash = 2166136261u;
+	for (unsigned int i = 0; i < transmitBpduSize; i++)
+		hash = (hash ^ transmitBuffer [i]) * 16777619u;
+
+	AddRecord (bridge, RECORD_TYPE_BPDU, transmitPortIndex, 0, hash);
+
+	int linkIndex = linkOfPort [GetBridgeIndex (bridge)][transmitPortIndex];
+	if ((linkIndex == -1) || !linkUp [linkIndex])
+		return;
+
+	const LINK& link = scenario->links [linkIndex];
+	bool fromA = (link.bridgeA == GetBridgeIndex (bridge)) && (link.portA == transmitPortIndex);
+
+	pendingBpdus.push_back (PENDING_BPDU ());
+	PENDING_BPDU& pending = pendingBpdus.back ();
+	pending.bridgeIndex = fromA ? link.bridgeB : link.bridgeA;
+	pending.portIndex = fromA ? link.portB : link.portA;
+	pending.data.assign (transmitBuffer, transmitBuffer + transmitBpduSize);
+}
+
+static void FlushFdb (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, enum STP_FLUSH_FDB_TYPE flushType)
+{
+	AddRecord (bridge, RECORD_TYPE_FLUSH_FDB, portIndex, treeIndex, flushType);
+}
+
+static void DebugStrOut (const STP_BRIDGE* bridge, int portIndex, int treeIndex, const char* nullTerminatedString, unsigned int stringLength, unsigned int flush)
+{
+}
+
+static void OnTopologyChange (const STP_BRIDGE* bridge)
+{
+}
+
+static void OnNotifiedTopologyChange (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, unsigned int timestamp)
+{
+	AddRecord (bridge, RECORD_TYPE_NOTIFIED_TOPOLOGY_CHANGE, portIndex, treeIndex, 0);
+}
+
+static void OnPortRoleChanged (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, enum STP_PORT_ROLE role, unsigned int timestamp)
+{
+	AddRecord (bridge, RECORD_TYPE_ROLE, portIndex, treeIndex, role);
+}
+
+static void OnConfigChanged (const STP_BRIDGE* bridge, unsigned int timestamp)
+{
+}
+
+static void* AllocAndZeroMemory (unsigned int size)
+{
+	return calloc (1, size);
+}
+
+static void FreeMemory (void* p)
+{
+	free (p);
+}
+
+static const STP_CALLBACKS Callbacks =
+{
+	EnableLearning,
+	EnableForwarding,
+	TransmitGetBuffer,
+	TransmitReleaseBuffer,
+	FlushFdb,
+	DebugStrOut,
+	OnTopologyChange,
+	OnNotifiedTopologyChange,
+	OnPortRoleChanged,
+	OnConfigChanged,
+	AllocAndZeroMemory,
+	FreeMemory,
+	NULL,
+};
+
+// ============================================================================
+
+static unsigned int GetCurrentTime ()
+{
+	return (mode == MODE_MILLISECOND_TICKLESS) ? (currentSecond * 1000) : currentSecond;
+}
+
+// In the tickless modes, applies the time elapsed since the bridge's timers were last advanced. Called before each call
+// to the library for the bridge, as the application would do it.
+static void CatchUp (unsigned int bridgeIndex)
+{
+	unsigned int time = GetCurrentTime ();
+	if (lastTimes [bridgeIndex] == time)
+		return;
+
+	if (mode == MODE_TICKLESS)
+		STP_OnSecondsElapsed (bridges [bridgeIndex], time - lastTimes [bridgeIndex], currentSecond * 1000);
+	else if (mode == MODE_MILLISECOND_TICKLESS)
+		STP_OnTimerTick (bridges [bridgeIndex], time - lastTimes [bridgeIndex], currentSecond * 1000);
+
+	lastTimes [bridgeIndex] = time;
+}
+
+static void DeliverPendingBpdus ()
+{
+	while (!pendingBpdus.empty ())
+	{
+		// Copy it out of the queue, as the call below will queue more BPDUs.
+		PENDING_BPDU pending = pendingBpdus.front ();
+		pendingBpdus.pop_front ();
+
+		CatchUp (pending.bridgeIndex);
+		STP_OnBpduReceived (bridges [pending.bridgeIndex], pending.portIndex, &pending.data [0], (unsigned int) pending.data.size (), currentSecond * 1000);
+	}
+}
+
+static void SetLinkUp (unsigned int linkIndex, bool up)
+{
+	const LINK& link = scenario->links [linkIndex];
+	CatchUp (link.bridgeA);
+	CatchUp (link.bridgeB);
+
+	linkUp [linkIndex] = up;
+	if (up)
+	{
+		STP_OnPortEnabled (bridges [link.bridgeA], link.portA, 100, true, currentSecond * 1000);
+		STP_OnPortEnabled (bridges [link.bridgeB], link.portB, 100, true, currentSecond * 1000);
+	}
+	else
+	{
+		STP_OnPortDisabled (bridges [link.bridgeA], link.portA, currentSecond * 1000);
+		STP_OnPortDisabled (bridges [link.bridgeB], link.portB, currentSecond * 1000);
+	}
+
+	DeliverPendingBpdus ();
+}
+
+static void RunScenario (const SCENARIO& s, MODE m, std::vector<RECORD>& recordsOut)
+{
+	scenario = &s;
+	mode = m;
+	records = &recordsOut;
+	currentSecond = 0;
+
+	unsigned int treeCount = GetTreeCount ();
+	unsigned int maxVlanNumber = (s.version == STP_VERSION_MSTP) ? 4094 : 0;
+
+	std::vector<STP_CONFIG_TABLE_ENTRY> configTable (1 + maxVlanNumber);
+	for (unsigned int vlanNumber = 1; vlanNumber <= maxVlanNumber; vlanNumber++)
+		configTable [vlanNumber].treeIndex = (unsigned char) (vlanNumber % treeCount);
+
+	lastTimes.assign (s.bridgeCount, 0);
+	linkOfPort.assign (s.bridgeCount, std::vector<int> (s.portCount, -1));
+	linkUp.assign (s.links.size (), false);
+	states.assign (s.bridgeCount, std::vector<unsigned char> (3 * s.portCount * treeCount, 0xFF));
+	pendingBpdus.clear ();
+
+	for (size_t i = 0; i < s.links.size (); i++)
+	{
+		linkOfPort [s.links [i].bridgeA][s.links [i].portA] = (int) i;
+		linkOfPort [s.links [i].bridgeB][s.links [i].portB] = (int) i;
+	}
+
+	for (unsigned int bridgeIndex = 0; bridgeIndex < s.bridgeCount; bridgeIndex++)
+	{
+		unsigned char address[6] = { 0x00, 0xAA, 0xBB, 0x00, (unsigned char) (bridgeIndex >> 8), (unsigned char) bridgeIndex };
+		STP_BRIDGE* bridge = STP_CreateBridge (s.portCount, s.mstiCount, maxVlanNumber, &Callbacks, address, 256);
+		STP_SetApplicationContext (bridge, (void*) (size_t) bridgeIndex);
+		STP_EnableMillisecondTimers (bridge, mode >= MODE_MILLISECOND_SECOND_TICKS);
+		STP_SetStpVersion (bridge, s.version, 0);
+		if (s.mstiCount > 0)
+			STP_SetMstConfigTable (bridge, &configTable [0], (unsigned int) configTable.size (), 0);
+		for (unsigned int treeIndex = 0; treeIndex < treeCount; treeIndex++)
+			STP_SetBridgePriority (bridge, treeIndex, s.bridgePriorities [bridgeIndex * treeCount + treeIndex], 0);
+		bridges.push_back (bridge);
+	}
+
+	for (unsigned int bridgeIndex = 0; bridgeIndex < s.bridgeCount; bridgeIndex++)
+		STP_StartBridge (bridges [bridgeIndex], 0);
+
+	for (unsigned int linkIndex = 0; linkIndex < s.links.size (); linkIndex++)
+		SetLinkUp (linkIndex, true);
+
+	size_t nextFlap = 0;
+	for (currentSecond = 1; currentSecond <= s.seconds; currentSecond++)
+	{
+		for (unsigned int bridgeIndex = 0; bridgeIndex < s.bridgeCount; bridgeIndex++)
+		{
+			if ((mode == MODE_SECOND_TICKS) || (mode == MODE_MILLISECOND_SECOND_TICKS))
+				STP_OnOneSecondTick (bridges [bridgeIndex], currentSecond * 1000);
+			else if (mode == MODE_MILLISECOND_TIMER_TICKS)
+				STP_OnTimerTick (bridges [bridgeIndex], 1000, currentSecond * 1000);
+			else
+			{
+				// The deadline is relative to the last time the timers were advanced, as the application would have
+				// called STP_GetNextDeadline right after each call to the library for this bridge.
+				unsigned int deadline = STP_GetNextDeadline (bridges [bridgeIndex]);
+				if ((deadline != 0) && (lastTimes [bridgeIndex] + deadline <= GetCurrentTime ()))
+					CatchUp (bridgeIndex);
+			}
+		}
+
+		DeliverPendingBpdus ();
+
+		for (; (nextFlap < s.flaps.size ()) && (s.flaps [nextFlap].second == currentSecond); nextFlap++)
+			SetLinkUp (s.flaps [nextFlap].linkIndex, !linkUp [s.flaps [nextFlap].linkIndex]);
+	}
+
+	for (unsigned int bridgeIndex = 0; bridgeIndex < s.bridgeCount; bridgeIndex++)
+		STP_DestroyBridge (bridges [bridgeIndex]);
+
+	bridges.clear ();
+}
+
+// ============================================================================
+
+static bool IsEarlierFlap (const FLAP& a, const FLAP& b)
+{
+	return a.second < b.second;
+}
+
+static void MakeScenario (SCENARIO* s, unsigned int seconds)
+{
+	static const enum STP_VERSION Versions[] = { STP_VERSION_LEGACY_STP, STP_VERSION_RSTP, STP_VERSION_MSTP };
+
+	s->bridgeCount = 2 + Random () % 9;
+	s->portCount = 2 + Random () % (MaxPortCount - 1);
+	s->version = Versions [Random () % 3];
+	s->mstiCount = (s->version == STP_VERSION_MSTP) ? (Random () % 4) : 0;
+	s->seconds = seconds;
+
+	// Mostly the default priority, so that the bridge addresses decide too.
+	unsigned int treeCount = 1 + s->mstiCount;
+	s->bridgePriorities.resize (s->bridgeCount * treeCount);
+	for (size_t i = 0; i < s->bridgePriorities.size (); i++)
+		s->bridgePriorities [i] = (unsigned short) (((Random () % 2) == 0) ? 0x8000 : ((Random () % 16) * 4096));
+
+	// A ring on ports 0 and 1, then random links between the remaining ports. Some ports stay unconnected,
+	// so they're disabled all the time.
+	std::vector<unsigned int> nextPort (s->bridgeCount, 0);
+	s->links.clear ();
+	unsigned int ringLinkCount = (s->bridgeCount == 2) ? 1 : s->bridgeCount;
+	for (unsigned int i = 0; i < ringLinkCount; i++)
+	{
+		unsigned int a = i;
+		unsigned int b = (i + 1) % s->bridgeCount;
+		LINK link = { a, nextPort [a]++, b, nextPort [b]++ };
+		s->links.push_back (link);
+	}
+
+	unsigned int extraLinkCount = Random () % (s->bridgeCount + 1);
+	for (unsigned int i = 0; i < extraLinkCount; i++)
+	{
+		unsigned int a = Random () % s->bridgeCount;
+		unsigned int b = Random () % s->bridgeCount;
+		if ((a == b) || (nextPort [a] == s->portCount) || (nextPort [b] == s->portCount))
+			continue;
+
+		LINK link = { a, nextPort [a]++, b, nextPort [b]++ };
+		s->links.push_back (link);
+	}
+
+	// Links go down at random seconds, sometimes several in the same second, sometimes none for longer than MaxAge,
+	// and come back up, mostly after a few seconds (while timers started before they went down are still running).
+	s->flaps.clear ();
+	std::vector<unsigned int> linkFreeSeconds (s->links.size (), 1);
+	unsigned int flapPeriod = 2 + Random () % 30;
+	for (unsigned int second = 1; second <= seconds; second++)
+	{
+		while ((Random () % flapPeriod) == 0)
+		{
+			unsigned int linkIndex = Random () % (unsigned int) s->links.size ();
+			if (linkFreeSeconds [linkIndex] > second)
+				continue;
+
+			unsigned int downSeconds = ((Random () % 4) != 0) ? (1 + Random () % 4) : (5 + Random () % 60);
+			FLAP down = { second, linkIndex };
+			FLAP up = { second + downSeconds, linkIndex };
+			s->flaps.push_back (down);
+			s->flaps.push_back (up);
+			linkFreeSeconds [linkIndex] = up.second + 1;
+		}
+	}
+
+	std::stable_sort (s->flaps.begin (), s->flaps.end (), IsEarlierFlap);
+}
+
+static void PrintScenario (const SCENARIO& s)
+{
+	printf ("%u bridges with %u ports, %s", s.bridgeCount, s.portCount, STP_GetVersionString (s.version));
+	if (s.mstiCount > 0)
+		printf (" with %u MSTIs", s.mstiCount);
+	printf (", %u links, %u flaps in %u seconds.\n", (unsigned int) s.links.size (), (unsigned int) s.flaps.size (), s.seconds);
+}
+
+static void PrintRecord (const char* title, const std::vector<RECORD>& records, size_t index)
+{
+	if (index == records.size ())
+	{
+		printf ("  %-28s (no more callbacks)\n", title);
+		return;
+	}
+
+	const RECORD& r = records [index];
+	printf ("  %-28s second %u, bridge %u, port %u, tree %u: %s = %u\n",
+			title, r.second, r.bridgeIndex, 1 + r.portIndex, r.treeIndex, RecordTypeNames [r.type], r.value);
+}
+
+static bool IsSameRecord (const RECORD& a, const RECORD& b)
+{
+	return (a.second == b.second) && (a.bridgeIndex == b.bridgeIndex) && (a.type == b.type)
+		&& (a.portIndex == b.portIndex) && (a.treeIndex == b.treeIndex) && (a.value == b.value);
+}
+
+// Compares the records of a run with those of its reference run; for the tickless runs,
+// leaving out the callbacks that didn't change anything.
+static bool CompareRecords (const SCENARIO& s, MODE mode, const std::vector<RECORD>& expected, const std::vector<RECORD>& actual)
+{
+	MODE referenceMode = ReferenceModes [mode];
+	bool skipUnchanged = (mode == MODE_TICKLESS) || (mode == MODE_MILLISECOND_TICKLESS);
+
+	size_t e = 0;
+	size_t a = 0;
+	while (true)
+	{
+		while (skipUnchanged && (e < expected.size ()) && expected [e].unchanged)
+			e++;
+		while (skipUnchanged && (a < actual.size ()) && actual [a].unchanged)
+			a++;
+
+		if ((e == expected.size ()) && (a == actual.size ()))
+			return true;
+
+		if ((e == expected.size ()) || (a == actual.size ()) || !IsSameRecord (expected [e], actual [a]))
+		{
+			printf ("Difference between %s and %s for ", ModeNames [referenceMode], ModeNames [mode]);
+			PrintScenario (s);
+			PrintRecord (ModeNames [referenceMode], expected, e);
+			PrintRecord (ModeNames [mode], actual, a);
+			return false;
+		}
+
+		e++;
+		a++;
+	}
+}
+
+// ============================================================================
+
+static void PrintUsage ()
+{
+	fprintf (stderr, "Usage: TimerTest [-runs N] [-seconds N] [-seed N]\n");
+}
+
+int main (int argc, char* argv[])
+{
+	unsigned int runCount = 500;
+	unsigned int seconds = 300;
+	unsigned int seed = 1;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (i + 1 >= argc)
+		{
+			PrintUsage ();
+			return 1;
+		}
+
+		const char* name = argv [i];
+		const char* value = argv [++i];
+
+		if (strcmp (name, "-runs") == 0)
+			runCount = (unsigned int) atoi (value);
+		else if (strcmp (name, "-seconds") == 0)
+			seconds = (unsigned int) atoi (value);
+		else if (strcmp (name, "-seed") == 0)
+			seed = (unsigned int) atoi (value);
+		else
+		{
+			PrintUsage ();
+			return 1;
+		}
+	}
+
+	// xorshift gets stuck at zero.
+	randomState = (seed != 0) ? seed : 1;
+
+	for (unsigned int run = 0; run < runCount; run++)
+	{
+		SCENARIO s;
+		MakeScenario (&s, seconds);
+
+		// The reference runs come first in the MODE enum.
+		std::vector<RECORD> modeRecords [MODE_COUNT];
+		for (unsigned int m = 0; m < MODE_COUNT; m++)
+		{
+			RunScenario (s, (MODE) m, modeRecords [m]);
+
+			if ((ReferenceModes [m] != m) && !CompareRecords (s, (MODE) m, modeRecords [ReferenceModes [m]], modeRecords [m]))
+			{
+				printf ("Run %u of seed %u.\n", run, seed);
+				return 1;
+			}
+		}
+	}
+
+	printf ("%u random networks run for %u seconds, the same in all modes.\n", runCount, seconds);
+	return 0;
+}
@@ -0,0 +1,312 @@
+
+// This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
+// Copyright (c) 2011-2017 Adi Gostin, distributed under Apache License v2.0.
+
+// Offline decoder for the binary trace of the STP library (see STP_SetTraceBuffer in the _help directory).
+//
+// It reads a file holding a copy of a whole trace buffer (header and records), and writes to stdout the text the library
+// writes to its debug log for the same events: the API calls, the transmitted BPDUs and the state machine transitions.
+// The contents of the BPDUs, the MST Config Name and the details logged by the procedures are not in the trace,
+// so they're not in the output either.
+//
+// The file must come from a machine with the same byte order as the one running the decoder, and from a build of the library
+// having the same state machines as the one the decoder is built with. Build it together with the library sources, for example:
+//		g++ -I../mstp-lib TraceDecoder.cpp ../mstp-lib/*.cpp ../mstp-lib/802.1Q-2011/*.cpp -o TraceDecoder
+//
+// Usage: TraceDecoder <trace file>
+
+#include "stp.h"
+#include "stp_bridge.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char Separator[] = "------------------------------------\r\n";
+
+static void PrintTimestamp (unsigned int timestamp)
+{
+	printf ("%u.%03u", timestamp / 1000, timestamp % 1000);
+}
+
+static const char* GetReceivedBpduText (unsigned char type)
+{
+	switch (type)
+	{
+		case VALIDATED_BPDU_TYPE_STP_CONFIG:	return "Config BPDU:\r\n";
+		case VALIDATED_BPDU_TYPE_RST:			return "RSTP BPDU:\r\n";
+		case VALIDATED_BPDU_TYPE_MST:			return "MSTP BPDU:\r\n";
+		case VALIDATED_BPDU_TYPE_STP_TCN:		return "TCN BPDU.\r\n";
+		default:								return "Invalid BPDU received. Discarding it.\r\n";
+	}
+}
+
+static const char* GetTransmittedBpduName (unsigned char type)
+{
+	switch (type)
+	{
+		case VALIDATED_BPDU_TYPE_STP_CONFIG:	return "Config";
+		case VALIDATED_BPDU_TYPE_RST:			return "RSTP";
+		case VALIDATED_BPDU_TYPE_MST:			return "MSTP";
+		case VALIDATED_BPDU_TYPE_STP_TCN:		return "TCN";
+		default:								return "(unknown)";
+	}
+}
+
+static void PrintTreeName (unsigned char tree)
+{
+	if (tree == CIST_INDEX)
+		printf ("CIST");
+	else
+		printf ("MST%d", tree);
+}
+
+// Ends the first line of the configuration API calls that log " nothing changed." when there's nothing to do.
+static void PrintNothingChanged (const STP_TRACE_RECORD* record)
+{
+	printf ((record->flags & STP_TRACE_FLAG_NOTHING_CHANGED) ? " nothing changed.\r\n" : "\r\n");
+}
+
+// ============================================================================
+
+// Each API function of the library ends its log output with a few lines that have no record in the trace;
+// we print them when we see the record of the next API function, or at the end of the trace.
+static const char* DecodeRecord (const STP_TRACE_RECORD* record, const char* pendingFooter)
+{
+	const SM_INTERFACE* smInterface = &smInterface_802_1Q_2011;
+
+	switch (record->event)
+	{
+		case STP_TRACE_EVENT_BRIDGE_STARTED:
+			printf ("%s", pendingFooter);
+			PrintTimestamp (record->timestamp);
+			printf (": Starting the bridge...\r\n");
+			return "Bridge started.\r\n------------------------------------\r\n";
+
+		case STP_TRACE_EVENT_BRIDGE_STOPPED:
+			printf ("%s", pendingFooter);
+			PrintTimestamp (record->timestamp);
+			printf (": Bridge stopped.\r\n");
+			return Separator;
+
+		case STP_TRACE_EVENT_PORT_ENABLED:
+			printf ("%s", pendingFooter);
+			PrintTimestamp (record->timestamp);
+			printf (": Port %d good\r\n", 1 + record->port);
+			return Separator;
+
+		case STP_TRACE_EVENT_PORT_DISABLED:
+			printf ("%s", pendingFooter);
+			PrintTimestamp (record->timestamp);
+			printf (": Port %d down\r\n", 1 + record->port);
+			return Separator;
+
+		case STP_TRACE_EVENT_ONE_SECOND_TICK:
+			printf ("%s", pendingFooter);
+			PrintTimestamp (record->timestamp);
+			printf (": One second:\r\n");
+			return Separator;
+
+		case STP_TRACE_EVENT_TIMER_TICK:
+			printf ("%s", pendingFooter);
+			PrintTimestamp (record->timestamp);
+			printf (": Timer tick of %u%s units:\r\n", record->value, (record->value == 255) ? " or more" : "");
+			return Separator;
+
+		case STP_TRACE_EVENT_BPDU_RECEIVED:
+			printf ("%s", pendingFooter);
+			PrintTimestamp (record->timestamp);
+			printf (": BPDU received on Port %d:\r\n", 1 + record->port);
+			printf ("%s", GetReceivedBpduText (record->value));
+			return Separator;
+
+		case STP_TRACE_EVENT_BPDU_TRANSMITTED:
+			printf ("TX %s BPDU to port %d:\r\n", GetTransmittedBpduName (record->value), 1 + record->port);
+			return pendingFooter;
+
+		case STP_TRACE_EVENT_STATE_CHANGED:
+		{
+			const SM_INFO* smInfo;
+			if (record->machine < smInterface->smInfoCount)
+				smInfo = &smInterface->smInfo [record->machine];
+			else if (record->machine == smInterface->smInfoCount)
+				smInfo = smInterface->transmitSmInfo;
+			else
+			{
+				printf ("(unknown state machine %d)\r\n", record->machine);
+				return pendingFooter;
+			}
+
+			if (record->port == 0xFFFF)
+				printf ("Bridge: ");
+			else
+				printf ("Port %d: ", 1 + record->port);
+
+			if (record->value >= STP_VERSION_MSTP)
+			{
+				if (record->tree == CIST_INDEX)
+					printf ("CIST: ");
+				else if (record->tree != 0xFF)
+					printf ("MST%d: ", record->tree);
+			}
+
+			printf ("%s: -> %s\r\n", smInfo->smName, smInfo->getStateName (record->state));
+			return pendingFooter;
+		}
+
+		case STP_TRACE_EVENT_BRIDGE_ADDRESS_SET:
+			printf ("%s", pendingFooter);
+			PrintTimestamp (record->timestamp);
+			printf (": Setting bridge MAC address to %02x%02x%02x%02x%02x%02x...",
+					record->port >> 8, record->port & 0xFF, record->tree, record->machine, record->state, record->value);
+			PrintNothingChanged (record);
+			return Separator;
+
+		case STP_TRACE_EVENT_BRIDGE_PRIORITY_SET:
+			printf ("%s", pendingFooter);
+			PrintTimestamp (record->timestamp);
+			printf (": Setting bridge priority: tree ");
+			PrintTreeName (record->tree);
+			printf (" prio = %d...\r\n", record->value << 12);
+			PrintNothingChanged (record);
+			return Separator;
+
+		case STP_TRACE_EVENT_PORT_PRIORITY_SET:
+			printf ("%s", pendingFooter);
+			PrintTimestamp (record->timestamp);
+			printf (": Setting port priority: port %d tree ", 1 + record->port);
+			PrintTreeName (record->tree);
+			printf (" prio = %d...\r\n", record->value);
+			return Separator;
+
+		case STP_TRACE_EVENT_STP_VERSION_SET:
+			printf ("%s", pendingFooter);
+			PrintTimestamp (record->timestamp);
+			printf (": Switching to %s... ", STP_GetVersionString ((STP_VERSION) record->value));
+			if (record->flags & STP_TRACE_FLAG_NOTHING_CHANGED)
+				printf ("... bridge was already running %s.\r\n", STP_GetVersionString ((STP_VERSION) record->value));
+			else
+				printf ("\r\n");
+			return Separator;
+
+		case STP_TRACE_EVENT_HELLO_TIME_SET:
+			printf ("%s", pendingFooter);
+			PrintTimestamp (record->timestamp);
+			printf (": Setting hello time to %d ms...\r\n", record->port);
+			PrintNothingChanged (record);
+			return Separator;
+
+		case STP_TRACE_EVENT_MST_CONFIG_NAME_SET:
+			printf ("%s", pendingFooter);
+			PrintTimestamp (record->timestamp);
+			printf (": Setting MST Config Name...\r\n");
+			return Separator;
+
+		case STP_TRACE_EVENT_MST_CONFIG_REVISION_LEVEL_SET:
+			printf ("%s", pendingFooter);
+			PrintTimestamp (record->timestamp);
+			printf (": Setting MST Config Revision Level to %d...\r\n", record->port);
+			return Separator;
+
+		case STP_TRACE_EVENT_MST_CONFIG_TABLE_SET:
+			printf ("%s", pendingFooter);
+			PrintTimestamp (record->timestamp);
+			printf (": Setting MST Config Table... ");
+			printf ((record->flags & STP_TRACE_FLAG_NOTHING_CHANGED) ? "... nothing changed.\r\n" : "\r\n");
+			return Separator;
+
+		case STP_TRACE_EVENT_MST_CONFIG_TABLE_ENTRIES_SET:
+			printf ("%s", pendingFooter);
+			PrintTimestamp (record->timestamp);
+			printf (": Setting MST Config Table entries for VLANs %d to %d... ", record->port, (record->machine << 8) | record->state);
+			printf ((record->flags & STP_TRACE_FLAG_NOTHING_CHANGED) ? "... nothing changed.\r\n" : "\r\n");
+			return Separator;
+
+		case STP_TRACE_EVENT_PORT_ADMIN_EDGE_SET:
+			printf ("%s", pendingFooter);
+			PrintTimestamp (record->timestamp);
+			printf (": Setting adminEdge = %d on port %d...\r\n", record->value, 1 + record->port);
+			return Separator;
+
+		case STP_TRACE_EVENT_PORT_AUTO_EDGE_SET:
+			printf ("%s", pendingFooter);
+			PrintTimestamp (record->timestamp);
+			printf (": Setting autoEdge = %d on port %d...\r\n", record->value, 1 + record->port);
+			return Separator;
+
+		case STP_TRACE_EVENT_PORT_ADMIN_P2P_SET:
+			printf ("%s", pendingFooter);
+			PrintTimestamp (record->timestamp);
+			printf (": Setting adminPointToPointMAC = %s on port %d...\r\n", STP_GetAdminP2PString ((STP_ADMIN_P2P) record->value), 1 + record->port);
+			return Separator;
+
+		default:
+			printf ("(unknown trace record %d)\r\n", record->event);
+			return pendingFooter;
+	}
+}
+
+// ============================================================================
+
+int main (int argc, char* argv[])
+{
+	if (argc != 2)
+	{
+		fprintf (stderr, "Usage: TraceDecoder <trace file>\n");
+		return 1;
+	}
+
+	FILE* file = fopen (argv [1], "rb");
+	if (file == NULL)
+	{
+		fprintf (stderr, "Cannot open %s.\n", argv [1]);
+		return 1;
+	}
+
+	STP_TRACE_HEADER header;
+	if (fread (&header, sizeof (header), 1, file) != 1)
+	{
+		fprintf (stderr, "%s is too small to be a trace file.\n", argv [1]);
+		fclose (file);
+		return 1;
+	}
+
+	STP_TRACE_RECORD* records = (STP_TRACE_RECORD*) malloc (header.recordCapacity * sizeof (STP_TRACE_RECORD));
+	if ((records == NULL) || (fread (records, sizeof (STP_TRACE_RECORD), header.recordCapacity, file) != header.recordCapacity))
+	{
+		fprintf (stderr, "%s is truncated or not a trace file.\n", argv [1]);
+		free (records);
+		fclose (file);
+		return 1;
+	}
+
+	fclose (file);
+
+	if (header.nextRecordIndex >= header.recordCapacity)
+	{
+		fprintf (stderr, "%s is corrupt or not a trace file.\n", argv [1]);
+		free (records);
+		return 1;
+	}
+
+	unsigned int first;
+	unsigned int count;
+	if (header.wrapped)
+	{
+		first = header.nextRecordIndex;
+		count = header.recordCapacity;
+	}
+	else
+	{
+		first = 0;
+		count = header.nextRecordIndex;
+	}
+
+	const char* pendingFooter = "";
+	for (unsigned int i = 0; i < count; i++)
+		pendingFooter = DecodeRecord (&records [(first + i) % header.recordCapacity], pendingFooter);
+
+	printf ("%s", pendingFooter);
+
+	free (records);
+	return 0;
+}
@@ -98,7 +98,7 @@ void L2GP_Receive_802_1Q_2011_InitState (STP_BRIDGE* bridge, int givenPort, int
 	{
 		port->rcvdInternal = true;
 		pseudoRcvMsgs (bridge, givenPort);
-		port->edgeDelayWhile = bridge->MigrateTime;
+		port->edgeDelayWhile = bridge->timerValue (STP_BRIDGE::MigrateTime);
 		port->pseudoInfoHelloWhen = HelloTime (bridge, givenPort);
 	}
 	else if (state == DISCARD)
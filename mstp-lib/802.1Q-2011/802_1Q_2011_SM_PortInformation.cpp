@@ -112,7 +112,7 @@ SM_STATE PortInformation_802_1Q_2011_CheckConditions (STP_BRIDGE* bridge, int gi
 		if (portTree->selected && portTree->updtInfo)
 			return UPDATE;
 
-		if ((portTree->infoIs == INFO_IS_RECEIVED) && (portTree->rcvdInfoWhile == 0) && !portTree->updtInfo && !rcvdXstMsg (bridge, givenPort, givenTree))
+		if ((portTree->infoIs == INFO_IS_RECEIVED) && (portTree->timers->rcvdInfoWhile == 0) && !portTree->updtInfo && !rcvdXstMsg (bridge, givenPort, givenTree))
 			return AGED;
 
 		if (rcvdXstMsg (bridge, givenPort, givenTree) && !updtXstInfo (bridge, givenPort, givenTree))
@@ -162,14 +162,16 @@ void PortInformation_802_1Q_2011_InitState (STP_BRIDGE* bridge, int givenPort, i
 	{
 		portTree->rcvdMsg = false;
 		portTree->proposing = portTree->proposed = portTree->agree = portTree->agreed = false;
-		portTree->rcvdInfoWhile = 0;
+		portTree->timers->rcvdInfoWhile = 0;
 		portTree->infoIs = INFO_IS_DISABLED; portTree->reselect = true; portTree->selected = false;
+		bridge->markRootCandidateDirty (givenPort, givenTree);
 	}
 	else if (state == AGED)
 	{
 		portTree->infoIs = INFO_IS_AGED;
 		portTree->reselect = true;
 		portTree->selected = false;
+		bridge->markRootCandidateDirty (givenPort, givenTree);
 	}
 	else if (state == UPDATE)
 	{
@@ -181,14 +183,15 @@ void PortInformation_802_1Q_2011_InitState (STP_BRIDGE* bridge, int givenPort, i
 //LOG (bridge, givenPort, givenTree, "{S} portTree->portPriority = portTree->designatedPriority\r\n", port->debugName);
 //LOG (bridge, givenPort, givenTree, "{S}         old = {PVS}\r\n", port->debugName, &portTree->portPriority);
 
-		portTree->portPriority = portTree->designatedPriority;
+		portTree->CopyPriority (DESIGNATED_INFO, PORT_INFO);
 
 //LOG (bridge, givenPort, givenTree, "{S}         new = {PVS}\r\n", port->debugName, &portTree->portPriority);
 //LOG (bridge, givenPort, givenTree, "-------------------------\r\n");
 
-		portTree->portTimes = portTree->designatedTimes;
+		portTree->CopyTimes (DESIGNATED_INFO, PORT_INFO);
 		portTree->updtInfo = false;
 		portTree->infoIs = INFO_IS_MINE;
+		bridge->markRootCandidateDirty (givenPort, givenTree);
 
 		if (givenTree == CIST_INDEX)
 			port->newInfo = true;
@@ -197,7 +200,11 @@ void PortInformation_802_1Q_2011_InitState (STP_BRIDGE* bridge, int givenPort, i
 	}
 	else if (state == SUPERIOR_DESIGNATED)
 	{
-		port->infoInternal = port->rcvdInternal;
+		if (port->infoInternal != port->rcvdInternal)
+		{
+			port->infoInternal = port->rcvdInternal;
+			bridge->markRootCandidateDirty (givenPort, CIST_INDEX);
+		}
 		portTree->agreed = portTree->proposing = false;
 		recordProposal (bridge, givenPort, givenTree);
 		setTcFlags (bridge, givenPort, givenTree);
@@ -208,13 +215,18 @@ void PortInformation_802_1Q_2011_InitState (STP_BRIDGE* bridge, int givenPort, i
 		recordTimes (bridge, givenPort, givenTree);
 		updtRcvdInfoWhile (bridge, givenPort, givenTree);
 		portTree->infoIs = INFO_IS_RECEIVED;
+		bridge->markRootCandidateDirty (givenPort, givenTree);
 		portTree->reselect = true;
 		portTree->selected = false;
 		portTree->rcvdMsg = false;
 	}
 	else if (state == REPEATED_DESIGNATED)
 	{
-		port->infoInternal = port->rcvdInternal;
+		if (port->infoInternal != port->rcvdInternal)
+		{
+			port->infoInternal = port->rcvdInternal;
+			bridge->markRootCandidateDirty (givenPort, CIST_INDEX);
+		}
 		recordProposal (bridge, givenPort, givenTree);
 		setTcFlags (bridge, givenPort, givenTree);
 		recordAgreement (bridge, givenPort, givenTree);
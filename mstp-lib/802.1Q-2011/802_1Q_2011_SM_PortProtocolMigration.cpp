@@ -67,7 +67,7 @@ SM_STATE PortProtocolMigration_802_1Q_2011_CheckConditions (STP_BRIDGE* bridge,
 		if (port->mDelayWhile == 0)
 			return SENSING;
 		
-		if ((port->mDelayWhile != bridge->MigrateTime) && !port->portEnabled)
+		if ((port->mDelayWhile != bridge->timerValue (STP_BRIDGE::MigrateTime)) && !port->portEnabled)
 			return CHECKING_RSTP;
 		
 		return 0;
@@ -109,12 +109,14 @@ void PortProtocolMigration_802_1Q_2011_InitState (STP_BRIDGE* bridge, int givenP
 	{
 		port->mcheck = false;
 		port->sendRSTP = rstpVersion (bridge);
-		port->mDelayWhile = bridge->MigrateTime;
+		bridge->trees [CIST_INDEX]->designatedPrioritiesStale = true;
+		port->mDelayWhile = bridge->timerValue (STP_BRIDGE::MigrateTime);
 	}
 	else if (state == SELECTING_STP)
 	{
 		port->sendRSTP = false;
-		port->mDelayWhile = bridge->MigrateTime;
+		bridge->trees [CIST_INDEX]->designatedPrioritiesStale = true;
+		port->mDelayWhile = bridge->timerValue (STP_BRIDGE::MigrateTime);
 	}		
 	else if (state == SENSING)
 	{
@@ -40,7 +40,7 @@ SM_STATE PortReceive_802_1Q_2011_CheckConditions (STP_BRIDGE* bridge, int givenP
 	// Check global conditions.
 
 	if (bridge->BEGIN
-		|| ((port->rcvdBpdu || (port->edgeDelayWhile != bridge->MigrateTime)) && !port->portEnabled))
+		|| ((port->rcvdBpdu || (port->edgeDelayWhile != bridge->timerValue (STP_BRIDGE::MigrateTime))) && !port->portEnabled))
 	{
 		if (state == DISCARD)
 		{
@@ -87,7 +87,7 @@ void PortReceive_802_1Q_2011_InitState (STP_BRIDGE* bridge, int givenPort, int g
 	{
 		port->rcvdBpdu = port->rcvdRSTP = port->rcvdSTP = false;
 		clearAllRcvdMsgs (bridge, givenPort);
-		port->edgeDelayWhile = bridge->MigrateTime;
+		port->edgeDelayWhile = bridge->timerValue (STP_BRIDGE::MigrateTime);
 	}
 	else if (state == RECEIVE)
 	{
@@ -95,7 +95,7 @@ void PortReceive_802_1Q_2011_InitState (STP_BRIDGE* bridge, int givenPort, int g
 		port->rcvdInternal = fromSameRegion (bridge, givenPort);
 		rcvMsgs (bridge, givenPort);
 		port->operEdge = port->isolate = port->rcvdBpdu = false;
-		port->edgeDelayWhile = bridge->MigrateTime;
+		port->edgeDelayWhile = bridge->timerValue (STP_BRIDGE::MigrateTime);
 	}
 	else
 		assert (false);
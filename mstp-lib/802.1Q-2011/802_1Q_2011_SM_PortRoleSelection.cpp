@@ -56,11 +56,9 @@ SM_STATE PortRoleSelection_802_1Q_2011_CheckConditions (STP_BRIDGE* bridge, int
 	
 	if (state == ROLE_SELECTION)
 	{
-		for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
-		{
-			if (bridge->ports [portIndex]->trees [givenTree]->reselect)
-				return ROLE_SELECTION;
-		}
+		// reselect is TRUE for some port; see STP_BRIDGE::updateSharedStateCounts.
+		if (bridge->trees [givenTree]->reselectPortCount != 0)
+			return ROLE_SELECTION;
 		
 		return 0;
 	}
@@ -166,7 +166,7 @@ SM_STATE PortRoleTransitions_802_1Q_2011_CheckConditions (STP_BRIDGE* bridge, in
 	{
 		if (tree->selected && !tree->updtInfo)
 		{
-			if ((tree->fdWhile != MaxAge (bridge, givenPort)) || tree->sync || tree->reRoot || !tree->synced)
+			if ((tree->timers->fdWhile != MaxAge (bridge, givenPort)) || tree->sync || tree->reRoot || !tree->synced)
 				return DISABLED_PORT;
 		}
 
@@ -180,13 +180,20 @@ SM_STATE PortRoleTransitions_802_1Q_2011_CheckConditions (STP_BRIDGE* bridge, in
 	{
 		if (tree->selected && !tree->updtInfo)
 		{
-			if (((tree->sync && !tree->synced) || (tree->reRoot && (tree->rrWhile != 0)) || tree->disputed) && !port->operEdge && (tree->learn || tree->forward))
+			bool mustDiscard = ((tree->sync && !tree->synced) || (tree->reRoot && (tree->timers->rrWhile != 0)) || tree->disputed) && !port->operEdge;
+
+			if (mustDiscard && (tree->learn || tree->forward))
 				return MASTER_DISCARD;
 
-			if (((tree->fdWhile == 0) || allSynced (bridge, givenPort, givenTree)) && !tree->learn)
+			// Note AG: Unlike those of DESIGNATED_LEARN and DESIGNATED_FORWARD, the conditions of 13.39 for MASTER_LEARN
+			// and MASTER_FORWARD don't check sync, reRoot and disputed, and allSynced doesn't look at the given port.
+			// A Master Port with sync set and synced clear, while the other ports are synced, would go to MASTER_LEARN
+			// right after MASTER_DISCARD, and back, before MASTER_SYNCED (checked later) could set synced.
+			// So we don't start learning or forwarding while MASTER_DISCARD would undo it.
+			if (((tree->timers->fdWhile == 0) || allSynced (bridge, givenPort, givenTree)) && !tree->learn && !mustDiscard)
 				return MASTER_LEARN;
 
-			if (((tree->fdWhile == 0) || allSynced (bridge, givenPort, givenTree)) && (tree->learn && !tree->forward))
+			if (((tree->timers->fdWhile == 0) || allSynced (bridge, givenPort, givenTree)) && (tree->learn && !tree->forward) && !mustDiscard)
 				return MASTER_FORWARD;
 
 			if (tree->proposed && !tree->agree)
@@ -198,7 +205,7 @@ SM_STATE PortRoleTransitions_802_1Q_2011_CheckConditions (STP_BRIDGE* bridge, in
 			if ((!tree->learning && !tree->forwarding && !tree->synced) || (tree->agreed && !tree->synced) || (port->operEdge && !tree->synced) || (tree->sync && tree->synced))
 				return MASTER_SYNCED;
 
-			if (tree->reRoot && (tree->rrWhile == 0))
+			if (tree->reRoot && (tree->timers->rrWhile == 0))
 				return MASTER_RETIRED;
 		}
 
@@ -242,10 +249,10 @@ SM_STATE PortRoleTransitions_802_1Q_2011_CheckConditions (STP_BRIDGE* bridge, in
 			if ((tree->agreed && !tree->synced) || (tree->sync && tree->synced))
 				return ROOT_SYNCED;
 
-			if (!tree->forward && (tree->rbWhile == 0) && !tree->reRoot)
+			if (!tree->forward && (tree->timers->rbWhile == 0) && !tree->reRoot)
 				return REROOT;
 
-			if (tree->rrWhile != FwdDelay (bridge, givenPort))
+			if (tree->timers->rrWhile != FwdDelay (bridge, givenPort))
 				return ROOT_PORT;
 
 			if (tree->disputed)
@@ -254,10 +261,10 @@ SM_STATE PortRoleTransitions_802_1Q_2011_CheckConditions (STP_BRIDGE* bridge, in
 			if (tree->reRoot && tree->forward)
 				return REROOTED;
 
-			if (((tree->fdWhile == 0) || (reRooted (bridge, givenPort, givenTree) && (tree->rbWhile == 0) && rstpVersion (bridge))) && !tree->learn)
+			if (((tree->timers->fdWhile == 0) || (reRooted (bridge, givenPort, givenTree) && (tree->timers->rbWhile == 0) && rstpVersion (bridge))) && !tree->learn)
 				return ROOT_LEARN;
 
-			if (((tree->fdWhile == 0) || (reRooted (bridge, givenPort, givenTree) && (tree->rbWhile == 0) && rstpVersion (bridge))) && tree->learn && !tree->forward)
+			if (((tree->timers->fdWhile == 0) || (reRooted (bridge, givenPort, givenTree) && (tree->timers->rbWhile == 0) && rstpVersion (bridge))) && tree->learn && !tree->forward)
 				return ROOT_FORWARD;
 		}
 
@@ -309,16 +316,16 @@ SM_STATE PortRoleTransitions_802_1Q_2011_CheckConditions (STP_BRIDGE* bridge, in
 				return DESIGNATED_SYNCED;
 			}
 
-			if (tree->reRoot && (tree->rrWhile == 0))
+			if (tree->reRoot && (tree->timers->rrWhile == 0))
 				return DESIGNATED_RETIRED;
 
-			if (((tree->sync && !tree->synced) || (tree->reRoot && (tree->rrWhile != 0)) || tree->disputed || port->isolate) && !port->operEdge && (tree->learn || tree->forward))
+			if (((tree->sync && !tree->synced) || (tree->reRoot && (tree->timers->rrWhile != 0)) || tree->disputed || port->isolate) && !port->operEdge && (tree->learn || tree->forward))
 				return DESIGNATED_DISCARD;
 
-			if (((tree->fdWhile == 0) || tree->agreed || port->operEdge) && ((tree->rrWhile == 0) || !tree->reRoot) && !tree->sync && !tree->learn && !port->isolate)
+			if (((tree->timers->fdWhile == 0) || tree->agreed || port->operEdge) && ((tree->timers->rrWhile == 0) || !tree->reRoot) && !tree->sync && !tree->learn && !port->isolate)
 				return DESIGNATED_LEARN;
 
-			if (((tree->fdWhile == 0) || tree->agreed || port->operEdge) && ((tree->rrWhile == 0) || !tree->reRoot) && !tree->sync && (tree->learn && !tree->forward) && !port->isolate)
+			if (((tree->timers->fdWhile == 0) || tree->agreed || port->operEdge) && ((tree->timers->rrWhile == 0) || !tree->reRoot) && !tree->sync && (tree->learn && !tree->forward) && !port->isolate)
 				return DESIGNATED_FORWARD;
 		}
 
@@ -359,10 +366,10 @@ SM_STATE PortRoleTransitions_802_1Q_2011_CheckConditions (STP_BRIDGE* bridge, in
 			if ((allSynced (bridge, givenPort, givenTree) && !tree->agree) || (tree->proposed && tree->agree))
 				return ALTERNATE_AGREED;
 
-			if ((tree->fdWhile != forwardDelay (bridge, givenPort)) || tree->sync || tree->reRoot || !tree->synced)
+			if ((tree->timers->fdWhile != forwardDelay (bridge, givenPort)) || tree->sync || tree->reRoot || !tree->synced)
 				return ALTERNATE_PORT;
 
-			if ((tree->rbWhile != 2 * HelloTime (bridge, givenPort)) && (tree->role == STP_PORT_ROLE_BACKUP))
+			if ((tree->timers->rbWhile != 2 * HelloTime (bridge, givenPort)) && (tree->role == STP_PORT_ROLE_BACKUP))
 				return BACKUP_PORT;
 		}
 
@@ -414,9 +421,9 @@ void PortRoleTransitions_802_1Q_2011_InitState (STP_BRIDGE* bridge, int givenPor
 		tree->learn = tree->forward = false;
 		tree->synced = false;
 		tree->sync = tree->reRoot = true;
-		tree->rrWhile = FwdDelay (bridge, givenPort);
-		tree->fdWhile = MaxAge (bridge, givenPort);
-		tree->rbWhile = 0;
+		tree->timers->rrWhile = FwdDelay (bridge, givenPort);
+		tree->timers->fdWhile = MaxAge (bridge, givenPort);
+		tree->timers->rbWhile = 0;
 	}
 	else if (state == DISABLE_PORT)
 	{
@@ -427,9 +434,9 @@ void PortRoleTransitions_802_1Q_2011_InitState (STP_BRIDGE* bridge, int givenPor
 	}
 	else if (state == DISABLED_PORT)
 	{
-		tree->fdWhile = MaxAge (bridge, givenPort);
+		tree->timers->fdWhile = MaxAge (bridge, givenPort);
 		tree->synced = true;
-		tree->rrWhile = 0;
+		tree->timers->rrWhile = 0;
 		tree->sync = tree->reRoot = false;
 	}
 
@@ -454,7 +461,7 @@ void PortRoleTransitions_802_1Q_2011_InitState (STP_BRIDGE* bridge, int givenPor
 	}
 	else if (state == MASTER_SYNCED)
 	{
-		tree->rrWhile = 0;
+		tree->timers->rrWhile = 0;
 		tree->synced = true;
 		tree->sync = false;
 	}
@@ -465,18 +472,18 @@ void PortRoleTransitions_802_1Q_2011_InitState (STP_BRIDGE* bridge, int givenPor
 	else if (state == MASTER_FORWARD)
 	{
 		tree->forward = true;
-		tree->fdWhile = 0;
+		tree->timers->fdWhile = 0;
 		tree->agreed = port->sendRSTP;
 	}
 	else if (state == MASTER_LEARN)
 	{
 		tree->learn = true;
-		tree->fdWhile = forwardDelay (bridge, givenPort);
+		tree->timers->fdWhile = forwardDelay (bridge, givenPort);
 	}
 	else if (state == MASTER_DISCARD)
 	{
 		tree->learn = tree->forward = tree->disputed = false;
-		tree->fdWhile = forwardDelay (bridge, givenPort);
+		tree->timers->fdWhile = forwardDelay (bridge, givenPort);
 	}
 
 	// ------------------------------------------------------------------------
@@ -487,7 +494,7 @@ void PortRoleTransitions_802_1Q_2011_InitState (STP_BRIDGE* bridge, int givenPor
 		tree->role = STP_PORT_ROLE_ROOT;
 		if (bridge->callbacks.onPortRoleChanged != NULL)
 			bridge->callbacks.onPortRoleChanged (bridge, givenPort, givenTree, STP_PORT_ROLE_ROOT, timestamp);
-		tree->rrWhile = FwdDelay (bridge, givenPort);
+		tree->timers->rrWhile = FwdDelay (bridge, givenPort);
 	}
 	else if (state == ROOT_PROPOSED)
 	{
@@ -514,12 +521,12 @@ void PortRoleTransitions_802_1Q_2011_InitState (STP_BRIDGE* bridge, int givenPor
 	}
 	else if (state == ROOT_FORWARD)
 	{
-		tree->fdWhile = 0;
+		tree->timers->fdWhile = 0;
 		tree->forward = true;
 	}
 	else if (state == ROOT_LEARN)
 	{
-		tree->fdWhile = forwardDelay (bridge, givenPort);
+		tree->timers->fdWhile = forwardDelay (bridge, givenPort);
 		tree->learn = true;
 	}
 	else if (state == REROOTED)
@@ -529,9 +536,9 @@ void PortRoleTransitions_802_1Q_2011_InitState (STP_BRIDGE* bridge, int givenPor
 	else if (state == ROOT_DISCARD)
 	{
 		if (tree->disputed)
-			tree->rbWhile = 3 * HelloTime (bridge, givenPort);
+			tree->timers->rbWhile = 3 * HelloTime (bridge, givenPort);
 		tree->learn = tree->forward = tree->disputed = false;
-		tree->fdWhile = FwdDelay (bridge, givenPort);
+		tree->timers->fdWhile = FwdDelay (bridge, givenPort);
 	}
 
 	// ------------------------------------------------------------------------
@@ -551,7 +558,7 @@ void PortRoleTransitions_802_1Q_2011_InitState (STP_BRIDGE* bridge, int givenPor
 	else if (state == DESIGNATED_FORWARD)
 	{
 		tree->forward = true;
-		tree->fdWhile = 0;
+		tree->timers->fdWhile = 0;
 		tree->agreed = port->sendRSTP;
 	}
 	else if (state == DESIGNATED_PROPOSE)
@@ -570,7 +577,7 @@ void PortRoleTransitions_802_1Q_2011_InitState (STP_BRIDGE* bridge, int givenPor
 	else if (state == DESIGNATED_LEARN)
 	{
 		tree->learn = true;
-		tree->fdWhile = forwardDelay (bridge, givenPort);
+		tree->timers->fdWhile = forwardDelay (bridge, givenPort);
 	}
 	else if (state == DESIGNATED_AGREE)
 	{
@@ -584,11 +591,11 @@ void PortRoleTransitions_802_1Q_2011_InitState (STP_BRIDGE* bridge, int givenPor
 	else if (state == DESIGNATED_DISCARD)
 	{
 		tree->learn = tree->forward = tree->disputed = false;
-		tree->fdWhile = forwardDelay (bridge, givenPort);
+		tree->timers->fdWhile = forwardDelay (bridge, givenPort);
 	}
 	else if (state == DESIGNATED_SYNCED)
 	{
-		tree->rrWhile = 0;
+		tree->timers->rrWhile = 0;
 		tree->synced = true;
 		tree->sync = false;
 	}
@@ -602,14 +609,14 @@ void PortRoleTransitions_802_1Q_2011_InitState (STP_BRIDGE* bridge, int givenPor
 
 	else if (state == ALTERNATE_PORT)
 	{
-		tree->fdWhile = forwardDelay (bridge, givenPort);
+		tree->timers->fdWhile = forwardDelay (bridge, givenPort);
 		tree->synced = true;
-		tree->rrWhile = 0;
+		tree->timers->rrWhile = 0;
 		tree->sync = tree->reRoot = false;
 	}
 	else if (state == BACKUP_PORT)
 	{
-		tree->rbWhile = 2 * HelloTime (bridge, givenPort);
+		tree->timers->rbWhile = 2 * HelloTime (bridge, givenPort);
 	}
 	else if (state == ALTERNATE_PROPOSED)
 	{
@@ -83,23 +83,21 @@ void PortTimers_802_1Q_2011_InitState (STP_BRIDGE* bridge, int givenPort, int gi
 	}		
 	else if (state == TICK)
 	{
-		if (port->helloWhen      > 0) port->helloWhen--;
-		if (port->mDelayWhile    > 0) port->mDelayWhile--;
-		if (port->edgeDelayWhile > 0) port->edgeDelayWhile--;
-		if (port->txCount        > 0) port->txCount--;
-		if (port->pseudoInfoHelloWhen > 0) port->pseudoInfoHelloWhen--;
-
-		for (unsigned int treeIndex = 0; treeIndex < bridge->treeCount(); treeIndex++)
-		{
-			PORT_TREE* portTree = port->trees [treeIndex];
-
-			if (portTree->tcWhile       > 0) portTree->tcWhile--;
-			if (portTree->fdWhile       > 0) portTree->fdWhile--;
-			if (portTree->rcvdInfoWhile > 0) portTree->rcvdInfoWhile--;
-			if (portTree->rrWhile       > 0) portTree->rrWhile--;
-			if (portTree->tcDetected    > 0) portTree->tcDetected--;
-			if (portTree->rbWhile       > 0) portTree->rbWhile--;
-		}
+		// Note AG: The standard decrements the timers by one every second. We decrement them by the time elapsed
+		// since the previous tick, in the units of the timers, and txCount by the number of txHoldPeriods elapsed
+		// (whole seconds, unless the Hello Time is shorter). Both are 1 when the application calls STP_OnOneSecondTick
+		// and doesn't use millisecond timers.
+		unsigned short units = bridge->tickTimerUnits;
+		unsigned short txHoldPeriods = bridge->tickTxHoldPeriods;
+
+		port->helloWhen      -= (port->helloWhen      < units) ? port->helloWhen      : units;
+		port->mDelayWhile    -= (port->mDelayWhile    < units) ? port->mDelayWhile    : units;
+		port->edgeDelayWhile -= (port->edgeDelayWhile < units) ? port->edgeDelayWhile : units;
+		port->txCount        -= (port->txCount        < txHoldPeriods) ? port->txCount : txHoldPeriods;
+		port->pseudoInfoHelloWhen -= (port->pseudoInfoHelloWhen < units) ? port->pseudoInfoHelloWhen : units;
+
+		// The timers of the trees of this port (fdWhile, rrWhile, rbWhile, tcWhile, rcvdInfoWhile, tcDetected)
+		// were decremented already, with those of all other ports, by DecrementTreeTimers in stp.cpp.
 	}
 	else
 		assert (false);
@@ -116,7 +116,7 @@ void PortTransmit_802_1Q_2011_InitState (STP_BRIDGE* bridge, int givenPort, int
 	}
 	else if (state == TRANSMIT_PERIODIC)
 	{
-		port->newInfo = port->newInfo || (cistDesignatedPort (bridge, givenPort) || (cistRootPort (bridge, givenPort) && (port->trees [CIST_INDEX]->tcWhile != 0)));
+		port->newInfo = port->newInfo || (cistDesignatedPort (bridge, givenPort) || (cistRootPort (bridge, givenPort) && (port->trees [CIST_INDEX]->timers->tcWhile != 0)));
 		port->newInfoMsti = port->newInfoMsti || mstiDesignatedOrTCpropagatingRootPort (bridge, givenPort);
 	}
 	else if (state == TRANSMIT_CONFIG)
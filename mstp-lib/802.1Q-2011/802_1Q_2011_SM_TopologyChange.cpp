@@ -51,6 +51,17 @@ SM_STATE TopologyChange_802_1Q_2011_CheckConditions (STP_BRIDGE* bridge, int giv
 	PORT* port = bridge->ports [givenPort];
 	PORT_TREE* portTree = port->trees [givenTree];
 
+	// Note AG: rcvdTcn and rcvdTcAck are per-port variables (13.25.27, 13.25.28) that only the CIST instance of this
+	// state machine clears: LEARNING and NOTIFIED_TC clear rcvdTcn "if (cist)". rcvMsgs() hands a TCN to the MSTIs
+	// through their rcvdTc, and only the CIST talks to STP bridges, which are the ones sending TCNs and TC-Acks.
+	// The CIST instance runs first, so the MSTI instances normally see these variables only after it has cleared them.
+	// But when the CIST instance doesn't clear them, being INACTIVE on a port with the Alternate role in the CIST
+	// and the Designated role in an MSTI, the MSTI instance would go from ACTIVE through NOTIFIED_TCN and NOTIFIED_TC
+	// forever, or re-enter LEARNING forever. So, deviating from 13.37, we let them affect only the CIST instance.
+	bool rcvdTcn = (givenTree == CIST_INDEX) && port->rcvdTcn;
+	bool rcvdTcAck = (givenTree == CIST_INDEX) && port->rcvdTcAck;
+	bool rcvdTcnOrTcAck = rcvdTcn || rcvdTcAck;
+
 	// ------------------------------------------------------------------------
 	// Check global conditions.
 
@@ -80,7 +91,7 @@ SM_STATE TopologyChange_802_1Q_2011_CheckConditions (STP_BRIDGE* bridge, int giv
 			return LEARNING;
 		}
 
-		if (port->rcvdTcn)
+		if (rcvdTcn)
 			return NOTIFIED_TCN;
 
 		if (portTree->rcvdTc)
@@ -89,7 +100,7 @@ SM_STATE TopologyChange_802_1Q_2011_CheckConditions (STP_BRIDGE* bridge, int giv
 		if (portTree->tcProp && !port->operEdge)
 			return PROPAGATING;
 
-		if (port->rcvdTcAck)
+		if (rcvdTcAck)
 			return ACKNOWLEDGED;
 
 		return 0;
@@ -108,10 +119,10 @@ SM_STATE TopologyChange_802_1Q_2011_CheckConditions (STP_BRIDGE* bridge, int giv
 		if (((portTree->role == STP_PORT_ROLE_ROOT) || (portTree->role == STP_PORT_ROLE_DESIGNATED) || (portTree->role == STP_PORT_ROLE_MASTER)) && portTree->forward && !port->operEdge)
 			return DETECTED;
 
-		if ((portTree->role != STP_PORT_ROLE_ROOT) && (portTree->role != STP_PORT_ROLE_DESIGNATED) && (portTree->role != STP_PORT_ROLE_MASTER) && !(portTree->learn || portTree->learning) && !(portTree->rcvdTc || port->rcvdTcn || port->rcvdTcAck || portTree->tcProp))
+		if ((portTree->role != STP_PORT_ROLE_ROOT) && (portTree->role != STP_PORT_ROLE_DESIGNATED) && (portTree->role != STP_PORT_ROLE_MASTER) && !(portTree->learn || portTree->learning) && !(portTree->rcvdTc || rcvdTcnOrTcAck || portTree->tcProp))
 			return INACTIVE;
 
-		if (portTree->rcvdTc || port->rcvdTcn || port->rcvdTcAck || portTree->tcProp)
+		if (portTree->rcvdTc || rcvdTcnOrTcAck || portTree->tcProp)
 			return LEARNING;
 
 		return 0;
@@ -175,8 +186,8 @@ void TopologyChange_802_1Q_2011_InitState (STP_BRIDGE* bridge, int givenPort, in
 			bridge->callbacks.flushFdb (bridge, givenPort, givenTree, rstpVersion (bridge) ? STP_FLUSH_FDB_TYPE_IMMEDIATE : STP_FLUSH_FDB_TYPE_RAPID_AGEING);
 		}
 
-		portTree->tcDetected = 0;
-		portTree->tcWhile = 0;
+		portTree->timers->tcDetected = 0;
+		portTree->timers->tcWhile = 0;
 		if (givenTree == CIST_INDEX)
 			port->tcAck = false;
 	}
@@ -233,7 +244,7 @@ void TopologyChange_802_1Q_2011_InitState (STP_BRIDGE* bridge, int givenPort, in
 	}
 	else if (state == ACKNOWLEDGED)
 	{
-		portTree->tcWhile = 0;
+		portTree->timers->tcWhile = 0;
 		port->rcvdTcAck = false;
 	}
 	else
@@ -8,6 +8,7 @@
 #include "../stp_log.h"
 #include <assert.h>
 #include <stddef.h>
+#include <string.h>
 
 #ifdef __GNUC__
 	// disable the warning for accessing a field of a non-POD NULL object
@@ -27,10 +28,10 @@ bool betterorsameInfo (STP_BRIDGE* bridge, int givenPort, int givenTree, INFO_IS
 	PORT* port = bridge->ports [givenPort];
 	PORT_TREE* tree = port->trees [givenTree];
 
-	if ((newInfoIs == INFO_IS_RECEIVED) && (tree->infoIs == INFO_IS_RECEIVED) && (tree->msgPriority.IsBetterThanOrSameAs (tree->portPriority)))
+	if ((newInfoIs == INFO_IS_RECEIVED) && (tree->infoIs == INFO_IS_RECEIVED) && (tree->ComparePriorities (MSG_INFO, PORT_INFO) <= 0))
 		return true;
 
-	if ((newInfoIs == INFO_IS_MINE) && (tree->infoIs == INFO_IS_MINE) && (tree->designatedPriority.IsBetterThanOrSameAs (tree->portPriority)))
+	if ((newInfoIs == INFO_IS_MINE) && (tree->infoIs == INFO_IS_MINE) && (tree->ComparePriorities (DESIGNATED_INFO, PORT_INFO) <= 0))
 		return true;
 
 	return false;
@@ -50,8 +51,13 @@ void clearAllRcvdMsgs (STP_BRIDGE* bridge, int givenPort)
 // Clears reselect for the tree (the CIST or a given MSTI) for all ports of the bridge.
 void clearReselectTree (STP_BRIDGE* bridge, int givenTree)
 {
+	// Note AG: setSelectedTree, called later in the same transition, reads reselectPortCount, so we can't wait
+	// for the scheduler to update the counts after the transition.
 	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
+	{
 		bridge->ports [portIndex]->trees [givenTree]->reselect = false;
+		bridge->updateSharedStateCounts (portIndex, givenTree);
+	}
 }
 
 // ============================================================================
@@ -61,6 +67,11 @@ void disableForwarding (STP_BRIDGE* bridge, int givenPort, int givenTree, unsign
 	assert (givenPort != -1);
 	assert (givenTree != -1);
 
+	// Not in the standard: see PORT::forwardingVlans. The bits of this tree are already clear if it wasn't forwarding.
+	PORT* port = bridge->ports [givenPort];
+	if (port->trees [givenTree]->forwarding)
+		bridge->updatePortVlanBitmap (givenPort, port->forwardingVlans, givenTree, false);
+
 	FLUSH_LOG (bridge);
 
 	bridge->callbacks.enableForwarding (bridge, givenPort, givenTree, false, timestamp);
@@ -73,6 +84,10 @@ void disableLearning (STP_BRIDGE* bridge, int givenPort, int givenTree, unsigned
 	assert (givenPort != -1);
 	assert (givenTree != -1);
 
+	PORT* port = bridge->ports [givenPort];
+	if (port->trees [givenTree]->learning)
+		bridge->updatePortVlanBitmap (givenPort, port->learningVlans, givenTree, false);
+
 	FLUSH_LOG (bridge);
 
 	bridge->callbacks.enableLearning (bridge, givenPort, givenTree, false, timestamp);
@@ -85,6 +100,10 @@ void enableForwarding (STP_BRIDGE* bridge, int givenPort, int givenTree, unsigne
 	assert (givenPort != -1);
 	assert (givenTree != -1);
 
+	PORT* port = bridge->ports [givenPort];
+	if (!port->trees [givenTree]->forwarding)
+		bridge->updatePortVlanBitmap (givenPort, port->forwardingVlans, givenTree, true);
+
 	FLUSH_LOG (bridge);
 
 	bridge->callbacks.enableForwarding (bridge, givenPort, givenTree, true, timestamp);
@@ -97,6 +116,10 @@ void enableLearning (STP_BRIDGE* bridge, int givenPort, int givenTree, unsigned
 	assert (givenPort != -1);
 	assert (givenTree != -1);
 
+	PORT* port = bridge->ports [givenPort];
+	if (!port->trees [givenTree]->learning)
+		bridge->updatePortVlanBitmap (givenPort, port->learningVlans, givenTree, true);
+
 	FLUSH_LOG (bridge);
 
 	bridge->callbacks.enableLearning (bridge, givenPort, givenTree, true, timestamp);
@@ -112,15 +135,15 @@ bool fromSameRegion (STP_BRIDGE* bridge, int givenPort)
 
 	PORT* port = bridge->ports [givenPort];
 
-	assert (bridge->receivedBpduContent != NULL);
+	assert (port->receivedBpduContent != NULL);
 
 	// Note AG: I added the condition "&& ForceProtocolVersion >= MSTP"
 	// (if we're running STP or RSTP, we shouldn't be looking at our MST Config ID!)
 
 	bool result = port->rcvdRSTP
-		&& (bridge->receivedBpduType == VALIDATED_BPDU_TYPE_MST)
+		&& (port->receivedBpduType == VALIDATED_BPDU_TYPE_MST)
 		&& (bridge->ForceProtocolVersion >= STP_VERSION_MSTP)
-		&& (bridge->receivedBpduContent->mstConfigId == bridge->MstConfigId);
+		&& (port->receivedBpduContent->mstConfigId == bridge->MstConfigId);
 
 	return result;
 }
@@ -143,12 +166,12 @@ void newTcDetected (STP_BRIDGE* bridge, int givenPort, int givenTree)
 	PORT* port = bridge->ports [givenPort];
 	PORT_TREE* tree = port->trees [givenTree];
 
-	if ((tree->tcDetected == 0) && port->sendRSTP)
-		tree->tcDetected = port->trees [CIST_INDEX]->portTimes.HelloTime + 1;
+	if ((tree->timers->tcDetected == 0) && port->sendRSTP)
+		tree->timers->tcDetected = bridge->timerValue (port->GetCistTree ()->cistTimes [PORT_INFO].HelloTime + 256);
 
-	if ((tree->tcDetected == 0) && (port->sendRSTP == false))
+	if ((tree->timers->tcDetected == 0) && (port->sendRSTP == false))
 	{
-		tree->tcDetected = bridge->trees [givenTree]->rootTimes.MaxAge + bridge->trees [givenTree]->rootTimes.ForwardDelay;
+		tree->timers->tcDetected = bridge->timerValue (bridge->trees [givenTree]->rootTimes.MaxAge + bridge->trees [givenTree]->rootTimes.ForwardDelay);
 	}
 }
 
@@ -171,9 +194,9 @@ void newTcWhile (STP_BRIDGE* bridge, int givenPort, int givenTree)
 	PORT* port = bridge->ports [givenPort];
 	PORT_TREE* portTree = port->trees [givenTree];
 
-	if ((portTree->tcWhile == 0) && (port->sendRSTP == true))
+	if ((portTree->timers->tcWhile == 0) && (port->sendRSTP == true))
 	{
-		portTree->tcWhile = 1 + port->trees [CIST_INDEX]->portTimes.HelloTime;
+		portTree->timers->tcWhile = bridge->timerValue (256 + port->GetCistTree ()->cistTimes [PORT_INFO].HelloTime);
 
 		if (givenTree == CIST_INDEX)
 			port->newInfo = true;
@@ -181,9 +204,9 @@ void newTcWhile (STP_BRIDGE* bridge, int givenPort, int givenTree)
 			port->newInfoMsti = true;
 	}
 
-	if ((portTree->tcWhile == 0) && (port->sendRSTP == false))
+	if ((portTree->timers->tcWhile == 0) && (port->sendRSTP == false))
 	{
-		portTree->tcWhile = bridge->trees [givenTree]->rootTimes.MaxAge + bridge->trees [givenTree]->rootTimes.ForwardDelay;
+		portTree->timers->tcWhile = bridge->timerValue (bridge->trees [givenTree]->rootTimes.MaxAge + bridge->trees [givenTree]->rootTimes.ForwardDelay);
 	}
 }
 
@@ -226,8 +249,8 @@ RCVD_INFO rcvInfo (STP_BRIDGE* bridge, int givenPort, int givenTree)
 	//       (portTimes-13.25.34).
 	if (portTree->msgFlagsPortRole == BPDU_PORT_ROLE_DESIGNATED)
 	{
-		if (   portTree->msgPriority.IsSuperiorTo (portTree->portPriority)
-			|| ((portTree->msgPriority == portTree->portPriority) && (portTree->msgTimes != portTree->portTimes)))
+		if (   portTree->IsPrioritySuperiorTo (MSG_INFO, PORT_INFO)
+			|| ((portTree->ComparePriorities (MSG_INFO, PORT_INFO) == 0) && !portTree->AreTimesEqual (MSG_INFO, PORT_INFO)))
 		{
 //LOG (bridge, givenPort, givenTree, "-------------------------\r\n");
 //LOG (bridge, givenPort, givenTree, "{S}: portTree->msgPriority.IsSuperiorTo (portTree->portPriority)\r\n", port->debugName);
@@ -246,7 +269,7 @@ RCVD_INFO rcvInfo (STP_BRIDGE* bridge, int givenPort, int givenTree)
 	//       vector and timer values; and
 	//    2) infoIs is Received.
 	if (   (portTree->msgFlagsPortRole == BPDU_PORT_ROLE_DESIGNATED)
-		&& ((portTree->msgPriority == portTree->portPriority) && (portTree->msgTimes == portTree->portTimes))
+		&& ((portTree->ComparePriorities (MSG_INFO, PORT_INFO) == 0) && portTree->AreTimesEqual (MSG_INFO, PORT_INFO))
 		&& (portTree->infoIs == INFO_IS_RECEIVED))
 	{
 		return RCVD_INFO_REPEATED_DESIGNATED;
@@ -264,7 +287,7 @@ RCVD_INFO rcvInfo (STP_BRIDGE* bridge, int givenPort, int givenTree)
 	//    a CIST or MSTI message priority that is the same as or worse than the CIST or MSTI port priority
 	//    vector.
 	if (   ((portTree->msgFlagsPortRole == BPDU_PORT_ROLE_ROOT) || (portTree->msgFlagsPortRole == BPDU_PORT_ROLE_ALT_BACKUP))
-		&& (portTree->msgPriority.IsWorseThanOrSameAs (portTree->portPriority)))
+		&& (portTree->ComparePriorities (MSG_INFO, PORT_INFO) >= 0))
 	{
 		return RCVD_INFO_INFERIOR_ROOT_ALTERNATE;
 	}
@@ -282,53 +305,74 @@ void rcvMsgs (STP_BRIDGE* bridge, int givenPort)
 	// This procedure is invoked by the Port Receive state machine (13.29) to decode a received BPDU. Sets
 	// rcvdTcn and rcvdTc for each and every MSTI if a TCN BPDU has been received, and extracts the message
 	// priority and timer values from the received BPDU storing them in the msgPriority and msgTimes variables.
-	if (bridge->receivedBpduType == VALIDATED_BPDU_TYPE_STP_TCN)
+	if (port->receivedBpduType == VALIDATED_BPDU_TYPE_STP_TCN)
 	{
 		port->rcvdTcn = true;
 
 		for (unsigned int treeIndex = 1; treeIndex < bridge->treeCount(); treeIndex++)
 			port->trees [treeIndex]->rcvdTc = true;
+
+		// Note AG: A TCN BPDU carries no priority vector, times or flags, but the Port Receive state machine sets rcvdMsg
+		// for it like for the other BPDUs (13.29), and 13.27.13 says nothing about the msgFlags. The Port Information
+		// state machine would then see the flags of the previous BPDU received on the port: with the Designated Port Role
+		// that a Configuration BPDU implicitly conveys, rcvInfo() would return RepeatedDesignatedInfo and restart
+		// rcvdInfoWhile, and a neighbor that sends only TCNs would keep its information from aging out forever.
+		// So we clear them, and rcvInfo() returns OtherInfo.
+		PORT_TREE* portCistTree = port->trees [CIST_INDEX];
+		portCistTree->msgFlagsTc            = false;
+		portCistTree->msgFlagsProposal      = false;
+		portCistTree->msgFlagsPortRole      = BPDU_PORT_ROLE_MASTER; // the "Unknown" role of an RST BPDU
+		portCistTree->msgFlagsLearning      = false;
+		portCistTree->msgFlagsForwarding    = false;
+		portCistTree->msgFlagsAgreement     = false;
+		portCistTree->msgFlagsTcAckOrMaster = false;
 	}
-	else if ((bridge->receivedBpduType == VALIDATED_BPDU_TYPE_STP_CONFIG)
-		||   (bridge->receivedBpduType == VALIDATED_BPDU_TYPE_RST)
-		||   (bridge->receivedBpduType == VALIDATED_BPDU_TYPE_MST))
+	else if ((port->receivedBpduType == VALIDATED_BPDU_TYPE_STP_CONFIG)
+		||   (port->receivedBpduType == VALIDATED_BPDU_TYPE_RST)
+		||   (port->receivedBpduType == VALIDATED_BPDU_TYPE_MST))
 	{
-		PORT_TREE* portCistTree = port->trees [CIST_INDEX];
+		PORT_CIST_TREE* portCistTree = port->GetCistTree ();
 
 		// See 13.25.26 in 802.1Q-2011
 
 		// priority
 		// See the definition of "port priority vector" in "13.9 CIST Priority Vector calculations" in 802.1Q-2011
-		portCistTree->msgPriority.RootId				= bridge->receivedBpduContent->cistRootId;
-		portCistTree->msgPriority.ExternalRootPathCost	= bridge->receivedBpduContent->cistExternalPathCost;
-		portCistTree->msgPriority.RegionalRootId		= bridge->receivedBpduContent->cistRegionalRootId;
+		CIST_PRIORITY_PREFIX* msgPriorityPrefix = &portCistTree->priorityPrefixes [MSG_INFO];
+		MSTI_PRIORITY_VECTOR* msgPriority = &portCistTree->priorities [MSG_INFO];
+		msgPriorityPrefix->RootId				= port->receivedBpduContent->cistRootId;
+		msgPriorityPrefix->ExternalRootPathCost	= port->receivedBpduContent->cistExternalPathCost;
+		msgPriority->RegionalRootId				= port->receivedBpduContent->cistRegionalRootId;
 		if (port->rcvdInternal)
 		{
-			portCistTree->msgPriority.InternalRootPathCost = bridge->receivedBpduContent->cistInternalRootPathCost;
-			portCistTree->msgPriority.DesignatedBridgeId   = bridge->receivedBpduContent->cistBridgeId;
+			msgPriority->InternalRootPathCost = port->receivedBpduContent->cistInternalRootPathCost;
+			msgPriority->DesignatedBridgeId   = port->receivedBpduContent->cistBridgeId;
 		}
 		else
 		{
-			portCistTree->msgPriority.InternalRootPathCost = 0;
-			portCistTree->msgPriority.DesignatedBridgeId = bridge->receivedBpduContent->cistRegionalRootId;
+			msgPriority->InternalRootPathCost = 0;
+			msgPriority->DesignatedBridgeId = port->receivedBpduContent->cistRegionalRootId;
 		}
-		portCistTree->msgPriority.DesignatedPortId		= bridge->receivedBpduContent->cistPortId;
+		msgPriority->DesignatedPortId			= port->receivedBpduContent->cistPortId;
+		portCistTree->UpdatePriorityKey (MSG_INFO);
 
 		// times
-		portCistTree->msgTimes.ForwardDelay = bridge->receivedBpduContent->ForwardDelay.GetValue () / 256;
-		portCistTree->msgTimes.HelloTime    = bridge->receivedBpduContent->HelloTime.GetValue () / 256;
-		portCistTree->msgTimes.MaxAge       = bridge->receivedBpduContent->MaxAge.GetValue () / 256;
-		portCistTree->msgTimes.MessageAge   = bridge->receivedBpduContent->MessageAge.GetValue () / 256;
+		// Note AG: TIMES have the same units as the BPDU. Without millisecond timers we drop the fractions of a second,
+		// as the library always did, for the timers and the comparisons between times to work in whole seconds.
+		unsigned short timeMask = bridge->millisecondTimers ? 0xFFFF : 0xFF00;
+		portCistTree->cistTimes [MSG_INFO].ForwardDelay = port->receivedBpduContent->ForwardDelay.GetValue () & timeMask;
+		portCistTree->cistTimes [MSG_INFO].HelloTime    = port->receivedBpduContent->HelloTime.GetValue () & timeMask;
+		portCistTree->cistTimes [MSG_INFO].MaxAge       = port->receivedBpduContent->MaxAge.GetValue () & timeMask;
+		portCistTree->cistTimes [MSG_INFO].MessageAge   = port->receivedBpduContent->MessageAge.GetValue () & timeMask;
 		if (port->rcvdInternal)
-			portCistTree->msgTimes.remainingHops = bridge->receivedBpduContent->cistRemainingHops;
+			portCistTree->remainingHops [MSG_INFO] = port->receivedBpduContent->cistRemainingHops;
 		else
-			portCistTree->msgTimes.remainingHops = bridge->MaxHops;
+			portCistTree->remainingHops [MSG_INFO] = bridge->MaxHops;
 
 		// flags
-		if (bridge->receivedBpduType == VALIDATED_BPDU_TYPE_STP_CONFIG)
+		if (port->receivedBpduType == VALIDATED_BPDU_TYPE_STP_CONFIG)
 		{
-			portCistTree->msgFlagsTc            = GetBpduFlagTc    (bridge->receivedBpduContent->cistFlags);
-			portCistTree->msgFlagsTcAckOrMaster = GetBpduFlagTcAck (bridge->receivedBpduContent->cistFlags);
+			portCistTree->msgFlagsTc            = GetBpduFlagTc    (port->receivedBpduContent->cistFlags);
+			portCistTree->msgFlagsTcAckOrMaster = GetBpduFlagTcAck (port->receivedBpduContent->cistFlags);
 
 			// From the note at the end of 13.27.12 in 802.1Q-2011:
 			// A Configuration BPDU implicitly conveys a Designated Port Role.
@@ -342,12 +386,12 @@ void rcvMsgs (STP_BRIDGE* bridge, int givenPort)
 		}
 		else
 		{
-			portCistTree->msgFlagsTc            = GetBpduFlagTc         (bridge->receivedBpduContent->cistFlags);
-			portCistTree->msgFlagsProposal      = GetBpduFlagProposal   (bridge->receivedBpduContent->cistFlags);
-			portCistTree->msgFlagsPortRole      = GetBpduFlagPortRole   (bridge->receivedBpduContent->cistFlags);
-			portCistTree->msgFlagsLearning      = GetBpduFlagLearning   (bridge->receivedBpduContent->cistFlags);
-			portCistTree->msgFlagsForwarding    = GetBpduFlagForwarding (bridge->receivedBpduContent->cistFlags);
-			portCistTree->msgFlagsAgreement     = GetBpduFlagAgreement  (bridge->receivedBpduContent->cistFlags);
+			portCistTree->msgFlagsTc            = GetBpduFlagTc         (port->receivedBpduContent->cistFlags);
+			portCistTree->msgFlagsProposal      = GetBpduFlagProposal   (port->receivedBpduContent->cistFlags);
+			portCistTree->msgFlagsPortRole      = GetBpduFlagPortRole   (port->receivedBpduContent->cistFlags);
+			portCistTree->msgFlagsLearning      = GetBpduFlagLearning   (port->receivedBpduContent->cistFlags);
+			portCistTree->msgFlagsForwarding    = GetBpduFlagForwarding (port->receivedBpduContent->cistFlags);
+			portCistTree->msgFlagsAgreement     = GetBpduFlagAgreement  (port->receivedBpduContent->cistFlags);
 			portCistTree->msgFlagsTcAckOrMaster = false;
 		}
 	}
@@ -367,7 +411,7 @@ void rcvMsgs (STP_BRIDGE* bridge, int givenPort)
 		LOG (bridge, -1, -1, "rcvMsgs() -- rcvdInternal==1\r\n");
 
 		// these assert conditions should have been checked while validating the received bpdu
-		unsigned short version3Length = bridge->receivedBpduContent->Version3Length.GetValue ();
+		unsigned short version3Length = port->receivedBpduContent->Version3Length.GetValue ();
 		unsigned short version3Offset = (unsigned short) offsetof (struct MSTP_BPDU, mstConfigId);
 		unsigned short version3CistLength = (unsigned short) sizeof (MSTP_BPDU) - version3Offset;
 		unsigned short mstiLength = version3Length - version3CistLength;
@@ -375,7 +419,7 @@ void rcvMsgs (STP_BRIDGE* bridge, int givenPort)
 
 		unsigned int mstiMessageCount = mstiLength / sizeof (MSTI_CONFIG_MESSAGE);
 
-		const MSTI_CONFIG_MESSAGE* mstiMessages = (MSTI_CONFIG_MESSAGE*) (bridge->receivedBpduContent + 1);
+		const MSTI_CONFIG_MESSAGE* mstiMessages = (MSTI_CONFIG_MESSAGE*) (port->receivedBpduContent + 1);
 
 		for (unsigned int messageIndex = 0; messageIndex < mstiMessageCount; messageIndex++)
 		{
@@ -385,18 +429,18 @@ void rcvMsgs (STP_BRIDGE* bridge, int givenPort)
 
 			PORT_TREE* portTree = port->trees [mstid];
 
-			// first two components are always zero for MSTIs
-			// portTree->msgPriority.RootId
-			// portTree->msgPriority.ExternalRootPathCost
-			portTree->msgPriority.RegionalRootId		= message->RegionalRootId;
-			portTree->msgPriority.InternalRootPathCost	= message->InternalRootPathCost;
+			// MSTIs don't have the first two components (RootId and ExternalRootPathCost), see MSTI_PRIORITY_VECTOR.
+			MSTI_PRIORITY_VECTOR* msgPriority = &portTree->priorities [MSG_INFO];
+			msgPriority->RegionalRootId			= message->RegionalRootId;
+			msgPriority->InternalRootPathCost	= message->InternalRootPathCost;
 
 			// TODO: not sure about the lines below
-			portTree->msgPriority.DesignatedBridgeId.SetPriority (message->BridgePriority << 8, mstid);
-			portTree->msgPriority.DesignatedBridgeId.SetAddress (bridge->receivedBpduContent->cistBridgeId.GetAddress().bytes);
-			portTree->msgPriority.DesignatedPortId.Set (message->PortPriority & 0xF0, bridge->receivedBpduContent->cistPortId.GetPortNumber ());
+			msgPriority->DesignatedBridgeId.SetPriority (message->BridgePriority << 8, mstid);
+			msgPriority->DesignatedBridgeId.SetAddress (port->receivedBpduContent->cistBridgeId.GetAddress().bytes);
+			msgPriority->DesignatedPortId.Set (message->PortPriority & 0xF0, port->receivedBpduContent->cistPortId.GetPortNumber ());
+			portTree->UpdatePriorityKey (MSG_INFO);
 
-			portTree->msgTimes.remainingHops = message->RemainingHops;
+			portTree->remainingHops [MSG_INFO] = message->RemainingHops;
 
 			portTree->msgFlagsTc            = GetBpduFlagTc         (message->flags);
 			portTree->msgFlagsProposal      = GetBpduFlagProposal   (message->flags);
@@ -424,10 +468,10 @@ void recordAgreement (STP_BRIDGE* bridge, int givenPort, int givenTree)
 	assert (givenTree != -1);
 
 	// we're accessing msgFlags below, which is valid only when a received BPDU is being handled
-	assert (bridge->receivedBpduContent != NULL);
+	assert (bridge->ports [givenPort]->receivedBpduContent != NULL);
 
 	PORT* port = bridge->ports [givenPort];
-	PORT_TREE* cistPortTree = port->trees [CIST_INDEX];
+	PORT_CIST_TREE* cistPortTree = port->GetCistTree ();
 	PORT_TREE* portTree = port->trees [givenTree];
 
 	if (givenTree == CIST_INDEX)
@@ -478,9 +522,9 @@ void recordAgreement (STP_BRIDGE* bridge, int givenPort, int givenTree)
 		assert (port->rcvdInternal); // Let's assume they're discarded outside of this function, and that this function is not called.
 
 		if (   port->operPointToPointMAC
-			&& (cistPortTree->msgPriority.RootId               == cistPortTree->portPriority.RootId)
-			&& (cistPortTree->msgPriority.ExternalRootPathCost == cistPortTree->portPriority.ExternalRootPathCost)
-			&& (cistPortTree->msgPriority.RegionalRootId       == cistPortTree->portPriority.RegionalRootId)
+			&& (cistPortTree->priorityPrefixes [MSG_INFO].RootId               == cistPortTree->priorityPrefixes [PORT_INFO].RootId)
+			&& (cistPortTree->priorityPrefixes [MSG_INFO].ExternalRootPathCost == cistPortTree->priorityPrefixes [PORT_INFO].ExternalRootPathCost)
+			&& (cistPortTree->priorities [MSG_INFO].RegionalRootId             == cistPortTree->priorities [PORT_INFO].RegionalRootId)
 			&& portTree->msgFlagsAgreement)
 		{
 			portTree->agreed = true;
@@ -511,7 +555,7 @@ void recordDispute (STP_BRIDGE* bridge, int givenPort, int givenTree)
 	assert (givenTree != -1);
 
 	// we're accessing msgFlags below, which is valid only when a received BPDU is being handled
-	assert (bridge->receivedBpduContent != NULL);
+	assert (bridge->ports [givenPort]->receivedBpduContent != NULL);
 
 	PORT* port = bridge->ports [givenPort];
 	PORT_TREE* portTree = port->trees [givenTree];
@@ -561,7 +605,7 @@ void recordMastered (STP_BRIDGE* bridge, int givenPort, int givenTree)
 	assert (givenTree != -1);
 
 	// we're accessing msgFlags below, which is valid only when a received BPDU is being handled
-	assert (bridge->receivedBpduContent != NULL);
+	assert (bridge->ports [givenPort]->receivedBpduContent != NULL);
 
 	PORT* port = bridge->ports [givenPort];
 
@@ -593,14 +637,19 @@ void recordPriority (STP_BRIDGE* bridge, int givenPort, int givenTree)
 	assert (givenTree != -1);
 
 	// we're accessing msgPriority below, which is valid only when a received BPDU is being handled
-	assert (bridge->receivedBpduContent != NULL);
+	assert (bridge->ports [givenPort]->receivedBpduContent != NULL);
 
 	PORT* port = bridge->ports [givenPort];
 	PORT_TREE* portTree = port->trees [givenTree];
 
-	portTree->portPriority = portTree->msgPriority;
+	portTree->CopyPriority (MSG_INFO, PORT_INFO);
+	bridge->markRootCandidateDirty (givenPort, givenTree);
 
-	LOG (bridge, givenPort, givenTree, "Port {D}: {TN}: recordPriority(): {PVS}\r\n", 1 + givenPort, givenTree, &portTree->portPriority);
+#if STP_USE_LOG
+	PRIORITY_VECTOR portPriority;
+	portTree->GetPriority (PORT_INFO, &portPriority);
+	LOG (bridge, givenPort, givenTree, "Port {D}: {TN}: recordPriority(): {PVS}\r\n", 1 + givenPort, givenTree, &portPriority);
+#endif
 }
 
 // ============================================================================
@@ -620,7 +669,7 @@ void recordProposal (STP_BRIDGE* bridge, int givenPort, int givenTree)
 	assert (givenTree != -1);
 
 	// we're accessing msgFlags below, which is valid only when a received BPDU is being handled
-	assert (bridge->receivedBpduContent != NULL);
+	assert (bridge->ports [givenPort]->receivedBpduContent != NULL);
 
 	PORT* port = bridge->ports [givenPort];
 	PORT_TREE* portTree = port->trees [givenTree];
@@ -657,23 +706,24 @@ void recordTimes (STP_BRIDGE* bridge, int givenPort, int givenTree)
 	assert (givenTree != -1);
 
 	// we're accessing msgTimes below, which is valid only when a received BPDU is being handled
-	assert (bridge->receivedBpduContent != NULL);
+	assert (bridge->ports [givenPort]->receivedBpduContent != NULL);
 
 	PORT* port = bridge->ports [givenPort];
 	PORT_TREE* portTree = port->trees [givenTree];
 
 	if (givenTree == CIST_INDEX)
 	{
-		portTree->portTimes.MessageAge    = portTree->msgTimes.MessageAge;
-		portTree->portTimes.MaxAge        = portTree->msgTimes.MaxAge;
-		portTree->portTimes.ForwardDelay  = portTree->msgTimes.ForwardDelay;
-		portTree->portTimes.remainingHops = portTree->msgTimes.remainingHops;
+		CIST_TIMES* cistTimes = port->GetCistTree ()->cistTimes;
+		cistTimes [PORT_INFO].MessageAge   = cistTimes [MSG_INFO].MessageAge;
+		cistTimes [PORT_INFO].MaxAge       = cistTimes [MSG_INFO].MaxAge;
+		cistTimes [PORT_INFO].ForwardDelay = cistTimes [MSG_INFO].ForwardDelay;
+		portTree->remainingHops [PORT_INFO] = portTree->remainingHops [MSG_INFO];
 
-		portTree->portTimes.HelloTime = STP_BRIDGE::BridgeHelloTime;
+		cistTimes [PORT_INFO].HelloTime = bridge->BridgeHelloTime;
 	}
 	else
 	{
-		portTree->portTimes.remainingHops = portTree->msgTimes.remainingHops;
+		portTree->remainingHops [PORT_INFO] = portTree->remainingHops [MSG_INFO];
 	}
 }
 
@@ -684,6 +734,8 @@ void setReRootTree (STP_BRIDGE* bridge, int givenTree)
 {
 	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
 		bridge->ports [portIndex]->trees [givenTree]->reRoot = true;
+
+	bridge->markTreeDirty (givenTree);
 }
 
 // ============================================================================
@@ -692,11 +744,8 @@ void setReRootTree (STP_BRIDGE* bridge, int givenTree)
 // for all ports in this tree. If reselect is TRUE for any port in this tree, this procedure takes no action.
 void setSelectedTree (STP_BRIDGE* bridge, int givenTree)
 {
-	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
-	{
-		if (bridge->ports [portIndex]->trees [givenTree]->reselect)
-			return;
-	}
+	if (bridge->trees [givenTree]->reselectPortCount != 0)
+		return;
 
 	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
 		bridge->ports [portIndex]->trees [givenTree]->selected = true;
@@ -709,6 +758,8 @@ void setSyncTree (STP_BRIDGE* bridge, int givenTree)
 {
 	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
 		bridge->ports [portIndex]->trees [givenTree]->sync = true;
+
+	bridge->markTreeDirty (givenTree);
 }
 
 // ============================================================================
@@ -729,7 +780,7 @@ void setTcFlags (STP_BRIDGE* bridge, int givenPort, int givenTree)
 	assert (givenTree != -1);
 
 	// we're accessing msgFlags below, which is valid only when a received BPDU is being handled
-	assert (bridge->receivedBpduContent != NULL);
+	assert (bridge->ports [givenPort]->receivedBpduContent != NULL);
 
 	PORT* port = bridge->ports [givenPort];
 
@@ -777,6 +828,8 @@ void setTcPropTree (STP_BRIDGE* bridge, int givenPort, int givenTree)
 			if (portIndex != (unsigned int) givenPort)
 				bridge->ports [portIndex]->trees [givenTree]->tcProp = true;
 		}
+
+		bridge->markTreeDirty (givenTree);
 	}
 }
 
@@ -800,6 +853,7 @@ void syncMaster (STP_BRIDGE* bridge)
 				portTree->agreed = false;
 				portTree->synced = false;
 				portTree->sync = true;
+				bridge->updateSharedStateCounts (portIndex, treeIndex);
 			}
 		}
 	}
@@ -818,13 +872,13 @@ void syncMaster (STP_BRIDGE* bridge)
 void txConfig (STP_BRIDGE* bridge, int givenPort, unsigned int timestamp)
 {
 	PORT* port = bridge->ports [givenPort];
-	PORT_TREE* cistTree = port->trees [CIST_INDEX];
+	PORT_CIST_TREE* cistTree = port->GetCistTree ();
 
 	unsigned int bpduSize = (unsigned int) offsetof (MSTP_BPDU, Version1Length);
 
 	FLUSH_LOG (bridge);
 
-	MSTP_BPDU* bpdu = (MSTP_BPDU*) bridge->callbacks.transmitGetBuffer (bridge, givenPort, bpduSize, timestamp);
+	MSTP_BPDU* bpdu = (MSTP_BPDU*) bridge->getTransmitBuffer (givenPort, bpduSize, timestamp);
 	if (bpdu != NULL)
 	{
 		// 9.3.1 in 802.1D-2004 (not 2011!)
@@ -832,52 +886,51 @@ void txConfig (STP_BRIDGE* bridge, int givenPort, unsigned int timestamp)
 		bpdu->protocolVersionId = 0;
 		bpdu->bpduType = 0;
 
-		bpdu->cistRootId           = cistTree->designatedPriority.RootId;
-		bpdu->cistExternalPathCost = cistTree->designatedPriority.ExternalRootPathCost;
-		bpdu->cistRegionalRootId   = cistTree->designatedPriority.DesignatedBridgeId;
-		bpdu->cistPortId           = cistTree->designatedPriority.DesignatedPortId;
+		bpdu->cistRootId           = cistTree->priorityPrefixes [DESIGNATED_INFO].RootId;
+		bpdu->cistExternalPathCost = cistTree->priorityPrefixes [DESIGNATED_INFO].ExternalRootPathCost;
+		bpdu->cistRegionalRootId   = cistTree->priorities [DESIGNATED_INFO].DesignatedBridgeId;
+		bpdu->cistPortId           = cistTree->priorities [DESIGNATED_INFO].DesignatedPortId;
 
 		bpdu->cistFlags = 0;
 
-		if (cistTree->tcWhile != 0)
+		if (cistTree->timers->tcWhile != 0)
 			bpdu->cistFlags |= (unsigned char) 1;
 
 		if (port->tcAck)
 			bpdu->cistFlags |= (unsigned char) 0x80;
 
-		bpdu->MessageAge   = cistTree->designatedTimes.MessageAge * 256;
-		bpdu->MaxAge       = cistTree->designatedTimes.MaxAge * 256;
-		bpdu->ForwardDelay = cistTree->designatedTimes.ForwardDelay * 256;
-		bpdu->HelloTime    = cistTree->portTimes.HelloTime * 256;
+		bpdu->MessageAge   = cistTree->cistTimes [DESIGNATED_INFO].MessageAge;
+		bpdu->MaxAge       = cistTree->cistTimes [DESIGNATED_INFO].MaxAge;
+		bpdu->ForwardDelay = cistTree->cistTimes [DESIGNATED_INFO].ForwardDelay;
+		bpdu->HelloTime    = cistTree->cistTimes [PORT_INFO].HelloTime;
 
 		LOG (bridge, givenPort, -1, "TX Config BPDU to port {D}:\r\n", 1 + givenPort);
+		TRACE (bridge, STP_TRACE_EVENT_BPDU_TRANSMITTED, givenPort, -1, timestamp, 0, 0, VALIDATED_BPDU_TYPE_STP_CONFIG);
 		LOG_INDENT (bridge);
 		DumpConfigBpdu (bridge, givenPort, -1, bpdu);
 		LOG_UNINDENT (bridge);
 
 		FLUSH_LOG (bridge);
 
-		bridge->callbacks.transmitReleaseBuffer (bridge, bpdu);
+		bridge->releaseTransmitBuffer (bpdu);
 	}
 }
 
 // ============================================================================
-// 13.27.aa) - 13.27.27
-void txRstp (STP_BRIDGE* bridge, int givenPort, unsigned int timestamp)
+
+// Note AG: txRstp() doesn't build the BPDU field by field on every call. It keeps in each port an image of the BPDU
+// (PORT::txTemplate) and copies it over the transmit buffer, then writes only the flags and the Hello Time. This function
+// brings the image up to date, tree by tree: a tree's part is rebuilt only after its txTemplateValid flag was cleared,
+// which updtRolesTree() does when the designated priority or times of the port change, and stp.cpp does when
+// a management setting that goes into the BPDU changes. The part of the CIST also holds the fields that are not
+// specific to a tree (protocol version, MST Configuration Identifier etc.)
+static void UpdateTxTemplate (STP_BRIDGE* bridge, int givenPort)
 {
 	PORT* port = bridge->ports [givenPort];
-	PORT_TREE* cistTree = port->trees [CIST_INDEX];
-
-	unsigned int bpduSize;
-	if (bridge->ForceProtocolVersion < 3)
-		bpduSize = (unsigned int) offsetof (struct MSTP_BPDU, Version3Length);
-	else
-		bpduSize = sizeof(MSTP_BPDU) + bridge->mstiCount * sizeof(MSTI_CONFIG_MESSAGE);
-
-	FLUSH_LOG (bridge);
+	PORT_CIST_TREE* cistTree = port->GetCistTree ();
+	MSTP_BPDU* bpdu = port->txTemplate;
 
-	MSTP_BPDU* bpdu = (MSTP_BPDU*) bridge->callbacks.transmitGetBuffer (bridge, givenPort, bpduSize, timestamp);
-	if (bpdu != NULL)
+	if (!cistTree->txTemplateValid)
 	{
 		// octets 1 and 2 - 14.5 in 802.1Q
 		bpdu->protocolId = 0;
@@ -896,46 +949,30 @@ void txRstp (STP_BRIDGE* bridge, int givenPort, unsigned int timestamp)
 			bpdu->bpduType = 2;
 		}
 
-		// octet 5 - 14.6.a) to 14.6.h)
-		bpdu->cistFlags = GetBpduPortRole (cistTree->role) << 2;
-		if (cistTree->agree)
-			bpdu->cistFlags |= (unsigned char) 0x40;
-
-		if (cistTree->proposing)
-			bpdu->cistFlags |= (unsigned char) 2;
-
-		if (cistTree->tcWhile != 0)
-			bpdu->cistFlags |= (unsigned char) 1;
-
-		if (cistTree->learning)
-			bpdu->cistFlags |= (unsigned char) 0x10;
-
-		if (cistTree->forwarding)
-			bpdu->cistFlags |= (unsigned char) 0x20;
+		// octet 5 - 14.6.a) to 14.6.h) - written by txRstp
 
 		// octets 6 to 13 - 14.6.h)
-		bpdu->cistRootId = cistTree->designatedPriority.RootId;
+		bpdu->cistRootId = cistTree->priorityPrefixes [DESIGNATED_INFO].RootId;
 
 		// octets 14 to 17 - 14.6.i)
-		bpdu->cistExternalPathCost = cistTree->designatedPriority.ExternalRootPathCost;
+		bpdu->cistExternalPathCost = cistTree->priorityPrefixes [DESIGNATED_INFO].ExternalRootPathCost;
 
 		// octets 18 to 25 - 14.6.j)
-		bpdu->cistRegionalRootId = cistTree->designatedPriority.RegionalRootId;
+		bpdu->cistRegionalRootId = cistTree->priorities [DESIGNATED_INFO].RegionalRootId;
 
 		// octets 26 to 27 - 14.6.k)
-		bpdu->cistPortId = cistTree->designatedPriority.DesignatedPortId;
+		bpdu->cistPortId = cistTree->priorities [DESIGNATED_INFO].DesignatedPortId;
 
 		// octets 28 to 29 - 14.6.l)
-		bpdu->MessageAge = cistTree->designatedTimes.MessageAge * 256;
+		bpdu->MessageAge = cistTree->cistTimes [DESIGNATED_INFO].MessageAge;
 
 		// octets 30 to 31 - 14.6.m)
-		bpdu->MaxAge = cistTree->designatedTimes.MaxAge * 256;
+		bpdu->MaxAge = cistTree->cistTimes [DESIGNATED_INFO].MaxAge;
 
-		// octets 32 to 33 - 14.6.n)
-		bpdu->HelloTime = cistTree->portTimes.HelloTime * 256;
+		// octets 32 to 33 - 14.6.n) - written by txRstp
 
 		// octets 34 to 35 - 14.6.o)
-		bpdu->ForwardDelay = cistTree->designatedTimes.ForwardDelay * 256;
+		bpdu->ForwardDelay = cistTree->cistTimes [DESIGNATED_INFO].ForwardDelay;
 
 		// octet 36 - 14.6.p)
 		bpdu->Version1Length = 0;
@@ -943,23 +980,96 @@ void txRstp (STP_BRIDGE* bridge, int givenPort, unsigned int timestamp)
 		if (bridge->ForceProtocolVersion >= 3)
 		{
 			// octet 37 to 38 - 14.6.q)
-			bpdu->Version3Length = (unsigned short) (bpduSize - 38);
+			bpdu->Version3Length = (unsigned short) (sizeof(MSTP_BPDU) + bridge->mstiCount * sizeof(MSTI_CONFIG_MESSAGE) - 38);
 
 			// octet 39 to 89 - 14.6.r)
 			bpdu->mstConfigId = bridge->MstConfigId;
 
 			// octet 90 to 93 - 14.6.s)
-			bpdu->cistInternalRootPathCost	= cistTree->designatedPriority.InternalRootPathCost;
+			bpdu->cistInternalRootPathCost	= cistTree->priorities [DESIGNATED_INFO].InternalRootPathCost;
 
 			// octet 94 to 101 - 14.6.t)
-			bpdu->cistBridgeId				= cistTree->designatedPriority.DesignatedBridgeId;
+			bpdu->cistBridgeId				= cistTree->priorities [DESIGNATED_INFO].DesignatedBridgeId;
 
 			// octet 102 - 14.6.u)
-			bpdu->cistRemainingHops			= cistTree->designatedTimes.remainingHops;
+			bpdu->cistRemainingHops			= cistTree->remainingHops [DESIGNATED_INFO];
+		}
+
+		cistTree->txTemplateValid = true;
+	}
+
+	if (bridge->ForceProtocolVersion >= 3)
+	{
+		MSTI_CONFIG_MESSAGE* mstiMessage = (MSTI_CONFIG_MESSAGE*) (bpdu + 1);
+
+		for (unsigned int mstiIndex = 0; mstiIndex < bridge->treeCount() - 1; mstiIndex++)
+		{
+			PORT_TREE* tree = port->trees [1 + mstiIndex];
+
+			if (!tree->txTemplateValid)
+			{
+				// flags - written by txRstp
+				mstiMessage->RegionalRootId			= tree->priorities [DESIGNATED_INFO].RegionalRootId;
+				mstiMessage->InternalRootPathCost	= tree->priorities [DESIGNATED_INFO].InternalRootPathCost;
+				mstiMessage->BridgePriority			= (bridge->trees [1 + mstiIndex]->GetBridgeIdentifier().GetPriority() & 0xF000) >> 8;
+				mstiMessage->PortPriority			= tree->portId.GetPriority ();
+
+				mstiMessage->RemainingHops		= tree->remainingHops [DESIGNATED_INFO];
+
+				tree->txTemplateValid = true;
+			}
 
+			mstiMessage++;
+		}
+	}
+}
+
+// ============================================================================
+// 13.27.aa) - 13.27.27
+void txRstp (STP_BRIDGE* bridge, int givenPort, unsigned int timestamp)
+{
+	PORT* port = bridge->ports [givenPort];
+	PORT_CIST_TREE* cistTree = port->GetCistTree ();
+
+	unsigned int bpduSize;
+	if (bridge->ForceProtocolVersion < 3)
+		bpduSize = (unsigned int) offsetof (struct MSTP_BPDU, Version3Length);
+	else
+		bpduSize = sizeof(MSTP_BPDU) + bridge->mstiCount * sizeof(MSTI_CONFIG_MESSAGE);
+
+	FLUSH_LOG (bridge);
+
+	MSTP_BPDU* bpdu = (MSTP_BPDU*) bridge->getTransmitBuffer (givenPort, bpduSize, timestamp);
+	if (bpdu != NULL)
+	{
+		UpdateTxTemplate (bridge, givenPort);
+		memcpy (bpdu, port->txTemplate, bpduSize);
+
+		// octet 5 - 14.6.a) to 14.6.h)
+		bpdu->cistFlags = GetBpduPortRole (cistTree->role) << 2;
+		if (cistTree->agree)
+			bpdu->cistFlags |= (unsigned char) 0x40;
+
+		if (cistTree->proposing)
+			bpdu->cistFlags |= (unsigned char) 2;
+
+		if (cistTree->timers->tcWhile != 0)
+			bpdu->cistFlags |= (unsigned char) 1;
+
+		if (cistTree->learning)
+			bpdu->cistFlags |= (unsigned char) 0x10;
+
+		if (cistTree->forwarding)
+			bpdu->cistFlags |= (unsigned char) 0x20;
+
+		// octets 32 to 33 - 14.6.n)
+		bpdu->HelloTime = cistTree->cistTimes [PORT_INFO].HelloTime;
+
+		if (bridge->ForceProtocolVersion >= 3)
+		{
 			MSTI_CONFIG_MESSAGE* mstiMessage = (MSTI_CONFIG_MESSAGE*) (bpdu + 1);
 
-			for (unsigned int mstiIndex = 0; mstiIndex < bridge->mstiCount; mstiIndex++)
+			for (unsigned int mstiIndex = 0; mstiIndex < bridge->treeCount() - 1; mstiIndex++)
 			{
 				const PORT_TREE* tree = port->trees [1 + mstiIndex];
 
@@ -971,7 +1081,7 @@ void txRstp (STP_BRIDGE* bridge, int givenPort, unsigned int timestamp)
 				if (tree->proposing)
 					mstiMessage->flags |= (unsigned char) 2;
 
-				if (tree->tcWhile != 0)
+				if (tree->timers->tcWhile != 0)
 					mstiMessage->flags |= (unsigned char) 1;
 
 				// 13.25.23
@@ -984,13 +1094,6 @@ void txRstp (STP_BRIDGE* bridge, int givenPort, unsigned int timestamp)
 				if (tree->forwarding)
 					mstiMessage->flags |= (unsigned char) 0x20;
 
-				mstiMessage->RegionalRootId			= tree->designatedPriority.RegionalRootId;
-				mstiMessage->InternalRootPathCost	= tree->designatedPriority.InternalRootPathCost;
-				mstiMessage->BridgePriority			= (bridge->trees [1 + mstiIndex]->GetBridgeIdentifier().GetPriority() & 0xF000) >> 8;
-				mstiMessage->PortPriority			= tree->portId.GetPriority ();
-
-				mstiMessage->RemainingHops		= tree->designatedTimes.remainingHops;
-
 				mstiMessage++;
 			}
 		}
@@ -998,6 +1101,7 @@ void txRstp (STP_BRIDGE* bridge, int givenPort, unsigned int timestamp)
 		if (bridge->ForceProtocolVersion < 3)
 		{
 			LOG (bridge, givenPort, -1, "TX RSTP BPDU to port {D}:\r\n", 1 + givenPort);
+			TRACE (bridge, STP_TRACE_EVENT_BPDU_TRANSMITTED, givenPort, -1, timestamp, 0, 0, VALIDATED_BPDU_TYPE_RST);
 			LOG_INDENT (bridge);
 			DumpRstpBpdu (bridge, givenPort, -1, bpdu);
 			LOG_UNINDENT (bridge);
@@ -1005,6 +1109,7 @@ void txRstp (STP_BRIDGE* bridge, int givenPort, unsigned int timestamp)
 		else
 		{
 			LOG (bridge, givenPort, -1, "TX MSTP BPDU to port {D}:\r\n", 1 + givenPort);
+			TRACE (bridge, STP_TRACE_EVENT_BPDU_TRANSMITTED, givenPort, -1, timestamp, 0, 0, VALIDATED_BPDU_TYPE_MST);
 			LOG_INDENT (bridge);
 			DumpMstpBpdu (bridge, givenPort, -1, bpdu);
 			LOG_UNINDENT (bridge);
@@ -1012,7 +1117,7 @@ void txRstp (STP_BRIDGE* bridge, int givenPort, unsigned int timestamp)
 
 		FLUSH_LOG (bridge);
 
-		bridge->callbacks.transmitReleaseBuffer (bridge, bpdu);
+		bridge->releaseTransmitBuffer (bpdu);
 	}
 }
 
@@ -1022,7 +1127,7 @@ void txTcn (STP_BRIDGE* bridge, int givenPort, unsigned int timestamp)
 {
 	FLUSH_LOG (bridge);
 
-	BPDU_HEADER* bpdu = (BPDU_HEADER*) bridge->callbacks.transmitGetBuffer (bridge, givenPort, sizeof (BPDU_HEADER), timestamp);
+	BPDU_HEADER* bpdu = (BPDU_HEADER*) bridge->getTransmitBuffer (givenPort, sizeof (BPDU_HEADER), timestamp);
 	if (bpdu != NULL)
 	{
 		// 9.3.2 in 802.1D-2004 (not 2011!)
@@ -1031,9 +1136,10 @@ void txTcn (STP_BRIDGE* bridge, int givenPort, unsigned int timestamp)
 		bpdu->bpduType = 0x80;
 
 		LOG (bridge, givenPort, -1, "TX TCN BPDU to port {D}:\r\n", 1 + givenPort);
+		TRACE (bridge, STP_TRACE_EVENT_BPDU_TRANSMITTED, givenPort, -1, timestamp, 0, 0, VALIDATED_BPDU_TYPE_STP_TCN);
 		FLUSH_LOG (bridge);
 
-		bridge->callbacks.transmitReleaseBuffer (bridge, bpdu);
+		bridge->releaseTransmitBuffer (bpdu);
 	}
 }
 
@@ -1043,7 +1149,7 @@ void txTcn (STP_BRIDGE* bridge, int givenPort, unsigned int timestamp)
 // rcvdRSTP TRUE if the received BPDU is a RST BPDU or a MST BPDU.
 void updtBPDUVersion (STP_BRIDGE* bridge, int givenPort)
 {
-	switch (bridge->receivedBpduType)
+	switch (bridge->ports [givenPort]->receivedBpduType)
 	{
 		case VALIDATED_BPDU_TYPE_STP_TCN:
 		case VALIDATED_BPDU_TYPE_STP_CONFIG:
@@ -1081,15 +1187,18 @@ void updtRcvdInfoWhile	(STP_BRIDGE* bridge, int givenPort, int givenTree)
 	PORT* port = bridge->ports [givenPort];
 	PORT_TREE* portTree = port->trees [givenTree];
 
-	const TIMES* cistTimes = &port->trees [CIST_INDEX]->portTimes;
+	TIMES cistTimes;
+	port->trees [CIST_INDEX]->GetTimes (PORT_INFO, &cistTimes);
 
-	if (((cistTimes->MessageAge + 1 <= cistTimes->MaxAge) && (port->rcvdInternal == false))
-		|| ((cistTimes->remainingHops > 1) && port->rcvdInternal))
+	unsigned int incrementedMessageAge = (cistTimes.MessageAge + 256 + 128) & ~0xFFu;
+
+	if (((incrementedMessageAge <= cistTimes.MaxAge) && (port->rcvdInternal == false))
+		|| ((cistTimes.remainingHops > 1) && port->rcvdInternal))
 	{
-		portTree->rcvdInfoWhile = 3 * cistTimes->HelloTime;
+		portTree->timers->rcvdInfoWhile = bridge->timerValue (3 * cistTimes.HelloTime);
 	}
 	else
-		portTree->rcvdInfoWhile = 0;
+		portTree->timers->rcvdInfoWhile = 0;
 }
 
 // ============================================================================
@@ -1099,7 +1208,7 @@ static void CalculateRootPathPriorityForPort (STP_BRIDGE* bridge, int givenPort,
 	PORT* port = bridge->ports [givenPort];
 	PORT_TREE* portTree = port->trees [givenTree];
 
-	*rootPathPriorityOut = portTree->portPriority;
+	portTree->GetPriority (PORT_INFO, rootPathPriorityOut);
 
 	if (givenTree == CIST_INDEX)
 	{
@@ -1108,8 +1217,10 @@ static void CalculateRootPathPriorityForPort (STP_BRIDGE* bridge, int givenPort,
 		// from a message priority vector, as follows:
 
 		// Note AG: The standard references 13.27.8 (fromSameRegion), but that function tries to read the received BPDU
-		// outside of STP_OnBpduReceived. I replaced fromSameRegion with rcvdInternal in the "if" below.
-		if (port->rcvdInternal == false)
+		// outside of STP_OnBpduReceived. I replaced fromSameRegion with infoInternal in the "if" below: it was set
+		// from rcvdInternal when the port priority vector was recorded (13.25.16), while rcvdInternal tells only about
+		// the last BPDU received, which may have been an inferior one from a bridge in another region on the same LAN.
+		if (port->infoInternal == false)
 		{
 			// If the port priority vector was received from a bridge in a different region (13.27.8), the External Port Path
 			// Cost EPCPB is added to the External Root Path Cost component, and the Regional Root Identifier is set to
@@ -1118,7 +1229,7 @@ static void CalculateRootPathPriorityForPort (STP_BRIDGE* bridge, int givenPort,
 			//		root path priority vector = {RD : ERCD + EPCPB : B : 0 : D : PD : PB}
 			rootPathPriorityOut->ExternalRootPathCost += port->ExternalPortPathCost;
 			rootPathPriorityOut->RegionalRootId = bridge->trees [givenTree]->GetBridgeIdentifier ();
-			assert (portTree->portPriority.InternalRootPathCost.GetValue () == 0);
+			assert (portTree->priorities [PORT_INFO].InternalRootPathCost.GetValue () == 0);
 		}
 		else
 		{
@@ -1136,13 +1247,16 @@ static void CalculateRootPathPriorityForPort (STP_BRIDGE* bridge, int givenPort,
 		// Path Cost component.
 		//			root path priority vector = {RRD : IRCD + IPCPB : D : PD : PB)
 
-		assert (port->rcvdInternal);
+		// Note AG: We used to assert rcvdInternal here, but it tells only about the last BPDU received on the port.
+		// When the neighbor moves to another region (its MST Configuration Identifier changes), the BPDUs it sends from then on
+		// don't set rcvdMsg for the MSTIs (13.27.13), and the MSTI port priority vector recorded from within the region stays here
+		// until rcvdInfoWhile expires; updtRolesTree() may select it as root path priority vector in the meantime.
 		rootPathPriorityOut->InternalRootPathCost += portTree->InternalPortPathCost;
 	}
 }
 
 // 13.25.7
-static void CalculateDesignatedPriorityForPort (STP_BRIDGE* bridge, int givenPort, int givenTree)
+static void CalculateDesignatedPriorityForPort (STP_BRIDGE* bridge, int givenPort, int givenTree, PRIORITY_VECTOR* designatedPriorityOut)
 {
 	BRIDGE_TREE* bridgeTree = bridge->trees [givenTree];
 	PORT* port = bridge->ports [givenPort];
@@ -1153,16 +1267,16 @@ static void CalculateDesignatedPriorityForPort (STP_BRIDGE* bridge, int givenPor
 		// The designated priority vector for a port Q on bridge B is the root priority vector with B's Bridge Identifier
 		// B substituted for the DesignatedBridgeID and Q's Port Identifier QB substituted for the DesignatedPortID
 		// and RcvPortID components.
-		portTree->designatedPriority = bridgeTree->rootPriority;
-		portTree->designatedPriority.DesignatedBridgeId = bridgeTree->GetBridgeIdentifier ();
-		portTree->designatedPriority.DesignatedPortId   = portTree->portId;
+		*designatedPriorityOut = bridgeTree->rootPriority;
+		designatedPriorityOut->DesignatedBridgeId = bridgeTree->GetBridgeIdentifier ();
+		designatedPriorityOut->DesignatedPortId   = portTree->portId;
 
 		// If Q is attached to a LAN that has one or more STP bridges attached (as
 		// determined by the Port Protocol Migration state machine), B's Bridge Identifier B is also substituted for the
 		// RRootID component.
 		if (port->sendRSTP == false)
 		{
-			portTree->designatedPriority.RegionalRootId = bridgeTree->GetBridgeIdentifier ();
+			designatedPriorityOut->RegionalRootId = bridgeTree->GetBridgeIdentifier ();
 		}
 	}
 	else
@@ -1171,12 +1285,183 @@ static void CalculateDesignatedPriorityForPort (STP_BRIDGE* bridge, int givenPor
 		// The designated priority vector for a port Q on bridge B is the root priority vector with B's Bridge Identifier
 		// B substituted for the DesignatedBridgeID and Q's Port Identifier QB substituted for the DesignatedPortID
 		// and RcvPortID components.
-		portTree->designatedPriority = bridgeTree->rootPriority;
-		portTree->designatedPriority.DesignatedBridgeId	= bridgeTree->GetBridgeIdentifier ();
-		portTree->designatedPriority.DesignatedPortId	= portTree->portId;
+		*designatedPriorityOut = bridgeTree->rootPriority;
+		designatedPriorityOut->DesignatedBridgeId	= bridgeTree->GetBridgeIdentifier ();
+		designatedPriorityOut->DesignatedPortId		= portTree->portId;
 	}
 }
 
+// Not from the standard: selection of the Root Port with a tournament tree, see BRIDGE_TREE::rootCandidates.
+//
+// Note AG: 13.27.31 a) and b) have us compute the root path priority of every port and pick the best, each time
+// Port Role Selection runs; with many ports, a BPDU received on one of them would cost in proportion to all of them.
+// The root path priority of a port depends only on variables of that port and on the bridge identifier, so we keep
+// the winners of a knockout tournament between the ports, and replay only the matches of the ports marked with
+// STP_BRIDGE::markRootCandidateDirty since the previous selection: log2(portCount) matches for each of them.
+// Define STP_CROSS_CHECK_ROOT_SELECTION to have the result verified against the scan of all ports.
+
+static const unsigned short NoRootCandidate = 0xFFFF;
+
+struct ROOT_CANDIDATE
+{
+	unsigned short portIndex; // NoRootCandidate if none
+	PRIORITY_VECTOR_KEY rootPathPriorityKey;
+};
+
+// 13.27.31 b): a port is a candidate for Root Port if it has received information whose DesignatedBridgeID
+// doesn't have our bridge address, and restrictedRole is not set for it.
+static bool IsRootCandidate (STP_BRIDGE* bridge, unsigned int portIndex, int givenTree, PRIORITY_VECTOR* rootPathPriorityOut)
+{
+	PORT* port = bridge->ports [portIndex];
+
+	if ((port->trees [givenTree]->infoIs != INFO_IS_RECEIVED) || port->restrictedRole)
+		return false;
+
+	CalculateRootPathPriorityForPort (bridge, portIndex, givenTree, rootPathPriorityOut);
+
+	return rootPathPriorityOut->DesignatedBridgeId.GetAddress () != bridge->trees [givenTree]->GetBridgePriority ().DesignatedBridgeId.GetAddress ();
+}
+
+static void GetRootCandidateEntry (STP_BRIDGE* bridge, int givenTree, unsigned int entry, ROOT_CANDIDATE* candidateOut)
+{
+	unsigned int portIndex = (entry >= bridge->portCount) ? (entry - bridge->portCount) : bridge->trees [givenTree]->rootCandidates [entry];
+
+	PRIORITY_VECTOR rootPathPriority;
+	if ((portIndex != NoRootCandidate) && IsRootCandidate (bridge, portIndex, givenTree, &rootPathPriority))
+	{
+		candidateOut->portIndex = (unsigned short) portIndex;
+		candidateOut->rootPathPriorityKey.Set (rootPathPriority);
+	}
+	else
+	{
+		// Note that an entry above the ports can hold a port that is no longer a candidate, while SelectRootPortCandidate()
+		// is replaying the matches of the marked ports. That port is marked too, and its own replay will correct the entry.
+		candidateOut->portIndex = NoRootCandidate;
+	}
+}
+
+// The same order as in updtRolesTree() before: by root path priority, then by port identifier.
+static const ROOT_CANDIDATE& GetBetterRootCandidate (STP_BRIDGE* bridge, int givenTree, const ROOT_CANDIDATE& a, const ROOT_CANDIDATE& b)
+{
+	if (b.portIndex == NoRootCandidate)
+		return a;
+
+	if (a.portIndex == NoRootCandidate)
+		return b;
+
+	int result = a.rootPathPriorityKey.Compare (b.rootPathPriorityKey);
+	if (result != 0)
+		return (result < 0) ? a : b;
+
+	const PORT_ID& aPortId = bridge->ports [a.portIndex]->trees [givenTree]->portId;
+	const PORT_ID& bPortId = bridge->ports [b.portIndex]->trees [givenTree]->portId;
+	return aPortId.IsBetterThan (bPortId) ? a : b;
+}
+
+// Brings the tournament tree up to date and returns the port with the best root path priority among the candidates,
+// or NoRootCandidate. Whether it's better than our own bridge priority is for the caller to decide.
+static unsigned int SelectRootPortCandidate (STP_BRIDGE* bridge, int givenTree)
+{
+	BRIDGE_TREE* bridgeTree = bridge->trees [givenTree];
+	unsigned int portCount = bridge->portCount;
+
+	for (unsigned int i = 0; i < bridgeTree->dirtyRootCandidateCount; i++)
+	{
+		unsigned int portIndex = bridgeTree->dirtyRootCandidates [i];
+		bridge->ports [portIndex]->trees [givenTree]->rootCandidateDirty = false;
+
+		if (bridgeTree->allRootCandidatesDirty)
+			continue;
+
+		// Replay the matches from this port's entry up to the top.
+		unsigned int entry = portCount + portIndex;
+		ROOT_CANDIDATE winner;
+		GetRootCandidateEntry (bridge, givenTree, entry, &winner);
+		while (entry > 1)
+		{
+			ROOT_CANDIDATE opponent;
+			GetRootCandidateEntry (bridge, givenTree, entry ^ 1, &opponent);
+			winner = GetBetterRootCandidate (bridge, givenTree, winner, opponent);
+			entry /= 2;
+			bridgeTree->rootCandidates [entry] = winner.portIndex;
+		}
+	}
+
+	bridgeTree->dirtyRootCandidateCount = 0;
+
+	if (bridgeTree->allRootCandidatesDirty)
+	{
+		for (unsigned int entry = portCount - 1; entry >= 1; entry--)
+		{
+			ROOT_CANDIDATE left, right;
+			GetRootCandidateEntry (bridge, givenTree, 2 * entry, &left);
+			GetRootCandidateEntry (bridge, givenTree, 2 * entry + 1, &right);
+			bridgeTree->rootCandidates [entry] = GetBetterRootCandidate (bridge, givenTree, left, right).portIndex;
+		}
+
+		bridgeTree->allRootCandidatesDirty = false;
+	}
+
+	// With a single port, entry 1 is that of the port itself.
+	ROOT_CANDIDATE best;
+	GetRootCandidateEntry (bridge, givenTree, 1, &best);
+	return best.portIndex;
+}
+
+#ifdef STP_CROSS_CHECK_ROOT_SELECTION
+// The scan of all ports that updtRolesTree() used to do, to check the tournament tree against it.
+static void CrossCheckRootSelection (STP_BRIDGE* bridge, int givenTree, const PORT_TREE* rootPortTree)
+{
+	BRIDGE_TREE* bridgeTree = bridge->trees [givenTree];
+
+	PRIORITY_VECTOR rootPriority = bridgeTree->GetBridgePriority ();
+	PORT_ID rootPortId;
+	rootPortId.Reset ();
+	PRIORITY_VECTOR_KEY rootPriorityKey;
+	rootPriorityKey.Set (rootPriority);
+	const PORT_TREE* expectedRootPortTree = NULL;
+
+	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
+	{
+		PORT_TREE* portTree = bridge->ports [portIndex]->trees [givenTree];
+
+		PRIORITY_VECTOR rootPathPriority;
+		if (IsRootCandidate (bridge, portIndex, givenTree, &rootPathPriority))
+		{
+			PRIORITY_VECTOR_KEY rootPathPriorityKey;
+			rootPathPriorityKey.Set (rootPathPriority);
+
+			if (rootPathPriorityKey.IsBetterThan (rootPriorityKey)
+				|| ((rootPathPriorityKey == rootPriorityKey) && (portTree->portId.IsBetterThan (rootPortId))))
+			{
+				expectedRootPortTree = portTree;
+				rootPriority = rootPathPriority;
+				rootPriorityKey = rootPathPriorityKey;
+				rootPortId = portTree->portId;
+			}
+		}
+	}
+
+	assert (rootPortTree == expectedRootPortTree);
+	assert (bridgeTree->rootPriority == rootPriority);
+}
+#endif
+
+// Tells whether the portTimes of a port differ from those of the Root Port, or from rootTimes if there's no Root Port.
+// See the note at condition h) in updtRolesTree().
+static bool PortTimesDifferFromRootPortTimes (const BRIDGE_TREE* bridgeTree, const PORT_TREE* portTree, const PORT_TREE* rootPortTree)
+{
+	TIMES portTimes;
+	portTree->GetTimes (PORT_INFO, &portTimes);
+
+	if (rootPortTree == NULL)
+		return portTimes != bridgeTree->rootTimes;
+
+	TIMES rootPortTimes;
+	rootPortTree->GetTimes (PORT_INFO, &rootPortTimes);
+	return portTimes != rootPortTimes;
+}
+
 // ============================================================================
 // 13.27.ae) - 13.27.31
 void updtRolesTree (STP_BRIDGE* bridge, int givenTree)
@@ -1192,6 +1477,9 @@ void updtRolesTree (STP_BRIDGE* bridge, int givenTree)
 	BRIDGE_ID previousCistRegionalRootIdentifier = bridgeTree->rootPriority.RegionalRootId;
 	INV_UINT4 previousCistExternalRootPathCost   = bridgeTree->rootPriority.ExternalRootPathCost;
 
+	PRIORITY_VECTOR previousRootPriority = bridgeTree->rootPriority;
+	TIMES previousRootTimes = bridgeTree->rootTimes;
+
 	// initialize this to our bridge priority
 	bridgeTree->rootPriority = bridgeTree->GetBridgePriority ();
 	bridgeTree->rootPortId.Reset ();
@@ -1199,62 +1487,107 @@ void updtRolesTree (STP_BRIDGE* bridge, int givenTree)
 
 	PORT_TREE* rootPortTree = NULL;
 
-	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
+	// a) and b), see the note above SelectRootPortCandidate().
+	unsigned int candidatePortIndex = SelectRootPortCandidate (bridge, givenTree);
+	if (candidatePortIndex != NoRootCandidate)
 	{
-		PORT* port = bridge->ports [portIndex];
+		PORT* port = bridge->ports [candidatePortIndex];
 		PORT_TREE* portTree = port->trees [givenTree];
 
-		if (portTree->infoIs == INFO_IS_RECEIVED)
+		PRIORITY_VECTOR rootPathPriority;
+		CalculateRootPathPriorityForPort (bridge, candidatePortIndex, givenTree, &rootPathPriority);
+
+		LOG (bridge, -1, givenTree, "  Port {D} root path priority  : {PVS}\r\n", 1 + candidatePortIndex, &rootPathPriority);
+
+		PRIORITY_VECTOR_KEY rootPathPriorityKey;
+		rootPathPriorityKey.Set (rootPathPriority);
+		PRIORITY_VECTOR_KEY rootPriorityKey;
+		rootPriorityKey.Set (bridgeTree->rootPriority);
+
+		if (rootPathPriorityKey.IsBetterThan (rootPriorityKey)
+			|| ((rootPathPriorityKey == rootPriorityKey) && (portTree->portId.IsBetterThan (bridgeTree->rootPortId))))
 		{
-			// a)
-			PRIORITY_VECTOR rootPathPriority;
-			CalculateRootPathPriorityForPort (bridge, portIndex, givenTree, &rootPathPriority);
+			rootPortTree = portTree;
+
+			bridgeTree->rootPriority = rootPathPriority;
+			bridgeTree->rootPortId   = portTree->portId;
 
-			LOG (bridge, -1, givenTree, "  Port {D} root path priority  : {PVS}\r\n", 1 + portIndex, &rootPathPriority);
+			portTree->GetTimes (PORT_INFO, &bridgeTree->rootTimes);
 
-			// b)
-			if ((rootPathPriority.DesignatedBridgeId.GetAddress () != bridgeTree->GetBridgePriority ().DesignatedBridgeId.GetAddress ())
-				&& (port->restrictedRole == false))
+			// Note AG: The times of an MSTI have only remainingHops (13.27.31 c), and its port priority vector was recorded
+			// from within the region even when infoInternal is now clear (see CalculateRootPathPriorityForPort), so only
+			// the CIST gets the Message Age increment.
+			if ((givenTree == CIST_INDEX) && (port->infoInternal == false))
 			{
-				if (rootPathPriority.IsBetterThan (bridgeTree->rootPriority)
-					|| ((rootPathPriority == bridgeTree->rootPriority) && (portTree->portId.IsBetterThan (bridgeTree->rootPortId))))
-				{
-					rootPortTree = portTree;
-
-					bridgeTree->rootPriority = rootPathPriority;
-					bridgeTree->rootPortId   = portTree->portId;
-
-					bridgeTree->rootTimes = portTree->portTimes;
-					if (port->rcvdInternal == false)
-						bridgeTree->rootTimes.MessageAge++;
-					else
-					{
-						assert (bridgeTree->rootTimes.remainingHops > 0);
-						bridgeTree->rootTimes.remainingHops--;
-					}
-				}
+				// Message Age incremented by 1 second and rounded to the nearest whole second.
+				bridgeTree->rootTimes.MessageAge = (unsigned short) ((bridgeTree->rootTimes.MessageAge + 256 + 128) & ~0xFFu);
+			}
+			else if (bridgeTree->rootTimes.remainingHops > 0)
+			{
+				// Note AG: rcvdInfoWhile of an MSTI is calculated from the remainingHops of the CIST (13.27.30), so MSTI information
+				// that arrived here with no hops left stays current and may be selected. The standard says to decrement
+				// remainingHops; we used to assert that it can't be zero, and we don't let it wrap around to 255 hops instead.
+				bridgeTree->rootTimes.remainingHops--;
 			}
 		}
 	}
 
+#ifdef STP_CROSS_CHECK_ROOT_SELECTION
+	CrossCheckRootSelection (bridge, givenTree, rootPortTree);
+#endif
+
 	LOG (bridge, -1, givenTree, "  bridge root priority : {PVS}\r\n", &bridgeTree->rootPriority);
 	LOG (bridge, -1, givenTree, "  root port = {PID}\r\n", &bridgeTree->rootPortId);
 
 	// ------------------------------------------------------------------------
 
-	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
+	// Note AG: The designated priority vectors and times are computed from rootPriority and rootTimes, the bridge identifier,
+	// the port identifiers, and for the CIST sendRSTP. The last three mark the tree when they change (designatedPrioritiesStale),
+	// so when none of these changed, the ports already have the values d) and e) would give them.
+	if (bridgeTree->designatedPrioritiesStale
+		|| (bridgeTree->rootPriority != previousRootPriority)
+		|| (bridgeTree->rootTimes != previousRootTimes))
 	{
-		PORT* port = bridge->ports [portIndex];
-		PORT_TREE* portTree = port->trees [givenTree];
+		bridgeTree->designatedPrioritiesStale = false;
 
-		// d)
-		CalculateDesignatedPriorityForPort (bridge, portIndex, givenTree);
+		for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
+		{
+			PORT_TREE* portTree = bridge->ports [portIndex]->trees [givenTree];
+
+			// d)
+			PRIORITY_VECTOR designatedPriority;
+			CalculateDesignatedPriorityForPort (bridge, portIndex, givenTree, &designatedPriority);
+			bool changed = portTree->SetPriority (DESIGNATED_INFO, designatedPriority);
+
+			// e)
+			if (portTree->SetTimes (DESIGNATED_INFO, bridgeTree->rootTimes))
+				changed = true;
 
-		// e)
-		portTree->designatedTimes = bridgeTree->rootTimes;
+			if (changed)
+				portTree->txTemplateValid = false;
 
-		LOG (bridge, -1, givenTree, "  Port {D} designated priority : {PVS}\r\n", 1 + portIndex, &portTree->designatedPriority);
+			LOG (bridge, -1, givenTree, "  Port {D} designated priority : {PVS}\r\n", 1 + portIndex, &designatedPriority);
+		}
 	}
+#ifdef STP_CROSS_CHECK_ROOT_SELECTION
+	else
+	{
+		for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
+		{
+			PORT_TREE* portTree = bridge->ports [portIndex]->trees [givenTree];
+
+			PRIORITY_VECTOR expectedPriority;
+			CalculateDesignatedPriorityForPort (bridge, portIndex, givenTree, &expectedPriority);
+			PRIORITY_VECTOR designatedPriority;
+			portTree->GetPriority (DESIGNATED_INFO, &designatedPriority);
+			assert (designatedPriority == expectedPriority);
+
+			TIMES designatedTimes;
+			portTree->GetTimes (DESIGNATED_INFO, &designatedTimes);
+			assert (designatedTimes == bridgeTree->rootTimes);
+		}
+	}
+#endif
 
 	// ------------------------------------------------------------------------
 
@@ -1304,15 +1637,11 @@ void updtRolesTree (STP_BRIDGE* bridge, int givenTree)
 			// Note AG: Problem in the standard: If we are the root bridge, we don't have a root port, so how are we
 			// supposed to look at the "associated timer parameter" "for the Root Port"?
 			// Let's look at the bridge times in this case.
-			if (portTree->portPriority != portTree->designatedPriority)
+			if (portTree->ComparePriorities (PORT_INFO, DESIGNATED_INFO) != 0)
 			{
 				portTree->updtInfo = true;
 			}
-			else if ((rootPortTree != NULL) && (portTree->portTimes != rootPortTree->portTimes))
-			{
-				portTree->updtInfo = true;
-			}
-			else if ((rootPortTree == NULL) && (portTree->portTimes != bridgeTree->rootTimes))
+			else if (PortTimesDifferFromRootPortTimes (bridgeTree, portTree, rootPortTree))
 			{
 				portTree->updtInfo = true;
 			}
@@ -1348,15 +1677,11 @@ void updtRolesTree (STP_BRIDGE* bridge, int givenTree)
 			{
 				portTree->selectedRole = STP_PORT_ROLE_DESIGNATED;
 
-				if (portTree->portPriority != portTree->designatedPriority)
-				{
-					portTree->updtInfo = true;
-				}
-				else if ((rootPortTree != NULL) && (portTree->portTimes != rootPortTree->portTimes))
+				if (portTree->ComparePriorities (PORT_INFO, DESIGNATED_INFO) != 0)
 				{
 					portTree->updtInfo = true;
 				}
-				else if ((rootPortTree == NULL) && (portTree->portTimes != bridgeTree->rootTimes))
+				else if (PortTimesDifferFromRootPortTimes (bridgeTree, portTree, rootPortTree))
 				{
 					portTree->updtInfo = true;
 				}
@@ -1384,8 +1709,8 @@ void updtRolesTree (STP_BRIDGE* bridge, int givenTree)
 			// and a BPDU with the old priority is still propagating through the network.
 			else if ((portTree->infoIs == INFO_IS_RECEIVED)
 				&& (rootPortTree != portTree)
-				&& (portTree->designatedPriority.IsNotBetterThan (portTree->portPriority))
-				&& (portTree->portPriority.DesignatedBridgeId.GetAddress () != bridgeTree->GetBridgeIdentifier ().GetAddress ()))
+				&& (portTree->ComparePriorities (DESIGNATED_INFO, PORT_INFO) >= 0)
+				&& (portTree->priorities [PORT_INFO].DesignatedBridgeId.GetAddress () != bridgeTree->GetBridgeIdentifier ().GetAddress ()))
 			{
 				portTree->selectedRole = STP_PORT_ROLE_ALTERNATE;
 				portTree->updtInfo = false;
@@ -1398,8 +1723,8 @@ void updtRolesTree (STP_BRIDGE* bridge, int givenTree)
 			//    BackupPort, and updtInfo is reset;
 			else if ((portTree->infoIs == INFO_IS_RECEIVED)
 				&& (rootPortTree != portTree)
-				&& (portTree->designatedPriority.IsNotBetterThan (portTree->portPriority))
-				&& (portTree->portPriority.DesignatedBridgeId.GetAddress () == bridgeTree->GetBridgeIdentifier ().GetAddress ()))
+				&& (portTree->ComparePriorities (DESIGNATED_INFO, PORT_INFO) >= 0)
+				&& (portTree->priorities [PORT_INFO].DesignatedBridgeId.GetAddress () == bridgeTree->GetBridgeIdentifier ().GetAddress ()))
 			{
 				portTree->selectedRole = STP_PORT_ROLE_BACKUP;
 				portTree->updtInfo = false;
@@ -1410,7 +1735,7 @@ void updtRolesTree (STP_BRIDGE* bridge, int givenTree)
 			//    vector is better than the port priority vector, selectedRole is set to DesignatedPort, and updtInfo is
 			//    set.
 			else if ((portTree->infoIs == INFO_IS_RECEIVED) && (rootPortTree != portTree)
-				&& (portTree->designatedPriority.IsBetterThan (portTree->portPriority)))
+				&& (portTree->ComparePriorities (DESIGNATED_INFO, PORT_INFO) < 0))
 			{
 				portTree->selectedRole = STP_PORT_ROLE_DESIGNATED;
 				portTree->updtInfo = true;
@@ -1449,60 +1774,30 @@ void updtRolesDisabledTree (STP_BRIDGE* bridge, int givenTree)
 //    3) Master Port and synced is TRUE for all ports for the given tree other than the given port.
 bool allSynced (STP_BRIDGE* bridge, int givenPort, int givenTree)
 {
-	// a) For all ports for the given tree, selected is TRUE, the port's role is the same as its selectedRole, and updtInfo is FALSE; and
-	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
-	{
-		const PORT_TREE* portTree = bridge->ports [portIndex]->trees [givenTree];
+	// Note AG: We don't loop through the ports here; we look at counts kept by STP_BRIDGE::updateSharedStateCounts.
+	const BRIDGE_TREE* tree = bridge->trees [givenTree];
+	const PORT_TREE* givenPortTree = bridge->ports [givenPort]->trees [givenTree];
 
-		if (portTree->selected == false)
-			return false;
-
-		if (portTree->role != portTree->selectedRole)
-			return false;
-
-		if (portTree->updtInfo)
-			return false;
-	}
+	// a) For all ports for the given tree, selected is TRUE, the port's role is the same as its selectedRole, and updtInfo is FALSE; and
+	if (tree->unsettledPortCount != 0)
+		return false;
 
 	// b) The role of the given Port is
-	STP_PORT_ROLE role = bridge->ports [givenPort]->trees [givenTree]->role;
+	STP_PORT_ROLE role = givenPortTree->role;
 	if ((role == STP_PORT_ROLE_ROOT) || (role == STP_PORT_ROLE_ALTERNATE) || (role == STP_PORT_ROLE_BACKUP))
 	{
 		// The standard doesn tell about the BackupPort role, but it makes sense to treat it as
 		// we treat the AlternatePort role.
 
 		// 1) Root Port or Alternate Port and synced is TRUE for all ports for the given tree other than the Root Port; or
-		for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
-		{
-			const PORT_TREE* portTree = bridge->ports [portIndex]->trees [givenTree];
-
-			if (portTree->role == STP_PORT_ROLE_ROOT)
-				continue;
-
-			if (portTree->synced == false)
-				return false;
-		}
-
-		return true;
+		return tree->unsyncedNonRootPortCount == 0;
 	}
 	else if ((role == STP_PORT_ROLE_DESIGNATED) || (role == STP_PORT_ROLE_MASTER))
 	{
 		// 2) Designated Port and synced is TRUE for all ports for the given tree other than the given port; or
 		// 3) Master Port     and synced is TRUE for all ports for the given tree other than the given port.
-		for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
-		{
-			if (portIndex == (unsigned int) givenPort)
-				continue;
-
-			const PORT_TREE* portTree = bridge->ports [portIndex]->trees [givenTree];
-
-//LOG (bridge, givenPort, givenTree, "552: Port {D} synced={D}\r\n", portIndex, portTree->synced);
-
-			if (portTree->synced == false)
-				return false;
-		}
-
-		return true;
+		unsigned int unsyncedOtherPortCount = tree->unsyncedPortCount - (givenPortTree->synced ? 0 : 1);
+		return unsyncedOtherPortCount == 0;
 	}
 	else
 	{
@@ -1518,18 +1813,14 @@ bool allSynced (STP_BRIDGE* bridge, int givenPort, int givenTree)
 // b) updtInfo is FALSE.
 bool allTransmitReady (STP_BRIDGE* bridge, int givenPort)
 {
-	for (unsigned int treeIndex = 0; treeIndex < bridge->treeCount(); treeIndex++)
-	{
-		PORT_TREE* portTree = bridge->ports [givenPort]->trees [treeIndex];
-
-		if (portTree->selected == false)
-			return false;
+	const PORT* port = bridge->ports [givenPort];
+	const PORT_TREE* cistPortTree = port->trees [CIST_INDEX];
 
-		if (portTree->updtInfo)
-			return false;
-	}
+	if ((cistPortTree->selected == false) || cistPortTree->updtInfo)
+		return false;
 
-	return true;
+	// The MSTIs are counted in notTransmitReadyMstiCount (see STP_BRIDGE::updateSharedStateCounts).
+	return (bridge->treeCount() == 1) || (port->notTransmitReadyMstiCount == 0);
 }
 
 // ============================================================================
@@ -1564,7 +1855,7 @@ bool cistDesignatedPort	(STP_BRIDGE* bridge, int givenPort)
 unsigned short EdgeDelay (STP_BRIDGE* bridge, int givenPort)
 {
 	PORT* port = bridge->ports [givenPort];
-	return port->operPointToPointMAC ? bridge->MigrateTime : MaxAge (bridge, givenPort);
+	return port->operPointToPointMAC ? bridge->timerValue (STP_BRIDGE::MigrateTime) : MaxAge (bridge, givenPort);
 }
 
 // ============================================================================
@@ -1581,9 +1872,10 @@ unsigned short forwardDelay (STP_BRIDGE* bridge, int givenPort)
 // ============================================================================
 // 13.26.h) - 13.26.8
 // The Forward Delay component of the CIST's designatedTimes parameter (13.25.8).
+// Note AG: This and the other functions in 13.26 that return times return them in the units of the timers.
 unsigned short FwdDelay (STP_BRIDGE* bridge, int givenPort)
 {
-	return bridge->ports [givenPort]->trees [CIST_INDEX]->designatedTimes.ForwardDelay;
+	return bridge->timerValue (bridge->ports [givenPort]->GetCistTree ()->cistTimes [DESIGNATED_INFO].ForwardDelay);
 }
 
 // ============================================================================
@@ -1592,7 +1884,7 @@ unsigned short FwdDelay (STP_BRIDGE* bridge, int givenPort)
 // value given in Table 13-5.
 unsigned short HelloTime (STP_BRIDGE* bridge, int givenPort)
 {
-	return bridge->ports [givenPort]->trees [CIST_INDEX]->portTimes.HelloTime;
+	return bridge->timerValue (bridge->ports [givenPort]->GetCistTree ()->cistTimes [PORT_INFO].HelloTime);
 }
 
 // ============================================================================
@@ -1600,7 +1892,7 @@ unsigned short HelloTime (STP_BRIDGE* bridge, int givenPort)
 // The Max Age component of the CIST's designatedTimes parameter (13.25.8).
 unsigned short MaxAge (STP_BRIDGE* bridge, int givenPort)
 {
-	return bridge->ports [givenPort]->trees [CIST_INDEX]->designatedTimes.MaxAge;
+	return bridge->timerValue (bridge->ports [givenPort]->GetCistTree ()->cistTimes [DESIGNATED_INFO].MaxAge);
 }
 
 // ============================================================================
@@ -1610,14 +1902,14 @@ unsigned short MaxAge (STP_BRIDGE* bridge, int givenPort)
 // b) RootPort, and the instance for the given MSTI and port of the tcWhile timer is not zero.
 bool mstiDesignatedOrTCpropagatingRootPort (STP_BRIDGE* bridge, int givenPort)
 {
-	for (unsigned int mstiIndex = 0; mstiIndex < bridge->mstiCount; mstiIndex++)
+	for (unsigned int treeIndex = 1; treeIndex < bridge->allocatedTreeCount(); treeIndex++)
 	{
-		PORT_TREE* mstiInstance = bridge->ports [givenPort]->trees [1 + mstiIndex];
+		PORT_TREE* mstiInstance = bridge->ports [givenPort]->trees [treeIndex];
 
 		if (mstiInstance->role == STP_PORT_ROLE_DESIGNATED)
 			return true;
 
-		if ((mstiInstance->role == STP_PORT_ROLE_ROOT) && (mstiInstance->tcWhile != 0))
+		if ((mstiInstance->role == STP_PORT_ROLE_ROOT) && (mstiInstance->timers->tcWhile != 0))
 			return true;
 	}
 
@@ -1629,9 +1921,9 @@ bool mstiDesignatedOrTCpropagatingRootPort (STP_BRIDGE* bridge, int givenPort)
 // TRUE if the role for any MSTI for the given port is MasterPort.
 bool mstiMasterPort (STP_BRIDGE* bridge, int givenPort)
 {
-	for (unsigned int mstiIndex = 0; mstiIndex < bridge->mstiCount; mstiIndex++)
+	for (unsigned int treeIndex = 1; treeIndex < bridge->allocatedTreeCount(); treeIndex++)
 	{
-		if (bridge->ports [givenPort]->trees [1 + mstiIndex]->role == STP_PORT_ROLE_MASTER)
+		if (bridge->ports [givenPort]->trees [treeIndex]->role == STP_PORT_ROLE_MASTER)
 			return true;
 	}
 
@@ -1686,7 +1978,7 @@ bool reRooted (STP_BRIDGE* bridge, int givenPort, int givenTree)
 		if (portIndex == (unsigned int) givenPort)
 			continue;
 
-		if (bridge->ports [portIndex]->trees [givenTree]->rrWhile != 0)
+		if (bridge->ports [portIndex]->trees [givenTree]->timers->rrWhile != 0)
 			return false;
 	}
 
@@ -7,11 +7,147 @@
 #include "stp_log.h"
 #include "stp_md5.h"
 #include <string.h>
+#include <stddef.h>
 
 static void RunStateMachines (STP_BRIDGE* bridge, unsigned int timestamp);
-static unsigned int GetInstanceCountForAllStateMachines (STP_BRIDGE* bridge);
+static void RunStateMachinePasses (STP_BRIDGE* bridge, bool runPortTransmit, unsigned int timestamp);
+static void SetBEGIN (STP_BRIDGE* bridge, bool begin);
+static unsigned int GetInstanceCountForAllStateMachines (const SM_INTERFACE* smInterface, unsigned int portCount, unsigned int treeCount);
 static void RecomputePrioritiesAndPortRoles (STP_BRIDGE* bridge, unsigned int treeIndex, unsigned int timestamp);
-static void ComputeMstConfigDigest (STP_BRIDGE* bridge);
+static void ComputeMstConfigDigest (STP_BRIDGE* bridge, unsigned int firstChangedVlan);
+static void SetAllVlansInBitmap (const STP_BRIDGE* bridge, unsigned char* bitmap);
+static void PublishSnapshot (STP_BRIDGE* bridge);
+
+// ============================================================================
+
+// All the memory of a bridge, except for the debug log buffer, is allocated as a single block. This keeps the state
+// the state machines work on close together, and avoids fragmenting the small heaps found in embedded applications.
+// This function lays out that block: it returns in footprintOut the size of the block and of its parts, and if memory
+// is not NULL, it also points the bridge's pointer variables to their places in the block and returns the STP_BRIDGE at its start.
+static STP_BRIDGE* LayOutBridgeMemory (unsigned char* memory, unsigned int portCount, unsigned int mstiCount, unsigned int maxVlanNumber, STP_MEMORY_FOOTPRINT* footprintOut)
+{
+	struct LAYOUT
+	{
+		unsigned char* memory;
+		unsigned int offset;
+
+		// Adds the size, and the padding before it, to the given part of footprintOut.
+		void* Carve (unsigned int size, unsigned int* part)
+		{
+			// 8 satisfies the alignment of everything we place in the block, on all platforms we know of.
+			unsigned int start = (offset + 7) & ~7u;
+			*part += start + size - offset;
+			offset = start + size;
+			return (memory != NULL) ? (memory + start) : NULL;
+		}
+	};
+
+	unsigned int treeCount = 1 + mstiCount;
+	unsigned int txTemplateSize = sizeof (MSTP_BPDU) + mstiCount * sizeof (MSTI_CONFIG_MESSAGE);
+	unsigned int stateMachineInstanceCount = GetInstanceCountForAllStateMachines (&smInterface_802_1Q_2011, portCount, treeCount);
+
+	// The trees of a port: its PORT_CIST_TREE followed by the smaller PORT_TREE of each MSTI.
+	unsigned int portTreesSize = sizeof (PORT_CIST_TREE) + mstiCount * sizeof (PORT_TREE);
+
+	unsigned int treeTimerCount = portCount * treeCount * (sizeof (PORT_TREE_TIMERS) / sizeof (unsigned short));
+	unsigned int treeTimerChunkCount = (treeTimerCount + STP_BRIDGE::TreeTimerChunk - 1) / STP_BRIDGE::TreeTimerChunk;
+
+	memset (footprintOut, 0, sizeof (*footprintOut));
+	STP_MEMORY_FOOTPRINT* f = footprintOut;
+
+	LAYOUT layout = { memory, 0 };
+
+	STP_BRIDGE*       bridge           = (STP_BRIDGE*)        layout.Carve (sizeof (STP_BRIDGE), &f->bridge);
+	BRIDGE_TREE**     trees            = (BRIDGE_TREE**)      layout.Carve (treeCount * sizeof (BRIDGE_TREE*), &f->bridge);
+	BRIDGE_TREE*      bridgeTrees      = (BRIDGE_TREE*)       layout.Carve (treeCount * sizeof (BRIDGE_TREE), &f->bridge);
+	PORT**            ports            = (PORT**)             layout.Carve (portCount * sizeof (PORT*), &f->ports);
+	PORT*             portArray        = (PORT*)              layout.Carve (portCount * sizeof (PORT), &f->ports);
+	PORT_TREE**       portTreePointers = (PORT_TREE**)        layout.Carve (portCount * treeCount * sizeof (PORT_TREE*), &f->portTrees);
+	unsigned char*    portTrees        = (unsigned char*)     layout.Carve (portCount * portTreesSize, &f->portTrees);
+	unsigned short*   rootCandidates   = (unsigned short*)    layout.Carve (treeCount * portCount * 2 * sizeof (unsigned short), &f->portTrees);
+	PORT_TREE_TIMERS* treeTimers       = (PORT_TREE_TIMERS*)  layout.Carve (treeTimerChunkCount * STP_BRIDGE::TreeTimerChunk * sizeof (unsigned short), &f->portTreeTimers);
+	SM_STATE*         states           = (SM_STATE*)          layout.Carve (stateMachineInstanceCount * sizeof (SM_STATE), &f->stateMachines);
+	unsigned char*    dirtyPorts       = (unsigned char*)     layout.Carve (portCount, &f->stateMachines);
+	unsigned char*    dirtyTrees       = (unsigned char*)     layout.Carve (treeCount, &f->stateMachines);
+	unsigned short*   dirtyPortList    = (unsigned short*)    layout.Carve (portCount * sizeof (unsigned short), &f->stateMachines);
+	unsigned short*   transmitPortList = (unsigned short*)    layout.Carve (portCount * sizeof (unsigned short), &f->stateMachines);
+	INV_UINT2*        mstConfigTable   = (INV_UINT2*)         layout.Carve ((1 + maxVlanNumber) * 2, &f->mstConfigTable);
+	unsigned int    (*digestStates)[4] = (unsigned int(*)[4]) layout.Carve ((1 + (1 + maxVlanNumber) * 2 / 64) * 16, &f->mstConfigTable);
+	unsigned char*    txTemplates      = (unsigned char*)     layout.Carve (portCount * txTemplateSize, &f->txTemplates);
+	unsigned char*    vlanBitmaps      = (unsigned char*)     layout.Carve ((treeCount + 1) * ((maxVlanNumber + 8) / 8), &f->vlanBitmaps);
+	unsigned char*    portVlanBitmaps  = (unsigned char*)     layout.Carve (portCount * 2 * ((maxVlanNumber + 8) / 8), &f->vlanBitmaps);
+
+	f->block = layout.offset;
+	f->total = layout.offset;
+
+	if (memory == NULL)
+		return NULL;
+
+	bridge->trees = trees;
+	for (unsigned int treeIndex = 0; treeIndex < treeCount; treeIndex++)
+	{
+		trees [treeIndex] = &bridgeTrees [treeIndex];
+		trees [treeIndex]->rootCandidates      = &rootCandidates [treeIndex * portCount * 2];
+		trees [treeIndex]->dirtyRootCandidates = &rootCandidates [treeIndex * portCount * 2 + portCount];
+	}
+
+	bridge->treeTimers = treeTimers;
+	bridge->treeTimerChunkCount = treeTimerChunkCount;
+
+	// Trees of the same port are next to each other, as most state machines work on one port at a time.
+	bridge->ports = ports;
+	for (unsigned int portIndex = 0; portIndex < portCount; portIndex++)
+	{
+		ports [portIndex] = &portArray [portIndex];
+		ports [portIndex]->trees = &portTreePointers [portIndex * treeCount];
+		ports [portIndex]->treeTimers = &treeTimers [portIndex * treeCount];
+		ports [portIndex]->txTemplate = (MSTP_BPDU*) &txTemplates [portIndex * txTemplateSize];
+		ports [portIndex]->forwardingVlans = &portVlanBitmaps [portIndex * 2 * ((maxVlanNumber + 8) / 8)];
+		ports [portIndex]->learningVlans = &portVlanBitmaps [(portIndex * 2 + 1) * ((maxVlanNumber + 8) / 8)];
+
+		unsigned char* portTreesOfPort = &portTrees [portIndex * portTreesSize];
+		ports [portIndex]->trees [CIST_INDEX] = (PORT_CIST_TREE*) portTreesOfPort;
+		ports [portIndex]->trees [CIST_INDEX]->isCist = true;
+		for (unsigned int treeIndex = 1; treeIndex < treeCount; treeIndex++)
+			ports [portIndex]->trees [treeIndex] = (PORT_TREE*) &portTreesOfPort [sizeof (PORT_CIST_TREE) + (treeIndex - 1) * sizeof (PORT_TREE)];
+
+		for (unsigned int treeIndex = 0; treeIndex < treeCount; treeIndex++)
+			ports [portIndex]->trees [treeIndex]->timers = &treeTimers [portIndex * treeCount + treeIndex];
+	}
+
+	bridge->states = states;
+	bridge->dirtyPorts = dirtyPorts;
+	bridge->dirtyTrees = dirtyTrees;
+	bridge->dirtyPortList = dirtyPortList;
+	bridge->transmitPortList = transmitPortList;
+	bridge->mstConfigTable = mstConfigTable;
+	bridge->mstConfigDigestStates = digestStates;
+	bridge->vlanBitmaps = vlanBitmaps;
+	bridge->vlanBitmapSize = (maxVlanNumber + 8) / 8;
+
+	return bridge;
+}
+
+unsigned int STP_GetRequiredMemorySize (unsigned int portCount, unsigned int mstiCount, unsigned int maxVlanNumber)
+{
+	STP_MEMORY_FOOTPRINT footprint;
+	LayOutBridgeMemory (NULL, portCount, mstiCount, maxVlanNumber, &footprint);
+	return footprint.block;
+}
+
+void STP_GetMemoryFootprint (const STP_BRIDGE* bridge, STP_MEMORY_FOOTPRINT* footprintOut)
+{
+	LayOutBridgeMemory (NULL, bridge->portCount, bridge->mstiCount, bridge->maxVlanNumber, footprintOut);
+
+#if STP_USE_LOG
+	footprintOut->logBuffer = bridge->logBufferMaxSize;
+#endif
+
+	if (bridge->callbacks.transmitBatch != NULL)
+		footprintOut->transmitBatch = bridge->portCount * (bridge->transmitBatchSlotSize + sizeof (STP_TRANSMITTED_BPDU));
+
+	footprintOut->total = footprintOut->block + footprintOut->logBuffer + footprintOut->transmitBatch;
+}
 
 // ============================================================================
 
@@ -36,23 +172,35 @@ STP_BRIDGE* STP_CreateBridge (unsigned int portCount,
 	assert (sizeof (BRIDGE_ID) == 8);
 	assert (sizeof (PORT_ID) == 2);
 	assert (sizeof (PRIORITY_VECTOR) == 34);
+	assert (sizeof (CIST_PRIORITY_PREFIX) == 12);
+	assert (sizeof (MSTI_PRIORITY_VECTOR) == 22);
 	assert (sizeof (MSTP_BPDU) == 102);
+	assert (sizeof (PORT_TREE_TIMERS) == 12);
 
+#if STP_USE_LOG
 	assert (debugLogBufferSize >= 2); // one byte for the data, one for the null terminator of the string passed to the callback
+#endif
 
 	// Upper limit for number of MSTIs is defined in 802.1Q-2011, page 342, top paragraph:
 	//		"No more than 64 MSTI Configuration Messages shall be encoded in an MST
 	//		BPDU, and no more than 64 MSTIs shall be supported by an MST Bridge."
 	assert (mstiCount <= 64);
 
+	// See comment at STP_MAX_MSTI_COUNT in stp_bridge.h.
+	assert (mstiCount <= STP_MAX_MSTI_COUNT);
+
 	// As specified in 12.3.i) in 802.1Q-2011, valid port numbers are 1..4095, so our valid port indexes will be 0..4094.
 	// This means a maximum of 4095 ports.
 	assert ((portCount >= 1) && (portCount < 4096));
 
 	assert (maxVlanNumber <= 4094);
 
-	STP_BRIDGE* bridge = (STP_BRIDGE*) callbacks->allocAndZeroMemory (sizeof (STP_BRIDGE));
-	assert (bridge != NULL);
+	STP_MEMORY_FOOTPRINT footprint;
+	LayOutBridgeMemory (NULL, portCount, mstiCount, maxVlanNumber, &footprint);
+	unsigned char* memory = (unsigned char*) callbacks->allocAndZeroMemory (footprint.block);
+	assert (memory != NULL);
+
+	STP_BRIDGE* bridge = LayOutBridgeMemory (memory, portCount, mstiCount, maxVlanNumber, &footprint);
 
 	// See "13.6.2 Force Protocol Version" on page 332
 	bridge->ForceProtocolVersion = STP_VERSION_RSTP;
@@ -63,44 +211,36 @@ STP_BRIDGE* STP_CreateBridge (unsigned int portCount,
 	bridge->mstiCount = mstiCount;
 	bridge->maxVlanNumber = maxVlanNumber;
 
+#if STP_USE_LOG
 	bridge->logBuffer = (char*) callbacks->allocAndZeroMemory (debugLogBufferSize);
 	assert (bridge->logBuffer != NULL);
 	bridge->logBufferMaxSize = debugLogBufferSize;
 	bridge->logBufferUsedSize = 0;
 	bridge->logCurrentPort = -1;
 	bridge->logCurrentTree = -1;
+#endif
 
-	// ------------------------------------------------------------------------
-	// alloc space for state array
-
-	unsigned int stateMachineInstanceCount = GetInstanceCountForAllStateMachines(bridge);
-	bridge->states = (SM_STATE*) callbacks->allocAndZeroMemory (stateMachineInstanceCount * sizeof(SM_STATE));
-	assert (bridge->states != NULL);
-
-	// ------------------------------------------------------------------------
-
-	bridge->trees = (BRIDGE_TREE**) callbacks->allocAndZeroMemory ((1 + bridge->mstiCount) * sizeof (BRIDGE_TREE*));
-	assert (bridge->trees != NULL);
-
-	bridge->ports = (PORT**) callbacks->allocAndZeroMemory (portCount * sizeof (PORT*));
-	assert (bridge->ports != NULL);
+	if (callbacks->transmitBatch != NULL)
+	{
+		bridge->transmitBatchSlotSize = sizeof (MSTP_BPDU) + mstiCount * sizeof (MSTI_CONFIG_MESSAGE);
+		bridge->transmitBatchBuffer = (unsigned char*) callbacks->allocAndZeroMemory (portCount * bridge->transmitBatchSlotSize);
+		bridge->transmitBatchEntries = (STP_TRANSMITTED_BPDU*) callbacks->allocAndZeroMemory (portCount * sizeof (STP_TRANSMITTED_BPDU));
+		assert ((bridge->transmitBatchBuffer != NULL) && (bridge->transmitBatchEntries != NULL));
+	}
 
 	// per-bridge CIST vars
-	bridge->trees [CIST_INDEX] = (BRIDGE_TREE*) callbacks->allocAndZeroMemory (sizeof (BRIDGE_TREE));
-	assert (bridge->trees [CIST_INDEX] != NULL);
 	bridge->trees [CIST_INDEX]->SetBridgeIdentifier (0x8000, CIST_INDEX, bridgeAddress);
 	// 13.24.3 in 802.1Q-2011
-	bridge->trees [CIST_INDEX]->BridgeTimes.HelloTime		= STP_BRIDGE::BridgeHelloTime;
+	bridge->BridgeHelloTime = STP_BRIDGE::DefaultBridgeHelloTime;
+	bridge->trees [CIST_INDEX]->BridgeTimes.HelloTime		= bridge->BridgeHelloTime;
 	bridge->trees [CIST_INDEX]->BridgeTimes.remainingHops	= bridge->MaxHops;
 	bridge->trees [CIST_INDEX]->BridgeTimes.ForwardDelay	= bridge->BridgeForwardDelay;
 	bridge->trees [CIST_INDEX]->BridgeTimes.MaxAge			= bridge->BridgeMaxAge;
 	bridge->trees [CIST_INDEX]->BridgeTimes.MessageAge		= 0;
 
 	// per-bridge MSTI vars
-	for (unsigned int treeIndex = 1; treeIndex < (1 + bridge->mstiCount); treeIndex++)
+	for (unsigned int treeIndex = 1; treeIndex < bridge->allocatedTreeCount(); treeIndex++)
 	{
-		bridge->trees [treeIndex] = (BRIDGE_TREE*) callbacks->allocAndZeroMemory (sizeof (BRIDGE_TREE));
-		assert (bridge->trees [treeIndex] != NULL);
 		bridge->trees [treeIndex]->SetBridgeIdentifier (0x8000, treeIndex, bridgeAddress);
 		bridge->trees [treeIndex]->BridgeTimes.remainingHops = bridge->MaxHops;
 	}
@@ -108,31 +248,30 @@ STP_BRIDGE* STP_CreateBridge (unsigned int portCount,
 	// per-port vars
 	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
 	{
-		bridge->ports [portIndex] = (PORT*) callbacks->allocAndZeroMemory (sizeof (PORT));
-		assert (bridge->ports [portIndex] != NULL);
-
 		PORT* port = bridge->ports [portIndex];
 
-		port->trees = (PORT_TREE**) callbacks->allocAndZeroMemory ((1 + bridge->mstiCount) * sizeof (PORT_TREE*));
-		assert (port->trees != NULL);
-
 		// per-port CIST and MSTI vars
-		for (unsigned int treeIndex = 0; treeIndex < (1 + bridge->mstiCount); treeIndex++)
+		for (unsigned int treeIndex = 0; treeIndex < bridge->allocatedTreeCount(); treeIndex++)
 		{
-			port->trees [treeIndex] = (PORT_TREE*) callbacks->allocAndZeroMemory (sizeof (PORT_TREE));
-			assert (port->trees [treeIndex] != NULL);
 			port->trees [treeIndex]->portId.Set (0x80, (unsigned short) portIndex + 1);
-			port->trees [treeIndex]->portTimes.HelloTime = STP_BRIDGE::BridgeHelloTime;
 			port->trees [treeIndex]->InternalPortPathCost = 200000;
 		}
 
+		port->GetCistTree ()->cistTimes [PORT_INFO].HelloTime = bridge->BridgeHelloTime;
 		port->AutoEdge = 1;
 		port->enableBPDUrx = true;
 		port->enableBPDUtx = true;
 		port->ExternalPortPathCost = 200000;
+		port->receivedBpduContent = NULL; // see comment at declaration of receivedBpduContent
 	}
 
-	bridge->receivedBpduContent = NULL; // see comment at declaration of receivedBpduContent
+	for (unsigned int treeIndex = 0; treeIndex < bridge->allocatedTreeCount(); treeIndex++)
+	{
+		bridge->markAllRootCandidatesDirty (treeIndex);
+
+		for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
+			bridge->updateSharedStateCounts (portIndex, treeIndex);
+	}
 
 	// These were already zeroed by the allocation routine.
 	//bridge->MstConfigId.ConfigurationIdentifierFormatSelector = 0;
@@ -141,11 +280,10 @@ STP_BRIDGE* STP_CreateBridge (unsigned int portCount,
 	// Let's set a default name for the MST Config.
 	STP_GetDefaultMstConfigName (bridgeAddress, bridge->MstConfigId.ConfigurationName);
 
-	bridge->mstConfigTable = (INV_UINT2*) callbacks->allocAndZeroMemory ((1 + maxVlanNumber) * 2);
-	assert (bridge->mstConfigTable != NULL);
-
 	// The config table is all zeroes now, so all VIDs map to the CIST, no VID mapped to any MSTI.
-	ComputeMstConfigDigest (bridge);
+	ComputeMstConfigDigest (bridge, 0);
+	SetAllVlansInBitmap (bridge, &bridge->vlanBitmaps [CIST_INDEX * bridge->vlanBitmapSize]);
+	SetAllVlansInBitmap (bridge, &bridge->vlanBitmaps [(1 + mstiCount) * bridge->vlanBitmapSize]);
 
 	return bridge;
 }
@@ -154,26 +292,17 @@ STP_BRIDGE* STP_CreateBridge (unsigned int portCount,
 
 void STP_DestroyBridge (STP_BRIDGE* bridge)
 {
-	bridge->callbacks.freeMemory (bridge->mstConfigTable);
+#if STP_USE_LOG
+	bridge->callbacks.freeMemory (bridge->logBuffer);
+#endif
 
-	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
+	if (bridge->callbacks.transmitBatch != NULL)
 	{
-		for (unsigned int treeIndex = 0; treeIndex < (1 + bridge->mstiCount); treeIndex++)
-			bridge->callbacks.freeMemory (bridge->ports [portIndex]->trees [treeIndex]);
-
-		bridge->callbacks.freeMemory (bridge->ports [portIndex]->trees);
-
-		bridge->callbacks.freeMemory (bridge->ports [portIndex]);
+		bridge->callbacks.freeMemory (bridge->transmitBatchBuffer);
+		bridge->callbacks.freeMemory (bridge->transmitBatchEntries);
 	}
 
-	for (unsigned int treeIndex = 0; treeIndex < (1 + bridge->mstiCount); treeIndex++)
-		bridge->callbacks.freeMemory (bridge->trees [treeIndex]);
-
-	bridge->callbacks.freeMemory (bridge->ports);
-	bridge->callbacks.freeMemory (bridge->trees);
-	bridge->callbacks.freeMemory (bridge->states);
-	bridge->callbacks.freeMemory (bridge->logBuffer);
-
+	// The bridge is at the start of the single memory block allocated in STP_CreateBridge.
 	bridge->callbacks.freeMemory (bridge);
 }
 
@@ -182,14 +311,19 @@ void STP_DestroyBridge (STP_BRIDGE* bridge)
 void STP_StartBridge (STP_BRIDGE* bridge, unsigned int timestamp)
 {
 	LOG (bridge, -1, -1, "{T}: Starting the bridge...\r\n", timestamp);
+	TRACE (bridge, STP_TRACE_EVENT_BRIDGE_STARTED, -1, -1, timestamp, 0, 0, 0);
 
 	assert (bridge->started == false);
 
 	bridge->started = true;
 
-	bridge->BEGIN = true;
+	bridge->timerRemainder = 0;
+	bridge->secondRemainder = 0;
+	bridge->txHoldRemainder = 0;
+
+	SetBEGIN (bridge, true);
 	RunStateMachines (bridge, timestamp);
-	bridge->BEGIN = false;
+	SetBEGIN (bridge, false);
 	RunStateMachines (bridge, timestamp);
 
 	bridge->callbacks.onConfigChanged (bridge, timestamp);
@@ -205,9 +339,12 @@ void STP_StopBridge (STP_BRIDGE* bridge, unsigned int timestamp)
 {
 	bridge->started = false;
 
+	PublishSnapshot (bridge);
+
 	bridge->callbacks.onConfigChanged (bridge, timestamp);
 
 	LOG (bridge, -1, -1, "{T}: Bridge stopped.\r\n", timestamp);
+	TRACE (bridge, STP_TRACE_EVENT_BRIDGE_STOPPED, -1, -1, timestamp, 0, 0, 0);
 	LOG (bridge, -1, -1, "------------------------------------\r\n");
 	FLUSH_LOG (bridge);
 }
@@ -219,7 +356,12 @@ void STP_SetBridgeAddress (STP_BRIDGE* bridge, const unsigned char* address, uns
 	LOG (bridge, -1, -1, "{T}: Setting bridge MAC address to {BA}...", timestamp, address);
 
 	const unsigned char* currentAddress = bridge->trees[CIST_INDEX]->GetBridgeIdentifier().GetAddress().bytes;
-	if (memcmp (currentAddress, address, 6) == 0)
+	bool changed = (memcmp (currentAddress, address, 6) != 0);
+
+	TRACE (bridge, STP_TRACE_EVENT_BRIDGE_ADDRESS_SET, (address[0] << 8) | address[1], address[2], timestamp, address[3], address[4], address[5],
+		   changed ? 0 : STP_TRACE_FLAG_NOTHING_CHANGED);
+
+	if (!changed)
 	{
 		LOG (bridge, -1, -1, " nothing changed.\r\n");
 	}
@@ -227,14 +369,17 @@ void STP_SetBridgeAddress (STP_BRIDGE* bridge, const unsigned char* address, uns
 	{
 		LOG (bridge, -1, -1, "\r\n");
 
-		for (unsigned int treeIndex = 0; treeIndex < (1 + bridge->mstiCount); treeIndex++)
+		for (unsigned int treeIndex = 0; treeIndex < bridge->allocatedTreeCount(); treeIndex++)
 		{
 			// change the MAC address without changing the priority
 			BRIDGE_ID bid = bridge->trees [treeIndex]->GetBridgeIdentifier ();
 			bid.SetAddress (address);
 			bridge->trees [treeIndex]->SetBridgeIdentifier (bid);
+			bridge->markAllRootCandidatesDirty (treeIndex);
 		}
 
+		bridge->invalidateTxTemplates ();
+
 		if (bridge->started)
 		{
 			if (bridge->ForceProtocolVersion < STP_VERSION_MSTP)
@@ -246,9 +391,9 @@ void STP_SetBridgeAddress (STP_BRIDGE* bridge, const unsigned char* address, uns
 			{
 				// BEGIN used to be asserted when the MST Config Name was generated from the bridge address.
 				// Now that we don't generate a default name anymore, I don't know if it's still needed, but I'll leave it for now.
-				bridge->BEGIN = true;
+				SetBEGIN (bridge, true);
 				RunStateMachines (bridge, timestamp);
-				bridge->BEGIN = false;
+				SetBEGIN (bridge, false);
 				RunStateMachines (bridge, timestamp);
 			}
 		}
@@ -293,6 +438,7 @@ static unsigned int GetDefaultPortPathCost (unsigned int speedMegabitsPerSecond)
 void STP_OnPortEnabled (STP_BRIDGE* bridge, unsigned int portIndex, unsigned int speedMegabitsPerSecond, unsigned int detectedPointToPointMAC, unsigned int timestamp)
 {
 	LOG (bridge, -1, -1, "{T}: Port {D} good\r\n", timestamp, 1 + portIndex);
+	TRACE (bridge, STP_TRACE_EVENT_PORT_ENABLED, portIndex, -1, timestamp, 0, 0, 0);
 
 	PORT* port = bridge->ports [portIndex];
 
@@ -308,6 +454,8 @@ void STP_OnPortEnabled (STP_BRIDGE* bridge, unsigned int portIndex, unsigned int
 	else
 		port->ExternalPortPathCost = GetDefaultPortPathCost(speedMegabitsPerSecond);
 
+	bridge->markRootCandidateDirty (portIndex, CIST_INDEX);
+
 	// If STP_OnPortEnabled is called for the first time after software startup,
 	// and if STP_SetPortAdminP2P was not yet called or called with AUTO,
 	// then operPointToPointMAC was never computed.
@@ -315,6 +463,8 @@ void STP_OnPortEnabled (STP_BRIDGE* bridge, unsigned int portIndex, unsigned int
 	if (port->adminPointToPointMAC == STP_ADMIN_P2P_AUTO)
 		port->operPointToPointMAC = detectedPointToPointMAC;
 
+	bridge->markPortDirty (portIndex);
+
 	if (bridge->started)
 		RunStateMachines (bridge, timestamp);
 
@@ -324,141 +474,848 @@ void STP_OnPortEnabled (STP_BRIDGE* bridge, unsigned int portIndex, unsigned int
 
 // ============================================================================
 
-void STP_OnPortDisabled (STP_BRIDGE* bridge, unsigned int portIndex, unsigned int timestamp)
+void STP_OnPortDisabled (STP_BRIDGE* bridge, unsigned int portIndex, unsigned int timestamp)
+{
+	LOG (bridge, -1, -1, "{T}: Port {D} down\r\n", timestamp, 1 + portIndex);
+	TRACE (bridge, STP_TRACE_EVENT_PORT_DISABLED, portIndex, -1, timestamp, 0, 0, 0);
+
+	// We allow disabling an already disabled port.
+	if (bridge->ports [portIndex]->portEnabled)
+	{
+		bridge->ports [portIndex]->portEnabled = false;
+
+		bridge->markPortDirty (portIndex);
+
+		if (bridge->started)
+			RunStateMachines (bridge, timestamp);
+	}
+
+	LOG (bridge, -1, -1, "------------------------------------\r\n");
+	FLUSH_LOG (bridge);
+}
+
+// ============================================================================
+
+// Decrements the timers of all ports and trees (see PORT_TREE_TIMERS) for a tick, on behalf of the TICK state
+// of the Port Timers state machine, which decrements the timers that are per port only. Doing it here, before
+// the state machines run, is the same as doing it in TICK: PortTimers is the first state machine, and all ports
+// enter TICK in the first pass. (Note that we don't have to mark the tree dirty when rrWhile reaches zero,
+// even though reRooted() reads it on the other ports: RunTimerTick marks all ports dirty anyway.)
+static void DecrementTreeTimers (STP_BRIDGE* bridge, unsigned short units)
+{
+	if (bridge->treeCount() == bridge->allocatedTreeCount())
+	{
+		// A single pass over the whole block. The inner loop has a constant trip count, so the compilers vectorize
+		// the pass at -O2 too, with saturating subtract instructions where the target has them (psubusw with SSE2).
+		unsigned short* timer = (unsigned short*) bridge->treeTimers;
+		unsigned int chunkCount = bridge->treeTimerChunkCount;
+		for (unsigned int chunk = 0; chunk < chunkCount; chunk++, timer += STP_BRIDGE::TreeTimerChunk)
+		{
+			for (unsigned int i = 0; i < STP_BRIDGE::TreeTimerChunk; i++)
+				timer [i] -= (timer [i] < units) ? timer [i] : units;
+		}
+	}
+	else
+	{
+		// A bridge created with MSTIs and not running MSTP: only the timers of the CIST run, the first of each port.
+		for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
+		{
+			unsigned short* timer = (unsigned short*) bridge->ports [portIndex]->treeTimers;
+			for (unsigned int i = 0; i < sizeof (PORT_TREE_TIMERS) / sizeof (unsigned short); i++)
+				timer [i] -= (timer [i] < units) ? timer [i] : units;
+		}
+	}
+}
+
+// Runs the state machines for a tick of the given length, in timer units (see STP_BRIDGE::timerValue).
+static void RunTimerTick (STP_BRIDGE* bridge, unsigned int timerUnits, unsigned int timestamp)
+{
+	if (bridge->millisecondTimers)
+	{
+		LOG (bridge, -1, -1, "{T}: {D}/256 seconds:\r\n", timestamp, timerUnits);
+		TRACE (bridge, STP_TRACE_EVENT_TIMER_TICK, -1, -1, timestamp, 0, 0, (unsigned char) ((timerUnits < 255) ? timerUnits : 255));
+	}
+	else if (timerUnits > 1)
+	{
+		LOG (bridge, -1, -1, "{T}: {D} seconds:\r\n", timestamp, timerUnits);
+		TRACE (bridge, STP_TRACE_EVENT_TIMER_TICK, -1, -1, timestamp, 0, 0, (unsigned char) ((timerUnits < 255) ? timerUnits : 255));
+	}
+	else
+	{
+		LOG (bridge, -1, -1, "{T}: One second:\r\n", timestamp);
+		TRACE (bridge, STP_TRACE_EVENT_ONE_SECOND_TICK, -1, -1, timestamp, 0, 0, 0);
+	}
+
+	unsigned int seconds = (bridge->secondRemainder + timerUnits) / bridge->timerUnitsPerSecond();
+	bridge->secondRemainder = (bridge->secondRemainder + timerUnits) % bridge->timerUnitsPerSecond();
+
+	// Not from the standard. See long comment in 802_1Q_2011_procedures.cpp, just above CallTcCallback().
+	bridge->tcIgnore -= (bridge->tcIgnore < seconds) ? bridge->tcIgnore : seconds;
+
+	unsigned int txHoldPeriods = (bridge->txHoldRemainder + timerUnits) / bridge->txHoldPeriod();
+	bridge->txHoldRemainder = (bridge->txHoldRemainder + timerUnits) % bridge->txHoldPeriod();
+
+	// No timer is greater than 0xFFFF, and txCount isn't greater than TxHoldCount.
+	bridge->tickTimerUnits    = (unsigned short) ((timerUnits < 0xFFFF) ? timerUnits : 0xFFFF);
+	bridge->tickTxHoldPeriods = (unsigned short) ((txHoldPeriods < 0xFFFF) ? txHoldPeriods : 0xFFFF);
+
+	DecrementTreeTimers (bridge, bridge->tickTimerUnits);
+
+	for (unsigned int givenPort = 0; givenPort < bridge->portCount; givenPort++)
+	{
+		bridge->ports [givenPort]->tick = true;
+		bridge->markPortDirty (givenPort);
+	}
+
+	RunStateMachines (bridge, timestamp);
+
+	LOG (bridge, -1, -1, "------------------------------------\r\n");
+	FLUSH_LOG (bridge);
+}
+
+// ============================================================================
+
+static void UpdateDeadline (unsigned int* deadline, unsigned int timer)
+{
+	if ((timer != 0) && ((*deadline == 0) || (timer < *deadline)))
+		*deadline = timer;
+}
+
+// Returns after how many timer units the next timer expires, or 0 if none is running.
+// Disabled ports count too: their state machines hold some of their timers (fdWhile, mDelayWhile) by restarting them
+// after each tick, but others (rbWhile, helloWhen, tcWhile) keep counting down and expire as on an enabled port.
+static unsigned int GetNextTimerExpiry (const STP_BRIDGE* bridge)
+{
+	unsigned int expiry = 0;
+
+	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
+	{
+		const PORT* port = bridge->ports [portIndex];
+
+		UpdateDeadline (&expiry, port->helloWhen);
+		UpdateDeadline (&expiry, port->mDelayWhile);
+		UpdateDeadline (&expiry, port->edgeDelayWhile);
+		UpdateDeadline (&expiry, port->pseudoInfoHelloWhen);
+
+		// txCount matters to the Port Transmit state machine not when it reaches zero, but when it falls below TxHoldCount.
+		// It's decremented once every txHoldPeriod, when txHoldRemainder wraps around.
+		if (port->txCount >= STP_BRIDGE::TxHoldCount)
+			UpdateDeadline (&expiry, (port->txCount - STP_BRIDGE::TxHoldCount + 1) * bridge->txHoldPeriod() - bridge->txHoldRemainder);
+
+		const unsigned short* timer = (const unsigned short*) port->treeTimers;
+		const unsigned short* timersEnd = timer + bridge->treeCount() * (sizeof (PORT_TREE_TIMERS) / sizeof (unsigned short));
+		for (; timer < timersEnd; timer++)
+			UpdateDeadline (&expiry, *timer);
+	}
+
+	return expiry;
+}
+
+// Advances the timers by the given time, in timer units, with the same port states as that many ticks of one unit.
+// Until the next timer expires, such ticks only decrement timers, after which the state machines restart those
+// they hold at a fixed value, like rrWhile of a Root Port or fdWhile of a disabled port. So we apply the ticks
+// before each expiry with a single tick, and the tick at the expiry on its own: a held timer must not reach zero
+// in a longer tick, as some state machines check for zero before restarting it (mDelayWhile of a disabled port).
+// The states entered on each tick (a Root Port re-entering ROOT_PORT, for instance) are entered once per tick here,
+// so the application sees fewer repeated role callbacks than with one-unit ticks, but the same role changes.
+static void AdvanceTimers (STP_BRIDGE* bridge, unsigned int timerUnits, unsigned int timestamp)
+{
+	while (timerUnits > 0)
+	{
+		unsigned int expiry = GetNextTimerExpiry (bridge);
+		if ((expiry == 0) || (expiry > timerUnits))
+		{
+			RunTimerTick (bridge, timerUnits, timestamp);
+			break;
+		}
+
+		if (expiry > 1)
+			RunTimerTick (bridge, expiry - 1, timestamp);
+
+		RunTimerTick (bridge, 1, timestamp);
+
+		timerUnits -= expiry;
+	}
+}
+
+// ============================================================================
+
+void STP_OnOneSecondTick (STP_BRIDGE* bridge, unsigned int timestamp)
+{
+	if (bridge->started)
+	{
+		if (bridge->millisecondTimers)
+		{
+			// With whole-second times no timer expires before the end of the second, and a single tick of 256 units
+			// does the same as a tick of one second without millisecond timers. Splitting the second at the next expiry,
+			// as AdvanceTimers does, would run the state machines once more: the states they re-enter on each run
+			// (ROOT_PORT, for instance) would call their callbacks again, and a timer held until the expiry would be
+			// left one unit short of its value instead of a second. So we split it only when a timer expires within
+			// the second, as with a Hello Time shorter than a second.
+			unsigned int expiry = GetNextTimerExpiry (bridge);
+			if ((expiry != 0) && (expiry < 256))
+				AdvanceTimers (bridge, 256, timestamp);
+			else
+				RunTimerTick (bridge, 256, timestamp);
+		}
+		else
+			RunTimerTick (bridge, 1, timestamp);
+	}
+}
+
+void STP_OnSecondsElapsed (STP_BRIDGE* bridge, unsigned int seconds, unsigned int timestamp)
+{
+	if (bridge->started)
+		AdvanceTimers (bridge, seconds * bridge->timerUnitsPerSecond(), timestamp);
+}
+
+void STP_OnTimerTick (STP_BRIDGE* bridge, unsigned int milliseconds, unsigned int timestamp)
+{
+	if (bridge->started)
+	{
+		// timerRemainder keeps the fractions of a timer unit from one call to the next.
+		unsigned int timerUnits = milliseconds / 1000 * bridge->timerUnitsPerSecond();
+		unsigned int remainder = bridge->timerRemainder + milliseconds % 1000 * bridge->timerUnitsPerSecond();
+		timerUnits += remainder / 1000;
+		bridge->timerRemainder = remainder % 1000;
+
+		AdvanceTimers (bridge, timerUnits, timestamp);
+	}
+}
+
+unsigned int STP_GetNextDeadline (const STP_BRIDGE* bridge)
+{
+	if (bridge->started == false)
+		return 0;
+
+	unsigned int expiry = GetNextTimerExpiry (bridge);
+
+	if ((bridge->millisecondTimers == false) || (expiry == 0))
+		return expiry;
+
+	// The number of milliseconds after which STP_OnTimerTick will have applied that many timer units.
+	return (expiry * 1000 - bridge->timerRemainder + 255) / 256;
+}
+
+// ============================================================================
+
+void STP_EnableMillisecondTimers (STP_BRIDGE* bridge, unsigned int enable)
+{
+	// The timers hold values in the units of the current mode, so we can change it only while they're not running.
+	assert (bridge->started == false);
+
+	// Without millisecond timers the times must be whole seconds.
+	assert (enable || ((bridge->BridgeHelloTime % 256) == 0));
+
+	bridge->millisecondTimers = (enable != 0);
+}
+
+unsigned int STP_AreMillisecondTimersEnabled (const STP_BRIDGE* bridge)
+{
+	return bridge->millisecondTimers;
+}
+
+// ============================================================================
+
+void STP_SetHelloTime (STP_BRIDGE* bridge, unsigned int helloTimeMilliseconds, unsigned int timestamp)
+{
+	// 802.1Q-2011 fixes it at 2 seconds, older standards allowed 1 to 10 seconds.
+	// Without millisecond timers the timers can't count fractions of a second.
+	assert ((helloTimeMilliseconds >= 10) && (helloTimeMilliseconds <= 10000));
+	assert (bridge->millisecondTimers || ((helloTimeMilliseconds % 1000) == 0));
+
+	LOG (bridge, -1, -1, "{T}: Setting hello time to {D} ms...\r\n", timestamp, helloTimeMilliseconds);
+
+	unsigned short helloTime = (unsigned short) ((helloTimeMilliseconds * 256 + 500) / 1000);
+
+	TRACE (bridge, STP_TRACE_EVENT_HELLO_TIME_SET, helloTimeMilliseconds, -1, timestamp, 0, 0, 0,
+		   (bridge->BridgeHelloTime != helloTime) ? 0 : STP_TRACE_FLAG_NOTHING_CHANGED);
+
+	if (bridge->BridgeHelloTime != helloTime)
+	{
+		LOG (bridge, -1, -1, "\r\n");
+
+		bridge->BridgeHelloTime = helloTime;
+		bridge->txHoldRemainder = 0; // txHoldPeriod may have changed
+		bridge->trees [CIST_INDEX]->BridgeTimes.HelloTime = helloTime;
+
+		// The Hello Time of the CIST's portTimes is always BridgeHelloTime, see recordTimes(). MSTIs don't have one.
+		for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
+			bridge->ports [portIndex]->GetCistTree ()->cistTimes [PORT_INFO].HelloTime = helloTime;
+
+		bridge->invalidateTxTemplates ();
+
+		bridge->callbacks.onConfigChanged (bridge, timestamp);
+
+		if (bridge->started)
+			RecomputePrioritiesAndPortRoles (bridge, CIST_INDEX, timestamp);
+	}
+	else
+		LOG (bridge, -1, -1, " nothing changed.\r\n");
+
+	LOG (bridge, -1, -1, "------------------------------------\r\n");
+	FLUSH_LOG (bridge);
+}
+
+unsigned int STP_GetHelloTime (const STP_BRIDGE* bridge)
+{
+	return (bridge->BridgeHelloTime * 1000 + 128) / 256;
+}
+
+// ============================================================================
+
+// Logs and validates a BPDU received on a port and, if it's to be passed to the state machines, stores it in the port
+// and sets rcvdBpdu. The caller runs the state machines afterwards and then calls ReleaseReceivedBpdu.
+static bool QueueReceivedBpdu (STP_BRIDGE* bridge, unsigned int portIndex, const unsigned char* bpdu, unsigned int bpduSize, unsigned int timestamp)
+{
+	PORT* port = bridge->ports [portIndex];
+
+	if (port->portEnabled == false)
+	{
+		LOG (bridge, -1, -1, "{T}: WARNING: BPDU received on disabled port {D}. The STP library is discarding it.\r\n", timestamp, 1 + portIndex);
+		return false;
+	}
+
+	LOG (bridge, -1, -1, "{T}: BPDU received on Port {D}:\r\n", timestamp, 1 + portIndex);
+
+	enum VALIDATED_BPDU_TYPE type = STP_GetValidatedBpduType (bpdu, bpduSize);
+	TRACE (bridge, STP_TRACE_EVENT_BPDU_RECEIVED, portIndex, -1, timestamp, 0, 0, (unsigned char) type);
+	bool passToStateMachines;
+	switch (type)
+	{
+		case VALIDATED_BPDU_TYPE_STP_CONFIG:
+			LOG (bridge, portIndex, -1, "Config BPDU:\r\n");
+			LOG_INDENT (bridge);
+			DumpConfigBpdu (bridge, portIndex, -1, (const MSTP_BPDU*) bpdu);
+			LOG_UNINDENT (bridge);
+			passToStateMachines = true;
+			break;
+
+		case VALIDATED_BPDU_TYPE_RST:
+			LOG (bridge, portIndex, -1, "RSTP BPDU:\r\n");
+			LOG_INDENT (bridge);
+			DumpRstpBpdu (bridge, portIndex, -1, (const MSTP_BPDU*) bpdu);
+			LOG_UNINDENT (bridge);
+			passToStateMachines = true;
+			break;
+
+		case VALIDATED_BPDU_TYPE_MST:
+			LOG (bridge, portIndex, -1, "MSTP BPDU:\r\n");
+			LOG_INDENT (bridge);
+			DumpMstpBpdu (bridge, portIndex, -1, (const MSTP_BPDU*) bpdu);
+			LOG_UNINDENT (bridge);
+			passToStateMachines = true;
+			break;
+
+		case VALIDATED_BPDU_TYPE_STP_TCN:
+			LOG (bridge, portIndex, -1, "TCN BPDU.\r\n");
+			passToStateMachines = true;
+			break;
+
+		default:
+			LOG (bridge, portIndex, -1, "Invalid BPDU received. Discarding it.\r\n");
+			passToStateMachines = false;
+	}
+
+	if (!passToStateMachines)
+		return false;
+
+	assert (port->receivedBpduContent == NULL);
+	assert (port->receivedBpduType == VALIDATED_BPDU_TYPE_UNKNOWN);
+	assert (port->rcvdBpdu == false);
+
+	port->receivedBpduContent = (const MSTP_BPDU*) bpdu;
+	port->receivedBpduType = type;
+	port->rcvdBpdu = true;
+	bridge->markPortDirty (portIndex);
+	return true;
+}
+
+static void ReleaseReceivedBpdu (STP_BRIDGE* bridge, unsigned int portIndex)
+{
+	PORT* port = bridge->ports [portIndex];
+
+	port->receivedBpduContent = NULL; // to cause an exception on access
+	port->receivedBpduType = VALIDATED_BPDU_TYPE_UNKNOWN; // to cause asserts on access
+
+	// Check that the state machines did process the BPDU.
+	assert (port->rcvdBpdu == false);
+}
+
+// ============================================================================
+
+void STP_OnBpduReceived (STP_BRIDGE* bridge, unsigned int portIndex, const unsigned char* bpdu, unsigned int bpduSize, unsigned int timestamp)
+{
+	if (bridge->started)
+	{
+		if (QueueReceivedBpdu (bridge, portIndex, bpdu, bpduSize, timestamp))
+		{
+			RunStateMachines (bridge, timestamp);
+			ReleaseReceivedBpdu (bridge, portIndex);
+		}
+
+		LOG (bridge, -1, -1, "------------------------------------\r\n");
+		FLUSH_LOG (bridge);
+	}
+}
+
+// ============================================================================
+
+void STP_OnBpdusReceived (STP_BRIDGE* bridge, const STP_RECEIVED_BPDU* entries, unsigned int entryCount, unsigned int timestamp)
+{
+	if (bridge->started)
+	{
+		// Each BPDU is processed on its own, in order, as with STP_OnBpduReceived, so that the bridge ends up in the same state.
+		// Only the Port Transmit state machine waits until the end of the burst, as no other state machine reads
+		// the variables it works with (newInfo, txCount, tcAck, helloWhen): a port that would have transmitted several
+		// BPDUs during the burst transmits once, at the end. The snapshot and the transmit batch wait for the end too.
+		for (unsigned int entryIndex = 0; entryIndex < entryCount; entryIndex++)
+		{
+			const STP_RECEIVED_BPDU* entry = &entries [entryIndex];
+			assert (entry->portIndex < bridge->portCount);
+			if (QueueReceivedBpdu (bridge, entry->portIndex, entry->bpdu, entry->bpduSize, timestamp))
+			{
+				RunStateMachinePasses (bridge, false, timestamp);
+				ReleaseReceivedBpdu (bridge, entry->portIndex);
+			}
+		}
+
+		RunStateMachines (bridge, timestamp);
+
+		LOG (bridge, -1, -1, "------------------------------------\r\n");
+		FLUSH_LOG (bridge);
+	}
+}
+
+// ============================================================================
+
+unsigned int STP_IsBridgeStarted (const STP_BRIDGE* bridge)
+{
+	return bridge->started;
+}
+
+// ============================================================================
+
+void STP_EnableLogging (STP_BRIDGE* bridge, unsigned int enable)
+{
+#if STP_USE_LOG
+	bridge->loggingEnabled = enable;
+#endif
+}
+
+// ============================================================================
+
+unsigned int STP_IsLoggingEnabled (const STP_BRIDGE* bridge)
+{
+#if STP_USE_LOG
+	return bridge->loggingEnabled;
+#else
+	return false;
+#endif
+}
+
+// ============================================================================
+
+void STP_SetTraceBuffer (STP_BRIDGE* bridge, void* buffer, unsigned int bufferSize)
+{
+	if (buffer == NULL)
+	{
+		bridge->traceHeader = NULL;
+		bridge->traceRecords = NULL;
+		return;
+	}
+
+	assert (((size_t) buffer % sizeof (unsigned int)) == 0);
+	assert (bufferSize >= sizeof (STP_TRACE_HEADER) + sizeof (STP_TRACE_RECORD));
+
+	STP_TRACE_HEADER* header = (STP_TRACE_HEADER*) buffer;
+	header->recordCapacity = (bufferSize - sizeof (STP_TRACE_HEADER)) / sizeof (STP_TRACE_RECORD);
+	header->recordsWritten = 0;
+	header->nextRecordIndex = 0;
+	header->wrapped = 0;
+
+	bridge->traceRecords = (STP_TRACE_RECORD*) &header [1];
+	bridge->traceHeader = header;
+}
+
+// ============================================================================
+
+unsigned int STP_GetSnapshotBufferSize (unsigned int portCount, unsigned int mstiCount)
+{
+	unsigned int treeCount = 1 + mstiCount;
+	return sizeof (STP_SNAPSHOT_HEADER)
+		+ treeCount * sizeof (STP_SNAPSHOT_TREE)
+		+ portCount * sizeof (STP_SNAPSHOT_PORT)
+		+ portCount * treeCount * sizeof (STP_SNAPSHOT_PORT_TREE);
+}
+
+void STP_SetSnapshotBuffer (STP_BRIDGE* bridge, void* buffer)
+{
+	if (buffer == NULL)
+	{
+		bridge->snapshotHeader = NULL;
+		return;
+	}
+
+	assert (((size_t) buffer % sizeof (unsigned int)) == 0);
+
+	// An odd sequence number keeps readers away until PublishSnapshot has filled in the buffer.
+	bridge->snapshotHeader = (volatile STP_SNAPSHOT_HEADER*) buffer;
+	bridge->snapshotHeader->sequence = 1;
+
+	PublishSnapshot (bridge);
+}
+
+// Copies src over dst, but only if they differ. The first write of an update makes the sequence number odd,
+// so that readers ignore what they copy until the update is complete. See PublishSnapshot.
+struct SNAPSHOT_WRITER
+{
+	volatile STP_SNAPSHOT_HEADER* header;
+	bool updating;
+
+	void Write (volatile void* dst, const void* src, unsigned int size)
+	{
+		volatile unsigned char* d = (volatile unsigned char*) dst;
+		const unsigned char* s = (const unsigned char*) src;
+		for (unsigned int i = 0; i < size; i++)
+		{
+			if (d [i] != s [i])
+			{
+				if (!updating)
+				{
+					header->sequence = header->sequence + 1;
+					STP_MEMORY_BARRIER ();
+					updating = true;
+				}
+
+				d [i] = s [i];
+			}
+		}
+	}
+};
+
+// Note AG: This is a seqlock. The protocol thread never waits for readers: it updates the buffer in place,
+// and readers retry when the sequence number changed while they were copying. Only the fields that changed
+// are written, and the sequence number doesn't change if none did, so readers are disturbed only by actual changes.
+static void PublishSnapshot (STP_BRIDGE* bridge)
+{
+	if (bridge->snapshotHeader == NULL)
+		return;
+
+	unsigned int treeCount = bridge->allocatedTreeCount();
+
+	SNAPSHOT_WRITER writer = { bridge->snapshotHeader, (bridge->snapshotHeader->sequence & 1) != 0 };
+
+	STP_SNAPSHOT_HEADER header;
+	memset (&header, 0, sizeof (header));
+	header.portCount = bridge->portCount;
+	header.treeCount = treeCount;
+	header.started = bridge->started;
+	header.stpVersion = (unsigned char) bridge->ForceProtocolVersion;
+	writer.Write (&writer.header->portCount, &header.portCount, sizeof (header) - offsetof (STP_SNAPSHOT_HEADER, portCount));
+
+	volatile STP_SNAPSHOT_TREE* trees = (volatile STP_SNAPSHOT_TREE*) &writer.header [1];
+	for (unsigned int treeIndex = 0; treeIndex < treeCount; treeIndex++)
+	{
+		const BRIDGE_TREE* bridgeTree = bridge->trees [treeIndex];
+
+		STP_SNAPSHOT_TREE tree;
+		memset (&tree, 0, sizeof (tree));
+		memcpy (tree.rootPriorityVector, &bridgeTree->rootPriority, 34);
+		memcpy (&tree.rootPriorityVector [34], &bridgeTree->rootPortId, 2);
+		tree.forwardDelay  = bridgeTree->rootTimes.ForwardDelay / 256;
+		tree.helloTime     = bridgeTree->rootTimes.HelloTime / 256;
+		tree.maxAge        = bridgeTree->rootTimes.MaxAge / 256;
+		tree.messageAge    = bridgeTree->rootTimes.MessageAge / 256;
+		tree.remainingHops = bridgeTree->rootTimes.remainingHops;
+		writer.Write (&trees [treeIndex], &tree, sizeof (tree));
+	}
+
+	volatile STP_SNAPSHOT_PORT* ports = (volatile STP_SNAPSHOT_PORT*) &trees [treeCount];
+	volatile STP_SNAPSHOT_PORT_TREE* portTrees = (volatile STP_SNAPSHOT_PORT_TREE*) &ports [bridge->portCount];
+	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
+	{
+		const PORT* port = bridge->ports [portIndex];
+
+		STP_SNAPSHOT_PORT snapshotPort = { port->portEnabled, port->operEdge, port->operPointToPointMAC, 0 };
+		writer.Write (&ports [portIndex], &snapshotPort, sizeof (snapshotPort));
+
+		for (unsigned int treeIndex = 0; treeIndex < treeCount; treeIndex++)
+		{
+			const PORT_TREE* tree = port->trees [treeIndex];
+			STP_SNAPSHOT_PORT_TREE portTree = { (unsigned char) tree->role, tree->learning, tree->forwarding, 0 };
+			writer.Write (&portTrees [portIndex * treeCount + treeIndex], &portTree, sizeof (portTree));
+		}
+	}
+
+	if (writer.updating)
+	{
+		STP_MEMORY_BARRIER ();
+		writer.header->sequence = writer.header->sequence + 1;
+	}
+}
+
+unsigned int STP_ReadSnapshot (const void* buffer, void* copyOut, unsigned int bufferSize)
+{
+	assert (bufferSize >= sizeof (STP_SNAPSHOT_HEADER));
+
+	const volatile STP_SNAPSHOT_HEADER* header = (const volatile STP_SNAPSHOT_HEADER*) buffer;
+	const volatile unsigned char* src = (const volatile unsigned char*) buffer;
+	unsigned char* dst = (unsigned char*) copyOut;
+
+	while (true)
+	{
+		unsigned int sequence = header->sequence;
+		if ((sequence & 1) == 0)
+		{
+			STP_MEMORY_BARRIER ();
+
+			for (unsigned int i = 0; i < bufferSize; i++)
+				dst [i] = src [i];
+
+			STP_MEMORY_BARRIER ();
+
+			if (header->sequence == sequence)
+			{
+				// The copy of the sequence number itself might be from the middle of an update.
+				((STP_SNAPSHOT_HEADER*) copyOut)->sequence = sequence;
+				return sequence;
+			}
+		}
+	}
+}
+
+// ============================================================================
+
+static void InsertSortedPortIndex (unsigned short* list, unsigned int* count, unsigned int portIndex)
+{
+	// Ports are usually marked in increasing order, so check for appending first.
+	unsigned int pos = *count;
+	while ((pos > 0) && (list [pos - 1] > portIndex))
+	{
+		list [pos] = list [pos - 1];
+		pos--;
+	}
+
+	assert ((pos == 0) || (list [pos - 1] != portIndex));
+	list [pos] = (unsigned short) portIndex;
+	(*count)++;
+}
+
+void STP_BRIDGE::markPortDirty (unsigned int portIndex)
+{
+	unsigned char d = dirtyPorts [portIndex];
+
+	if ((d & (DirtyThisPass | DirtyNextPass)) == 0)
+		InsertSortedPortIndex (dirtyPortList, &dirtyPortListCount, portIndex);
+
+	if ((d & DirtyTransmit) == 0)
+		InsertSortedPortIndex (transmitPortList, &transmitPortListCount, portIndex);
+
+	dirtyPorts [portIndex] = d | DirtyNextPass | DirtyTransmit;
+	dirtyMarksPending = true;
+}
+
+void STP_BRIDGE::markAllDirty ()
+{
+	for (unsigned int portIndex = 0; portIndex < portCount; portIndex++)
+	{
+		dirtyPorts [portIndex] |= DirtyNextPass | DirtyTransmit;
+		dirtyPortList [portIndex] = (unsigned short) portIndex;
+		transmitPortList [portIndex] = (unsigned short) portIndex;
+	}
+
+	dirtyPortListCount = portCount;
+	transmitPortListCount = portCount;
+
+	for (unsigned int treeIndex = 0; treeIndex < allocatedTreeCount(); treeIndex++)
+		markTreeDirty (treeIndex);
+}
+
+void STP_BRIDGE::markRootCandidateDirty (unsigned int portIndex, unsigned int treeIndex)
 {
-	LOG (bridge, -1, -1, "{T}: Port {D} down\r\n", timestamp, 1 + portIndex);
-
-	// We allow disabling an already disabled port.
-	if (bridge->ports [portIndex]->portEnabled)
-	{
-		bridge->ports [portIndex]->portEnabled = false;
+	BRIDGE_TREE* tree = trees [treeIndex];
+	PORT_TREE* portTree = ports [portIndex]->trees [treeIndex];
 
-		if (bridge->started)
-			RunStateMachines (bridge, timestamp);
-	}
+	if (tree->allRootCandidatesDirty || portTree->rootCandidateDirty)
+		return;
 
-	LOG (bridge, -1, -1, "------------------------------------\r\n");
-	FLUSH_LOG (bridge);
+	portTree->rootCandidateDirty = true;
+	tree->dirtyRootCandidates [tree->dirtyRootCandidateCount++] = (unsigned short) portIndex;
 }
 
-// ============================================================================
+void STP_BRIDGE::markAllRootCandidatesDirty (unsigned int treeIndex)
+{
+	trees [treeIndex]->allRootCandidatesDirty = true;
+	trees [treeIndex]->designatedPrioritiesStale = true;
+}
 
-void STP_OnOneSecondTick (STP_BRIDGE* bridge, unsigned int timestamp)
+static void UpdateCount (unsigned int* count, unsigned char oldState, unsigned char newState, unsigned char countedFlag)
 {
-	if (bridge->started)
+	if ((newState & countedFlag) && !(oldState & countedFlag))
 	{
-		LOG (bridge, -1, -1, "{T}: One second:\r\n", timestamp);
+		(*count)++;
+	}
+	else if (!(newState & countedFlag) && (oldState & countedFlag))
+	{
+		assert (*count > 0);
+		(*count)--;
+	}
+}
 
-		// Not from the standard. See long comment in 802_1Q_2011_procedures.cpp, just above CallTcCallback().
-		if (bridge->tcIgnore > 0)
-			bridge->tcIgnore--;
+void STP_BRIDGE::updateSharedStateCounts (unsigned int portIndex, unsigned int treeIndex)
+{
+	BRIDGE_TREE* tree = trees [treeIndex];
+	PORT* port = ports [portIndex];
+	PORT_TREE* portTree = port->trees [treeIndex];
 
-		for (unsigned int givenPort = 0; givenPort < bridge->portCount; givenPort++)
-			bridge->ports [givenPort]->tick = true;
+	unsigned char oldState = portTree->countedState;
+	unsigned char newState = portTree->GetCountedState ();
+	if (newState == oldState)
+		return;
 
-		RunStateMachines (bridge, timestamp);
+	UpdateCount (&tree->unsettledPortCount,       oldState, newState, PORT_TREE::CountedUnsettled);
+	UpdateCount (&tree->unsyncedPortCount,        oldState, newState, PORT_TREE::CountedUnsynced);
+	UpdateCount (&tree->unsyncedNonRootPortCount, oldState, newState, PORT_TREE::CountedUnsyncedNonRoot);
+	UpdateCount (&tree->reselectPortCount,        oldState, newState, PORT_TREE::CountedReselect);
 
-		LOG (bridge, -1, -1, "------------------------------------\r\n");
-		FLUSH_LOG (bridge);
-	}
-}
+	// allTransmitReady looks at the CIST variables directly.
+	if (treeIndex != CIST_INDEX)
+		UpdateCount (&port->notTransmitReadyMstiCount, oldState, newState, PORT_TREE::CountedNotTransmitReady);
 
-// ============================================================================
+	portTree->countedState = newState;
+}
 
-void STP_OnBpduReceived (STP_BRIDGE* bridge, unsigned int portIndex, const unsigned char* bpdu, unsigned int bpduSize, unsigned int timestamp)
+void STP_BRIDGE::invalidateTxTemplates ()
 {
-	if (bridge->started)
+	for (unsigned int portIndex = 0; portIndex < portCount; portIndex++)
 	{
-		if (bridge->ports [portIndex]->portEnabled == false)
-		{
-			LOG (bridge, -1, -1, "{T}: WARNING: BPDU received on disabled port {D}. The STP library is discarding it.\r\n", timestamp, 1 + portIndex);
-		}
-		else
-		{
-			LOG (bridge, -1, -1, "{T}: BPDU received on Port {D}:\r\n", timestamp, 1 + portIndex);
+		for (unsigned int treeIndex = 0; treeIndex < allocatedTreeCount(); treeIndex++)
+			ports [portIndex]->trees [treeIndex]->txTemplateValid = false;
+	}
+}
 
-			enum VALIDATED_BPDU_TYPE type = STP_GetValidatedBpduType (bpdu, bpduSize);
-			bool passToStateMachines;
-			switch (type)
-			{
-				case VALIDATED_BPDU_TYPE_STP_CONFIG:
-					LOG (bridge, portIndex, -1, "Config BPDU:\r\n");
-					LOG_INDENT (bridge);
-					DumpConfigBpdu (bridge, portIndex, -1, (const MSTP_BPDU*) bpdu);
-					LOG_UNINDENT (bridge);
-					passToStateMachines = true;
-					break;
-
-				case VALIDATED_BPDU_TYPE_RST:
-					LOG (bridge, portIndex, -1, "RSTP BPDU:\r\n");
-					LOG_INDENT (bridge);
-					DumpRstpBpdu (bridge, portIndex, -1, (const MSTP_BPDU*) bpdu);
-					LOG_UNINDENT (bridge);
-					passToStateMachines = true;
-					break;
-
-				case VALIDATED_BPDU_TYPE_MST:
-					LOG (bridge, portIndex, -1, "MSTP BPDU:\r\n");
-					LOG_INDENT (bridge);
-					DumpMstpBpdu (bridge, portIndex, -1, (const MSTP_BPDU*) bpdu);
-					LOG_UNINDENT (bridge);
-					passToStateMachines = true;
-					break;
-
-				case VALIDATED_BPDU_TYPE_STP_TCN:
-					LOG (bridge, portIndex, -1, "TCN BPDU.\r\n");
-					passToStateMachines = true;
-					break;
-
-				default:
-					LOG (bridge, portIndex, -1, "Invalid BPDU received. Discarding it.\r\n");
-					passToStateMachines = false;
-			}
+void STP_BRIDGE::updatePortVlanBitmap (unsigned int portIndex, unsigned char* portBitmap, unsigned int treeIndex, bool set)
+{
+	const unsigned char* treeBitmap = getVlanBitmap (treeIndex);
 
-			if (passToStateMachines)
-			{
-				assert (bridge->receivedBpduContent == NULL);
-				assert (bridge->receivedBpduType == VALIDATED_BPDU_TYPE_UNKNOWN);
-				assert (bridge->ports [portIndex]->rcvdBpdu == false);
+	unsigned char changed = 0;
+	for (unsigned int i = 0; i < vlanBitmapSize; i++)
+	{
+		unsigned char value = set ? (portBitmap [i] | treeBitmap [i]) : (portBitmap [i] & (unsigned char) ~treeBitmap [i]);
+		changed |= value ^ portBitmap [i];
+		portBitmap [i] = value;
+	}
 
-				bridge->receivedBpduContent = (MSTP_BPDU*) bpdu;
-				bridge->receivedBpduType = type;
-				bridge->ports [portIndex]->rcvdBpdu = true;
+	if (changed != 0)
+		ports [portIndex]->vlanBitmapGeneration++;
+}
 
-				RunStateMachines (bridge, timestamp);
+void STP_BRIDGE::rebuildPortVlanBitmaps ()
+{
+	for (unsigned int portIndex = 0; portIndex < portCount; portIndex++)
+	{
+		PORT* port = ports [portIndex];
 
-				bridge->receivedBpduContent = NULL; // to cause an exception on access
-				bridge->receivedBpduType = VALIDATED_BPDU_TYPE_UNKNOWN; // to cause asserts on access
+		unsigned char changed = 0;
+		for (unsigned int i = 0; i < vlanBitmapSize; i++)
+		{
+			unsigned char forwarding = 0;
+			unsigned char learning = 0;
+			for (unsigned int treeIndex = 0; treeIndex < treeCount (); treeIndex++)
+			{
+				if (port->trees [treeIndex]->forwarding)
+					forwarding |= getVlanBitmap (treeIndex) [i];
 
-				// Check that the state machines did process the BPDU.
-				assert (bridge->ports [portIndex]->rcvdBpdu == false);
+				if (port->trees [treeIndex]->learning)
+					learning |= getVlanBitmap (treeIndex) [i];
 			}
+
+			changed |= (forwarding ^ port->forwardingVlans [i]) | (learning ^ port->learningVlans [i]);
+			port->forwardingVlans [i] = forwarding;
+			port->learningVlans [i] = learning;
 		}
 
-		LOG (bridge, -1, -1, "------------------------------------\r\n");
-		FLUSH_LOG (bridge);
+		if (changed != 0)
+			port->vlanBitmapGeneration++;
 	}
 }
 
 // ============================================================================
 
-unsigned int STP_IsBridgeStarted (const STP_BRIDGE* bridge)
+void* STP_BRIDGE::getTransmitBuffer (unsigned int portIndex, unsigned int bpduSize, unsigned int timestamp)
 {
-	return bridge->started;
+	if (callbacks.transmitBatch == NULL)
+		return callbacks.transmitGetBuffer (this, portIndex, bpduSize, timestamp);
+
+	assert (bpduSize <= transmitBatchSlotSize);
+
+	if (ports [portIndex]->inTransmitBatch)
+		flushTransmitBatch (timestamp);
+
+	unsigned char* slot = &transmitBatchBuffer [portIndex * transmitBatchSlotSize];
+
+	assert (transmitBatchCount < portCount);
+	STP_TRANSMITTED_BPDU* entry = &transmitBatchEntries [transmitBatchCount];
+	entry->portIndex = portIndex;
+	entry->bpdu = slot;
+	entry->bpduSize = bpduSize;
+	transmitBatchCount++;
+	ports [portIndex]->inTransmitBatch = true;
+
+	return slot;
 }
 
-// ============================================================================
+void STP_BRIDGE::releaseTransmitBuffer (void* buffer)
+{
+	// In batch mode the BPDU stays in its slot until flushTransmitBatch.
+	if (callbacks.transmitBatch == NULL)
+		callbacks.transmitReleaseBuffer (this, buffer);
+}
 
-void STP_EnableLogging (STP_BRIDGE* bridge, unsigned int enable)
+void STP_BRIDGE::flushTransmitBatch (unsigned int timestamp)
 {
-	bridge->loggingEnabled = enable;
+	if (transmitBatchCount == 0)
+		return;
+
+	callbacks.transmitBatch (this, transmitBatchEntries, transmitBatchCount, timestamp);
+
+	for (unsigned int i = 0; i < transmitBatchCount; i++)
+		ports [transmitBatchEntries [i].portIndex]->inTransmitBatch = false;
+
+	transmitBatchCount = 0;
 }
 
 // ============================================================================
 
-unsigned int STP_IsLoggingEnabled (const STP_BRIDGE* bridge)
+static void MarkDirtyAfterTransition (STP_BRIDGE* bridge, int givenPort, int givenTree, unsigned int sharedStateBefore)
 {
-	return bridge->loggingEnabled;
+	if (givenPort == -1)
+	{
+		// Port Role Selection writes selected, selectedRole and updtInfo of all ports, and a CIST transition
+		// can write to the MSTIs too (syncMaster, updtRolesTree). Simplest is to consider everything touched.
+		// (syncMaster updates the counts of the MSTI ports it writes to.)
+		if (givenTree != -1)
+		{
+			for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
+				bridge->updateSharedStateCounts (portIndex, givenTree);
+		}
+
+		bridge->markAllDirty ();
+		return;
+	}
+
+	bridge->markPortDirty (givenPort);
+
+	// A transition of a per-port-per-tree machine touches the other ports of the same tree only through
+	// the variables read by allSynced, reRooted and Port Role Selection. (Procedures that write directly
+	// to the other ports of the tree - setSyncTree, setReRootTree, setTcPropTree - mark the tree themselves.)
+	if ((givenTree != -1)
+		&& (bridge->ports [givenPort]->trees [givenTree]->GetSharedStateSignature () != sharedStateBefore))
+	{
+		bridge->updateSharedStateCounts (givenPort, givenTree);
+		bridge->markTreeDirty (givenTree);
+	}
 }
 
 // ============================================================================
@@ -484,16 +1341,21 @@ rep:
 				LOG (bridge, givenPort, givenTree, "MST{D}: ", givenTree);
 		}
 
-		//const char* currentStateName = smInfo->getStateName (*statePtr);
-		const char* newStateName = smInfo->getStateName (newState);
+		// The state names are looked up inside the LOG macro, so it costs nothing when logging is disabled.
+		//LOG (bridge, givenPort, givenTree, "{S}: {S} -> {S}\r\n", smInfo->smName, smInfo->getStateName (*statePtr), smInfo->getStateName (newState));
+		LOG (bridge, givenPort, givenTree, "{S}: -> {S}\r\n", smInfo->smName, smInfo->getStateName (newState));
+		TRACE (bridge, STP_TRACE_EVENT_STATE_CHANGED, givenPort, givenTree, timestamp,
+			   (unsigned char) ((smInfo == bridge->smInterface->transmitSmInfo) ? bridge->smInterface->smInfoCount : (smInfo - bridge->smInterface->smInfo)),
+			   newState, (unsigned char) bridge->ForceProtocolVersion);
 
-		//LOG (bridge, givenPort, givenTree, "{S}: {S} -> {S}\r\n", smInfo->smName, currentStateName, newStateName);
-		LOG (bridge, givenPort, givenTree, "{S}: -> {S}\r\n", smInfo->smName, newStateName);
+		unsigned int sharedStateBefore = ((givenPort != -1) && (givenTree != -1)) ? bridge->ports [givenPort]->trees [givenTree]->GetSharedStateSignature () : 0;
 
 		smInfo->initState (bridge, givenPort, givenTree, newState, timestamp);
 
 		*statePtr = newState;
 		changed = true;
+
+		MarkDirtyAfterTransition (bridge, givenPort, givenTree, sharedStateBefore);
 		goto rep;
 	}
 
@@ -502,79 +1364,258 @@ rep:
 
 // ============================================================================
 
-static bool RunStateMachineInstances (STP_BRIDGE* bridge, const SM_INFO* smInfo, SM_STATE** statePtr, unsigned int timestamp)
+// Returns the next port after previousPort (pass -1 to get the first one) whose instance of a state machine
+// must be evaluated during the current pass, or -1 if there are no more such ports. If the tree of the instances is dirty,
+// that's all ports; otherwise it's the ports in dirtyPortList. Marks set while a pass is executing are taken into account.
+static int GetNextDirtyPort (const STP_BRIDGE* bridge, int givenTree, int previousPort)
 {
-	volatile bool changed = false;
+	if ((givenTree != -1) && (bridge->dirtyTrees [givenTree] & (STP_BRIDGE::DirtyThisPass | STP_BRIDGE::DirtyNextPass)))
+		return ((unsigned int) (previousPort + 1) < bridge->portCount) ? (previousPort + 1) : -1;
+
+	// Binary search for the first port in the list greater than previousPort.
+	unsigned int lo = 0;
+	unsigned int hi = bridge->dirtyPortListCount;
+	while (lo < hi)
+	{
+		unsigned int mid = (lo + hi) / 2;
+		if ((int) bridge->dirtyPortList [mid] <= previousPort)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return (lo < bridge->dirtyPortListCount) ? bridge->dirtyPortList [lo] : -1;
+}
+
+// ============================================================================
+
+static void RunStateMachineInstances (STP_BRIDGE* bridge, const SM_INFO* smInfo, unsigned int treeCount, SM_STATE** statePtr, unsigned int timestamp)
+{
+	// An instance is evaluated only if its port or its tree has a dirty mark. Marks set while this function
+	// is executing also count, so a transition can wake up instances that come later in the same pass.
 
 	switch (smInfo->instanceType)
 	{
 		case SM_INFO::PER_BRIDGE:
-			changed |= RunStateMachineInstance (bridge, smInfo, -1, -1, *statePtr, timestamp);
+			RunStateMachineInstance (bridge, smInfo, -1, -1, *statePtr, timestamp);
 			(*statePtr)++;
 			break;
 
 		case SM_INFO::PER_BRIDGE_PER_TREE:
-			for (unsigned int treeIndex = 0; treeIndex < bridge->treeCount(); treeIndex++)
+			for (unsigned int treeIndex = 0; treeIndex < treeCount; treeIndex++)
 			{
-				changed |= RunStateMachineInstance (bridge, smInfo, -1, treeIndex, *statePtr, timestamp);
+				if (bridge->dirtyTrees [treeIndex] & (STP_BRIDGE::DirtyThisPass | STP_BRIDGE::DirtyNextPass))
+					RunStateMachineInstance (bridge, smInfo, -1, treeIndex, *statePtr, timestamp);
 				(*statePtr)++;
 			}
 			break;
 
 		case SM_INFO::PER_PORT:
-			for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
-			{
-				changed |= RunStateMachineInstance (bridge, smInfo, portIndex, -1, *statePtr, timestamp);
-				(*statePtr)++;
-			}
+			for (int portIndex = GetNextDirtyPort (bridge, -1, -1); portIndex != -1; portIndex = GetNextDirtyPort (bridge, -1, portIndex))
+				RunStateMachineInstance (bridge, smInfo, portIndex, -1, &(*statePtr) [portIndex], timestamp);
+			(*statePtr) += bridge->portCount;
 			break;
 
 		case SM_INFO::PER_PORT_PER_TREE:
-			for (unsigned int treeIndex = 0; treeIndex < bridge->treeCount(); treeIndex++)
+			for (unsigned int treeIndex = 0; treeIndex < treeCount; treeIndex++)
 			{
-				for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
-				{
-					changed |= RunStateMachineInstance (bridge, smInfo, portIndex, treeIndex, *statePtr, timestamp);
-					(*statePtr)++;
-				}
+				for (int portIndex = GetNextDirtyPort (bridge, treeIndex, -1); portIndex != -1; portIndex = GetNextDirtyPort (bridge, treeIndex, portIndex))
+					RunStateMachineInstance (bridge, smInfo, portIndex, treeIndex, &(*statePtr) [portIndex], timestamp);
+				(*statePtr) += bridge->portCount;
 			}
 			break;
 	}
+}
 
-	return changed;
+// ============================================================================
+
+static void RunTransmitStateMachineInstances (STP_BRIDGE* bridge, SM_STATE* statePtr, unsigned int timestamp)
+{
+	const SM_INFO* smInfo = bridge->smInterface->transmitSmInfo;
+
+	// PortTransmit runs only when the other machines have settled, which might be several passes after a port was marked,
+	// so it has its own mark that stays set until the port's PortTransmit instance was evaluated without making a transition.
+	assert (smInfo->instanceType == SM_INFO::PER_PORT);
+
+	unsigned int newCount = 0;
+	for (unsigned int i = 0; i < bridge->transmitPortListCount; i++)
+	{
+		unsigned int portIndex = bridge->transmitPortList [i];
+
+		// A transition marks the port again (PortTransmit only affects its own port), which doesn't change the list as the mark is still set.
+		bool changed = RunStateMachineInstance (bridge, smInfo, portIndex, -1, &statePtr [portIndex], timestamp);
+		if (changed)
+			bridge->transmitPortList [newCount++] = (unsigned short) portIndex;
+		else
+			bridge->dirtyPorts [portIndex] &= ~STP_BRIDGE::DirtyTransmit;
+	}
+
+	assert (newCount <= bridge->transmitPortListCount);
+	bridge->transmitPortListCount = newCount;
 }
 
 // ============================================================================
 
-static void RunStateMachines (STP_BRIDGE* bridge, unsigned int timestamp)
+static void BeginDirtyPass (STP_BRIDGE* bridge)
+{
+	// Marks set during the previous pass (or by the API since the last run) become the marks of this pass;
+	// marks of the previous pass are dropped, as all instances they pointed to have been evaluated since.
+	unsigned int newCount = 0;
+	for (unsigned int i = 0; i < bridge->dirtyPortListCount; i++)
+	{
+		unsigned int portIndex = bridge->dirtyPortList [i];
+		unsigned char d = bridge->dirtyPorts [portIndex];
+		if (d & STP_BRIDGE::DirtyNextPass)
+		{
+			bridge->dirtyPorts [portIndex] = (d & STP_BRIDGE::DirtyTransmit) | STP_BRIDGE::DirtyThisPass;
+			bridge->dirtyPortList [newCount++] = (unsigned short) portIndex;
+		}
+		else
+			bridge->dirtyPorts [portIndex] = d & STP_BRIDGE::DirtyTransmit;
+	}
+
+	bridge->dirtyPortListCount = newCount;
+
+	for (unsigned int treeIndex = 0; treeIndex < bridge->allocatedTreeCount(); treeIndex++)
+		bridge->dirtyTrees [treeIndex] = (bridge->dirtyTrees [treeIndex] & STP_BRIDGE::DirtyNextPass) ? STP_BRIDGE::DirtyThisPass : 0;
+
+	bridge->dirtyMarksPending = false;
+}
+
+// ============================================================================
+
+#ifdef STP_CROSS_CHECK_SCHEDULER
+// Debug aid: after the dirty-instance scheduler has settled, evaluate the conditions of _all_ instances
+// the way the full sweep would, and check that none of them would make a transition.
+// A failing assert here means some variable is written without marking the instances that read it.
+static void CrossCheckSchedulerResult (STP_BRIDGE* bridge)
 {
-	volatile bool changed;
+	SM_STATE* statePtr = bridge->states;
+
+	for (unsigned int i = 0; i <= bridge->smInterface->smInfoCount; i++)
+	{
+		const SM_INFO* smInfo = (i < bridge->smInterface->smInfoCount) ? &bridge->smInterface->smInfo [i] : bridge->smInterface->transmitSmInfo;
+
+		bool perPort = (smInfo->instanceType == SM_INFO::PER_PORT) || (smInfo->instanceType == SM_INFO::PER_PORT_PER_TREE);
+		bool perTree = (smInfo->instanceType == SM_INFO::PER_BRIDGE_PER_TREE) || (smInfo->instanceType == SM_INFO::PER_PORT_PER_TREE);
+
+		for (unsigned int treeIndex = 0; treeIndex < (perTree ? bridge->treeCount() : 1); treeIndex++)
+		{
+			for (unsigned int portIndex = 0; portIndex < (perPort ? bridge->portCount : 1); portIndex++)
+			{
+				int givenPort = perPort ? (int) portIndex : -1;
+				int givenTree = perTree ? (int) treeIndex : -1;
+				SM_STATE newState = smInfo->checkConditions (bridge, givenPort, givenTree, *statePtr);
+				assert (newState == 0);
+				statePtr++;
+			}
+		}
+	}
+
+	// Check also the counts kept for allSynced, allTransmitReady and Port Role Selection (see STP_BRIDGE::updateSharedStateCounts).
+	for (unsigned int treeIndex = 0; treeIndex < bridge->allocatedTreeCount(); treeIndex++)
+	{
+		unsigned int unsettledPortCount = 0;
+		unsigned int unsyncedPortCount = 0;
+		unsigned int unsyncedNonRootPortCount = 0;
+		unsigned int reselectPortCount = 0;
+		for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
+		{
+			unsigned char countedState = bridge->ports [portIndex]->trees [treeIndex]->GetCountedState ();
+			assert (bridge->ports [portIndex]->trees [treeIndex]->countedState == countedState);
+			unsettledPortCount       += (countedState & PORT_TREE::CountedUnsettled) ? 1 : 0;
+			unsyncedPortCount        += (countedState & PORT_TREE::CountedUnsynced) ? 1 : 0;
+			unsyncedNonRootPortCount += (countedState & PORT_TREE::CountedUnsyncedNonRoot) ? 1 : 0;
+			reselectPortCount        += (countedState & PORT_TREE::CountedReselect) ? 1 : 0;
+		}
+
+		assert (bridge->trees [treeIndex]->unsettledPortCount == unsettledPortCount);
+		assert (bridge->trees [treeIndex]->unsyncedPortCount == unsyncedPortCount);
+		assert (bridge->trees [treeIndex]->unsyncedNonRootPortCount == unsyncedNonRootPortCount);
+		assert (bridge->trees [treeIndex]->reselectPortCount == reselectPortCount);
+	}
+
+	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
+	{
+		unsigned int notTransmitReadyMstiCount = 0;
+		for (unsigned int treeIndex = 1; treeIndex < bridge->allocatedTreeCount(); treeIndex++)
+			notTransmitReadyMstiCount += (bridge->ports [portIndex]->trees [treeIndex]->countedState & PORT_TREE::CountedNotTransmitReady) ? 1 : 0;
+		assert (bridge->ports [portIndex]->notTransmitReadyMstiCount == notTransmitReadyMstiCount);
+	}
+}
+#endif
+
+// ============================================================================
 
-	do
+// Evaluates the marked state machine instances until no more marks are set. Without runPortTransmit the Port Transmit
+// instances are left out, and the ports marked for them stay in transmitPortList for the next run that includes them.
+static void RunStateMachinePasses (STP_BRIDGE* bridge, bool runPortTransmit, unsigned int timestamp)
+{
+	while (bridge->dirtyMarksPending || (runPortTransmit && (bridge->transmitPortListCount != 0)))
 	{
+		BeginDirtyPass (bridge);
+
 		SM_STATE* statePtr = bridge->states;
 
-		changed = false;
+		// ForceProtocolVersion doesn't change while the state machines are running (only via STP_SetStpVersion), so neither does the tree count.
+		unsigned int treeCount = bridge->treeCount();
 
 		for (unsigned int i = 0; i < bridge->smInterface->smInfoCount; i++)
-			changed |= RunStateMachineInstances (bridge, &bridge->smInterface->smInfo [i], &statePtr, timestamp);
+			RunStateMachineInstances (bridge, &bridge->smInterface->smInfo [i], treeCount, &statePtr, timestamp);
 
 		// We execute the PortTransmit state machine only after all other state machines have finished executing,
 		// so as to avoid transmitting BPDUs containing results from intermediary calculations.
 		// I remember reading this in the standard somewhere.
-		if (changed == false)
-			changed |= RunStateMachineInstances (bridge, bridge->smInterface->transmitSmInfo, &statePtr, timestamp);
+		if (runPortTransmit && (bridge->dirtyMarksPending == false))
+			RunTransmitStateMachineInstances (bridge, statePtr, timestamp);
+	}
+}
+
+static void RunStateMachines (STP_BRIDGE* bridge, unsigned int timestamp)
+{
+	// Note AG: Instead of evaluating all state machine instances until none of them changes state,
+	// we evaluate only the instances whose port or tree was marked dirty, until no more marks are set.
+	// Transitions mark what they might affect (see MarkDirtyAfterTransition), and API functions mark
+	// what they write to. The order of evaluation is the same as in the full sweep, so are the results.
+	// An event on a single port marks only that port; the run widens to other ports only when a procedure
+	// writes to them (setSyncTree, setReRootTree, Port Role Selection etc.), which marks their tree.
+	// Define STP_CROSS_CHECK_SCHEDULER to have this verified against a full sweep after each run.
+	RunStateMachinePasses (bridge, true, timestamp);
+
+#ifdef STP_CROSS_CHECK_SCHEDULER
+	CrossCheckSchedulerResult (bridge);
+#endif
+
+	bridge->flushTransmitBatch (timestamp);
+
+	PublishSnapshot (bridge);
+}
+
+// ============================================================================
 
-	} while (changed);
+static void SetBEGIN (STP_BRIDGE* bridge, bool begin)
+{
+	bridge->BEGIN = begin;
+
+	// BEGIN is read by all state machines.
+	bridge->markAllDirty ();
+
+	// The trees that were not in use until now (MSTIs, after switching to MSTP) may have stale root port candidates.
+	if (begin)
+	{
+		for (unsigned int treeIndex = 0; treeIndex < bridge->allocatedTreeCount(); treeIndex++)
+			bridge->markAllRootCandidatesDirty (treeIndex);
+	}
 }
 
 static void RestartStateMachines (STP_BRIDGE* bridge, unsigned int timestamp)
 {
 	assert (bridge->states);
-	memset (bridge->states, 0, GetInstanceCountForAllStateMachines(bridge) * sizeof(SM_STATE));
-	bridge->BEGIN = true;
+	memset (bridge->states, 0, GetInstanceCountForAllStateMachines (bridge->smInterface, bridge->portCount, bridge->allocatedTreeCount()) * sizeof(SM_STATE));
+
+	SetBEGIN (bridge, true);
 	RunStateMachines (bridge, timestamp);
-	bridge->BEGIN = false;
+	SetBEGIN (bridge, false);
 	RunStateMachines (bridge, timestamp);
 }
 
@@ -594,13 +1635,13 @@ static unsigned int GetInstanceCountForStateMachine (const SM_INFO* smInfo, unsi
 	}
 }
 
-static unsigned int GetInstanceCountForAllStateMachines (STP_BRIDGE* bridge)
+static unsigned int GetInstanceCountForAllStateMachines (const SM_INTERFACE* smInterface, unsigned int portCount, unsigned int treeCount)
 {
 	unsigned int count = 0;
-	for (unsigned int i = 0; i < bridge->smInterface->smInfoCount; i++)
-		count += GetInstanceCountForStateMachine (&bridge->smInterface->smInfo [i], bridge->portCount, (1 + bridge->mstiCount));
+	for (unsigned int i = 0; i < smInterface->smInfoCount; i++)
+		count += GetInstanceCountForStateMachine (&smInterface->smInfo [i], portCount, treeCount);
 
-	count += GetInstanceCountForStateMachine (bridge->smInterface->transmitSmInfo, bridge->portCount, (1 + bridge->mstiCount));
+	count += GetInstanceCountForStateMachine (smInterface->transmitSmInfo, portCount, treeCount);
 
 	return count;
 }
@@ -609,7 +1650,14 @@ static unsigned int GetInstanceCountForAllStateMachines (STP_BRIDGE* bridge)
 
 void STP_SetPortAdminEdge (STP_BRIDGE* bridge, unsigned int portIndex, unsigned int newAdminEdge, unsigned int timestamp)
 {
+	LOG (bridge, portIndex, -1, "{T}: Setting adminEdge = {D} on port {D}...\r\n", timestamp, newAdminEdge, 1 + portIndex);
+	TRACE (bridge, STP_TRACE_EVENT_PORT_ADMIN_EDGE_SET, portIndex, -1, timestamp, 0, 0, (unsigned char) newAdminEdge);
+
 	bridge->ports [portIndex]->AdminEdge = newAdminEdge;
+	bridge->markPortDirty (portIndex);
+
+	LOG (bridge, -1, -1, "------------------------------------\r\n");
+	FLUSH_LOG (bridge);
 }
 
 unsigned int STP_GetPortAdminEdge (const STP_BRIDGE* bridge, unsigned int portIndex)
@@ -621,7 +1669,14 @@ unsigned int STP_GetPortAdminEdge (const STP_BRIDGE* bridge, unsigned int portIn
 
 void STP_SetPortAutoEdge (STP_BRIDGE* bridge, unsigned int portIndex, unsigned int newAutoEdge, unsigned int timestamp)
 {
+	LOG (bridge, portIndex, -1, "{T}: Setting autoEdge = {D} on port {D}...\r\n", timestamp, newAutoEdge, 1 + portIndex);
+	TRACE (bridge, STP_TRACE_EVENT_PORT_AUTO_EDGE_SET, portIndex, -1, timestamp, 0, 0, (unsigned char) newAutoEdge);
+
 	bridge->ports [portIndex]->AutoEdge = newAutoEdge;
+	bridge->markPortDirty (portIndex);
+
+	LOG (bridge, -1, -1, "------------------------------------\r\n");
+	FLUSH_LOG (bridge);
 }
 
 unsigned int STP_GetPortAutoEdge (const STP_BRIDGE* bridge, unsigned int portIndex)
@@ -633,8 +1688,9 @@ unsigned int STP_GetPortAutoEdge (const STP_BRIDGE* bridge, unsigned int portInd
 
 void STP_SetPortAdminPointToPointMAC (STP_BRIDGE* bridge, unsigned int portIndex, STP_ADMIN_P2P adminPointToPointMAC, unsigned int timestamp)
 {
-	const char* p2pString = STP_GetAdminP2PString (adminPointToPointMAC);
-	LOG (bridge, portIndex, -1, "{T}: Setting adminPointToPointMAC = {S} on port {D}...\r\n", timestamp, p2pString, 1 + portIndex);
+	LOG (bridge, portIndex, -1, "{T}: Setting adminPointToPointMAC = {S} on port {D}...\r\n",
+		 timestamp, STP_GetAdminP2PString (adminPointToPointMAC), 1 + portIndex);
+	TRACE (bridge, STP_TRACE_EVENT_PORT_ADMIN_P2P_SET, portIndex, -1, timestamp, 0, 0, (unsigned char) adminPointToPointMAC);
 
 	PORT* port = bridge->ports [portIndex];
 
@@ -661,6 +1717,8 @@ void STP_SetPortAdminPointToPointMAC (STP_BRIDGE* bridge, unsigned int portIndex
 
 		// operPointToPointMAC has changed, and there's logic in the STP state machines that depends on it,
 		// but reruning the state machines here seems to me like overkill; they run anyway every second.
+		// We only mark the port, so its state machines get evaluated on the next run.
+		bridge->markPortDirty (portIndex);
 	}
 
 	LOG (bridge, -1, -1, "------------------------------------\r\n");
@@ -694,6 +1752,7 @@ static void RecomputePrioritiesAndPortRoles (STP_BRIDGE* bridge, unsigned int tr
 				PORT_TREE* portTree = bridge->ports [portIndex]->trees [treeIndex];
 				portTree->selected = false;
 				portTree->reselect = true;
+				bridge->updateSharedStateCounts (portIndex, treeIndex);
 			}
 		}
 	}
@@ -705,9 +1764,13 @@ static void RecomputePrioritiesAndPortRoles (STP_BRIDGE* bridge, unsigned int tr
 			PORT_TREE* portTree = bridge->ports [portIndex]->trees [treeIndex];
 			portTree->selected = false;
 			portTree->reselect = true;
+			bridge->updateSharedStateCounts (portIndex, treeIndex);
 		}
 	}
 
+	// selected is read by the PortTransmit machines of all ports, so this touches all ports and not only the given tree.
+	bridge->markAllDirty ();
+
 	RunStateMachines (bridge, timestamp);
 }
 
@@ -739,12 +1802,18 @@ void STP_SetBridgePriority (STP_BRIDGE* bridge, unsigned int treeIndex, unsigned
 		 bridgePriority);
 
 	BRIDGE_ID bid = bridge->trees [treeIndex]->GetBridgeIdentifier ();
+
+	TRACE (bridge, STP_TRACE_EVENT_BRIDGE_PRIORITY_SET, -1, treeIndex, timestamp, 0, 0, (unsigned char) (bridgePriority >> 12),
+		   (bid.GetPriority() != bridgePriority) ? 0 : STP_TRACE_FLAG_NOTHING_CHANGED);
+
 	if (bid.GetPriority() != bridgePriority)
 	{
 		LOG (bridge, -1, -1, "\r\n");
 
 		bid.SetPriority (bridgePriority, treeIndex);
 		bridge->trees [treeIndex]->SetBridgeIdentifier (bid);
+		bridge->markAllRootCandidatesDirty (treeIndex);
+		bridge->invalidateTxTemplates ();
 
 		bridge->callbacks.onConfigChanged (bridge, timestamp);
 
@@ -781,8 +1850,12 @@ void STP_SetPortPriority (STP_BRIDGE* bridge, unsigned int portIndex, unsigned i
 		 1 + portIndex,
 		 treeIndex,
 		 portPriority);
+	TRACE (bridge, STP_TRACE_EVENT_PORT_PRIORITY_SET, portIndex, treeIndex, timestamp, 0, 0, portPriority);
 
 	bridge->ports [portIndex]->trees [treeIndex]->portId.SetPriority (portPriority);
+	bridge->ports [portIndex]->trees [treeIndex]->txTemplateValid = false;
+	bridge->markRootCandidateDirty (portIndex, treeIndex);
+	bridge->trees [treeIndex]->designatedPrioritiesStale = true;
 
 	// It would make sense that stuff is recomputed also when the port priority in the portId variable
 	// is changed (as it is recomputed for the bridge priority), but either the spec does not mention this, or I'm not seeing it.
@@ -835,24 +1908,26 @@ void STP_SetMstConfigName (STP_BRIDGE* bridge, const char* name, unsigned int ti
 	assert (strlen (name) <= 32);
 
 	LOG (bridge, -1, -1, "{T}: Setting MST Config Name to \"{S}\"...\r\n", timestamp, name);
+	TRACE (bridge, STP_TRACE_EVENT_MST_CONFIG_NAME_SET, -1, -1, timestamp, 0, 0, 0);
 
 	memset (bridge->MstConfigId.ConfigurationName, 0, 32);
 	memcpy (bridge->MstConfigId.ConfigurationName, name, strlen (name));
+	bridge->invalidateTxTemplates ();
 
 	if (bridge->started)
 	{
 		if (bridge->ForceProtocolVersion >= STP_VERSION_MSTP)
 		{
-			bridge->BEGIN = true;
+			SetBEGIN (bridge, true);
 			RunStateMachines (bridge, timestamp);
-			bridge->BEGIN = false;
+			SetBEGIN (bridge, false);
 			RunStateMachines (bridge, timestamp);
 		}
 		else
 		{
-			STP_Indent(bridge);
+			LOG_INDENT (bridge);
 			LOG (bridge, -1, -1, "(This has no effect right now as the bridge isn't configured for MSTP.\r\n");
-			STP_Unindent(bridge);
+			LOG_UNINDENT (bridge);
 		}
 	}
 
@@ -867,24 +1942,26 @@ void STP_SetMstConfigName (STP_BRIDGE* bridge, const char* name, unsigned int ti
 void STP_SetMstConfigRevisionLevel (STP_BRIDGE* bridge, unsigned short revisionLevel, unsigned int timestamp)
 {
 	LOG (bridge, -1, -1, "{T}: Setting MST Config Revision Level to {D}...\r\n", timestamp, (int) revisionLevel);
+	TRACE (bridge, STP_TRACE_EVENT_MST_CONFIG_REVISION_LEVEL_SET, revisionLevel, -1, timestamp, 0, 0, 0);
 
 	bridge->MstConfigId.RevisionLevelHigh = revisionLevel >> 8;
 	bridge->MstConfigId.RevisionLevelLow = revisionLevel & 0xff;
+	bridge->invalidateTxTemplates ();
 
 	if (bridge->started)
 	{
 		if (bridge->ForceProtocolVersion >= STP_VERSION_MSTP)
 		{
-			bridge->BEGIN = true;
+			SetBEGIN (bridge, true);
 			RunStateMachines (bridge, timestamp);
-			bridge->BEGIN = false;
+			SetBEGIN (bridge, false);
 			RunStateMachines (bridge, timestamp);
 		}
 		else
 		{
-			STP_Indent(bridge);
+			LOG_INDENT (bridge);
 			LOG (bridge, -1, -1, "(This has no effect right now as the bridge isn't configured for MSTP.\r\n");
-			STP_Unindent(bridge);
+			LOG_UNINDENT (bridge);
 		}
 	}
 
@@ -894,19 +1971,78 @@ void STP_SetMstConfigRevisionLevel (STP_BRIDGE* bridge, unsigned short revisionL
 	FLUSH_LOG (bridge);
 }
 
-static void ComputeMstConfigDigest (STP_BRIDGE* bridge)
+// The digest covers a table of 4096 entries, of which only those up to maxVlanNumber can be non-zero. We keep
+// the state of the computation at the start of each 64-byte block of our table, so that after a change we hash
+// again only from the block holding firstChangedVlan. The zero entries past maxVlanNumber are hashed as whole
+// blocks of zeroes, which is much faster than feeding them to HMAC_MD5_Update.
+static void ComputeMstConfigDigest (STP_BRIDGE* bridge, unsigned int firstChangedVlan)
 {
+	assert (firstChangedVlan <= bridge->maxVlanNumber);
+
+	const unsigned char* table = (const unsigned char*) bridge->mstConfigTable;
+	unsigned int tableSize = 2 * (1 + bridge->maxVlanNumber);
+	unsigned int wholeBlockCount = tableSize / 64;
+	unsigned int block = 2 * firstChangedVlan / 64;
+
 	HMAC_MD5_CONTEXT context;
-	HMAC_MD5_Init (&context);
-	HMAC_MD5_Update (&context, bridge->mstConfigTable, 2 * (1 + bridge->maxVlanNumber));
+	if (block == 0)
+	{
+		HMAC_MD5_Init (&context);
+		HMAC_MD5_GetState (&context, bridge->mstConfigDigestStates [0]);
+	}
+	else
+		HMAC_MD5_SetState (&context, bridge->mstConfigDigestStates [block], block * 64);
 
-	unsigned short zero = 0;
-	for (int i = (1 + bridge->maxVlanNumber); i < 4096; i++)
-		HMAC_MD5_Update (&context, &zero, 2);
+	for (; block < wholeBlockCount; block++)
+	{
+		HMAC_MD5_Update (&context, &table [block * 64], 64);
+		HMAC_MD5_GetState (&context, bridge->mstConfigDigestStates [block + 1]);
+	}
 
+	HMAC_MD5_Update (&context, &table [wholeBlockCount * 64], tableSize - wholeBlockCount * 64);
+	HMAC_MD5_UpdateWithZeroes (&context, 2 * 4096 - tableSize);
 	HMAC_MD5_End (&context);
 
 	memcpy (bridge->MstConfigId.ConfigurationDigest, context.digest, 16);
+	bridge->invalidateTxTemplates ();
+}
+
+// Sets the bits of VLANs 1 to maxVlanNumber and clears the others, a whole byte at a time.
+static void SetAllVlansInBitmap (const STP_BRIDGE* bridge, unsigned char* bitmap)
+{
+	memset (bitmap, 0xFF, bridge->vlanBitmapSize);
+	bitmap [0] &= (unsigned char) ~1;
+	bitmap [bridge->vlanBitmapSize - 1] &= (unsigned char) (0xFF >> (7 - bridge->maxVlanNumber % 8));
+}
+
+// Maps a VLAN to a tree, keeping vlanBitmaps in sync with mstConfigTable.
+static void SetVlanTreeIndex (STP_BRIDGE* bridge, unsigned int vlanNumber, unsigned int treeIndex)
+{
+	unsigned int oldTreeIndex = bridge->mstConfigTable [vlanNumber].GetValue ();
+	unsigned char mask = (unsigned char) (1 << (vlanNumber % 8));
+	bridge->vlanBitmaps [oldTreeIndex * bridge->vlanBitmapSize + vlanNumber / 8] &= (unsigned char) ~mask;
+	bridge->vlanBitmaps [treeIndex * bridge->vlanBitmapSize + vlanNumber / 8] |= mask;
+	bridge->mstConfigTable [vlanNumber] = (unsigned short) treeIndex;
+}
+
+static void OnMstConfigTableChanged (STP_BRIDGE* bridge, unsigned int firstChangedVlan, unsigned int timestamp)
+{
+	unsigned char previousDigest [16];
+	memcpy (previousDigest, bridge->MstConfigId.ConfigurationDigest, 16);
+
+	ComputeMstConfigDigest (bridge, firstChangedVlan);
+
+	LOG (bridge, -1, -1, "New digest: 0x{X2}{X2}...{X2}{X2}.\r\n",
+		 bridge->MstConfigId.ConfigurationDigest[0], bridge->MstConfigId.ConfigurationDigest[1],
+		 bridge->MstConfigId.ConfigurationDigest[14], bridge->MstConfigId.ConfigurationDigest[15]);
+
+	bridge->rebuildPortVlanBitmaps ();
+
+	// Only the digest goes out in BPDUs, so the state machines don't need to know about the table otherwise.
+	if (bridge->started && (memcmp (previousDigest, bridge->MstConfigId.ConfigurationDigest, 16) != 0))
+		RestartStateMachines(bridge, timestamp);
+
+	bridge->callbacks.onConfigChanged (bridge, timestamp);
 }
 
 void STP_SetMstConfigTable (struct STP_BRIDGE* bridge, const STP_CONFIG_TABLE_ENTRY* entries, unsigned int entryCount, unsigned int timestamp)
@@ -915,7 +2051,11 @@ void STP_SetMstConfigTable (struct STP_BRIDGE* bridge, const STP_CONFIG_TABLE_EN
 
 	LOG (bridge, -1, -1, "{T}: Setting MST Config Table... ", timestamp);
 
-	if (memcmp (bridge->mstConfigTable, entries, entryCount * 2) == 0)
+	bool changed = (memcmp (bridge->mstConfigTable, entries, entryCount * 2) != 0);
+
+	TRACE (bridge, STP_TRACE_EVENT_MST_CONFIG_TABLE_SET, -1, -1, timestamp, 0, 0, 0, changed ? 0 : STP_TRACE_FLAG_NOTHING_CHANGED);
+
+	if (!changed)
 	{
 		LOG (bridge, -1, -1, "... nothing changed.\r\n");
 	}
@@ -927,24 +2067,62 @@ void STP_SetMstConfigTable (struct STP_BRIDGE* bridge, const STP_CONFIG_TABLE_EN
 		for (unsigned int vlan = 1; vlan < entryCount; vlan++)
 		{
 			assert (entries[vlan].unused == 0);
-			assert (entries[vlan].treeIndex < (1 + bridge->mstiCount));
+			assert (entries[vlan].treeIndex < bridge->allocatedTreeCount());
 		}
 
 		if (entryCount == 4096)
 			assert (entries[4095].treeIndex == 0);
 
-		memcpy (bridge->mstConfigTable, entries, entryCount * 2);
+		unsigned int firstChangedVlan = 0;
+		while (memcmp (&bridge->mstConfigTable [firstChangedVlan], &entries [firstChangedVlan], 2) == 0)
+			firstChangedVlan++;
 
-		ComputeMstConfigDigest (bridge);
+		for (unsigned int vlan = firstChangedVlan; vlan < entryCount; vlan++)
+		{
+			if (memcmp (&bridge->mstConfigTable [vlan], &entries [vlan], 2) != 0)
+				SetVlanTreeIndex (bridge, vlan, entries [vlan].treeIndex);
+		}
 
-		LOG (bridge, -1, -1, "New digest: 0x{X2}{X2}...{X2}{X2}.\r\n",
-			 bridge->MstConfigId.ConfigurationDigest[0], bridge->MstConfigId.ConfigurationDigest[1],
-			 bridge->MstConfigId.ConfigurationDigest[14], bridge->MstConfigId.ConfigurationDigest[15]);
+		OnMstConfigTableChanged (bridge, firstChangedVlan, timestamp);
+	}
 
-		if (bridge->started)
-			RestartStateMachines(bridge, timestamp);
+	LOG (bridge, -1, -1, "------------------------------------\r\n");
+	FLUSH_LOG (bridge);
+}
 
-		bridge->callbacks.onConfigChanged (bridge, timestamp);
+void STP_SetMstConfigTableEntries (STP_BRIDGE* bridge, unsigned int firstVlanNumber, unsigned int vlanCount, const unsigned char* treeIndexes, unsigned int timestamp)
+{
+	assert (firstVlanNumber >= 1);
+	assert (firstVlanNumber + vlanCount <= 1 + bridge->maxVlanNumber);
+
+	LOG (bridge, -1, -1, "{T}: Setting MST Config Table entries for VLANs {D} to {D}... ", timestamp, firstVlanNumber, firstVlanNumber + vlanCount - 1);
+
+	unsigned int firstChangedVlan = 0;
+	for (unsigned int i = 0; i < vlanCount; i++)
+	{
+		// Check that the caller is not trying to map a VLAN to a too-large tree number.
+		assert (treeIndexes [i] < (1 + bridge->mstiCount));
+
+		if (bridge->mstConfigTable [firstVlanNumber + i].GetValue () != treeIndexes [i])
+		{
+			if (firstChangedVlan == 0)
+				firstChangedVlan = firstVlanNumber + i;
+
+			SetVlanTreeIndex (bridge, firstVlanNumber + i, treeIndexes [i]);
+		}
+	}
+
+	unsigned int lastVlanNumber = firstVlanNumber + vlanCount - 1;
+	TRACE (bridge, STP_TRACE_EVENT_MST_CONFIG_TABLE_ENTRIES_SET, firstVlanNumber, -1, timestamp,
+		   (unsigned char) (lastVlanNumber >> 8), (unsigned char) lastVlanNumber, 0, (firstChangedVlan != 0) ? 0 : STP_TRACE_FLAG_NOTHING_CHANGED);
+
+	if (firstChangedVlan == 0)
+	{
+		LOG (bridge, -1, -1, "... nothing changed.\r\n");
+	}
+	else
+	{
+		OnMstConfigTableChanged (bridge, firstChangedVlan, timestamp);
 	}
 
 	LOG (bridge, -1, -1, "------------------------------------\r\n");
@@ -977,6 +2155,8 @@ enum STP_VERSION STP_GetStpVersion (const STP_BRIDGE* bridge)
 void STP_SetStpVersion (STP_BRIDGE* bridge, enum STP_VERSION version, unsigned int timestamp)
 {
 	LOG (bridge, -1, -1, "{T}: Switching to {S}... ", timestamp, STP_GetVersionString(version));
+	TRACE (bridge, STP_TRACE_EVENT_STP_VERSION_SET, -1, -1, timestamp, 0, 0, (unsigned char) version,
+		   (bridge->ForceProtocolVersion != version) ? 0 : STP_TRACE_FLAG_NOTHING_CHANGED);
 
 	if (bridge->ForceProtocolVersion == version)
 	{
@@ -987,9 +2167,13 @@ void STP_SetStpVersion (STP_BRIDGE* bridge, enum STP_VERSION version, unsigned i
 		LOG (bridge, -1, -1, "\r\n");
 
 		bridge->ForceProtocolVersion = version;
+		bridge->invalidateTxTemplates ();
+		bridge->rebuildPortVlanBitmaps ();
 
 		if (bridge->started)
 			RestartStateMachines (bridge, timestamp);
+		else
+			PublishSnapshot (bridge);
 
 		bridge->callbacks.onConfigChanged(bridge, timestamp);
 	}
@@ -1055,6 +2239,55 @@ unsigned int STP_GetTreeIndexFromVlanNumber (const STP_BRIDGE* bridge, unsigned
 	}
 }
 
+void STP_GetTreeIndexesFromVlanNumbers (const STP_BRIDGE* bridge, unsigned int firstVlanNumber, unsigned int vlanCount, unsigned char* treeIndexesOut)
+{
+	assert (firstVlanNumber + vlanCount <= 1 + bridge->maxVlanNumber);
+
+	if (bridge->ForceProtocolVersion < STP_VERSION_MSTP)
+	{
+		memset (treeIndexesOut, 0, vlanCount);
+	}
+	else
+	{
+		// Tree indexes are at most 64, so the high byte of each entry is zero and we can copy the low byte alone.
+		const STP_CONFIG_TABLE_ENTRY* entries = (const STP_CONFIG_TABLE_ENTRY*) &bridge->mstConfigTable [firstVlanNumber];
+		for (unsigned int i = 0; i < vlanCount; i++)
+			treeIndexesOut [i] = entries [i].treeIndex;
+	}
+}
+
+const unsigned char* STP_GetVlanBitmapForTree (const STP_BRIDGE* bridge, unsigned int treeIndex, unsigned int* bitmapSizeOut)
+{
+	assert (treeIndex < bridge->treeCount ());
+
+	*bitmapSizeOut = bridge->vlanBitmapSize;
+
+	return bridge->getVlanBitmap (treeIndex);
+}
+
+const unsigned char* STP_GetForwardingVlanBitmapForPort (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int* bitmapSizeOut)
+{
+	assert (portIndex < bridge->portCount);
+
+	*bitmapSizeOut = bridge->vlanBitmapSize;
+	return bridge->ports [portIndex]->forwardingVlans;
+}
+
+const unsigned char* STP_GetLearningVlanBitmapForPort (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int* bitmapSizeOut)
+{
+	assert (portIndex < bridge->portCount);
+
+	*bitmapSizeOut = bridge->vlanBitmapSize;
+	return bridge->ports [portIndex]->learningVlans;
+}
+
+unsigned int STP_GetVlanBitmapGenerationForPort (const STP_BRIDGE* bridge, unsigned int portIndex)
+{
+	assert (portIndex < bridge->portCount);
+
+	return bridge->ports [portIndex]->vlanBitmapGeneration;
+}
+
 const struct STP_MST_CONFIG_ID* STP_GetMstConfigId (const struct STP_BRIDGE* bridge)
 {
 	return &bridge->MstConfigId;
@@ -1140,6 +2373,7 @@ void STP_GetRootTimes (const STP_BRIDGE* bridge,
 					   unsigned char* remainingHopsOutOrNull)
 {
 	// This retrieves the rootTimes variable described in 13.24.9 in 802.1Q-2011.
+	// The library keeps times in 1/256 s; we return them in whole seconds, as this function always did.
 	// These values are meaningful only as long as the bridge is running, hence the following assert.
 	assert (bridge->started);
 
@@ -1149,16 +2383,16 @@ void STP_GetRootTimes (const STP_BRIDGE* bridge,
 	BRIDGE_TREE* tree = bridge->trees [treeIndex];
 
 	if (forwardDelayOutOrNull != NULL)
-		*forwardDelayOutOrNull = tree->rootTimes.ForwardDelay;
+		*forwardDelayOutOrNull = tree->rootTimes.ForwardDelay / 256;
 
 	if (helloTimeOutOrNull != NULL)
-		*helloTimeOutOrNull = tree->rootTimes.HelloTime;
+		*helloTimeOutOrNull = tree->rootTimes.HelloTime / 256;
 
 	if (maxAgeOutOrNull != NULL)
-		*maxAgeOutOrNull = tree->rootTimes.MaxAge;
+		*maxAgeOutOrNull = tree->rootTimes.MaxAge / 256;
 
 	if (messageAgeOutOrNull != NULL)
-		*messageAgeOutOrNull = tree->rootTimes.MessageAge;
+		*messageAgeOutOrNull = tree->rootTimes.MessageAge / 256;
 
 	if (remainingHopsOutOrNull != NULL)
 		*remainingHopsOutOrNull = tree->rootTimes.remainingHops;
@@ -1195,6 +2429,7 @@ void* STP_GetApplicationContext (const STP_BRIDGE* bridge)
 
 // ============================================================================
 
+#if STP_USE_LOG
 void STP_MST_CONFIG_ID::Dump (STP_BRIDGE* bridge, int port, int tree) const
 {
 	char namesz [33];
@@ -1205,6 +2440,7 @@ void STP_MST_CONFIG_ID::Dump (STP_BRIDGE* bridge, int port, int tree) const
 		 (RevisionLevelHigh << 8) | RevisionLevelLow,
 		 ConfigurationDigest [0], ConfigurationDigest [1], ConfigurationDigest [14], ConfigurationDigest [15]);
 }
+#endif
 
 // ============================================================================
 
@@ -44,6 +44,14 @@ typedef void  (*STP_CALLBACK_CONFIG_CHANGED)                (const struct STP_BR
 typedef void* (*STP_CALLBACK_ALLOC_AND_ZERO_MEMORY) (unsigned int size);
 typedef void  (*STP_CALLBACK_FREE_MEMORY) (void* p);
 
+struct STP_TRANSMITTED_BPDU
+{
+	unsigned int portIndex;
+	const unsigned char* bpdu;
+	unsigned int bpduSize;
+};
+typedef void  (*STP_CALLBACK_TRANSMIT_BATCH)				(const struct STP_BRIDGE* bridge, const struct STP_TRANSMITTED_BPDU* entries, unsigned int entryCount, unsigned int timestamp);
+
 struct STP_CALLBACKS
 {
 	STP_CALLBACK_ENABLE_LEARNING			 enableLearning;
@@ -58,6 +66,10 @@ struct STP_CALLBACKS
 	STP_CALLBACK_CONFIG_CHANGED              onConfigChanged;
 	STP_CALLBACK_ALLOC_AND_ZERO_MEMORY		 allocAndZeroMemory;
 	STP_CALLBACK_FREE_MEMORY				 freeMemory;
+
+	// Optional. When not NULL, the library passes to it all BPDUs generated by one run of the state machines,
+	// instead of calling transmitGetBuffer and transmitReleaseBuffer for each of them.
+	STP_CALLBACK_TRANSMIT_BATCH				 transmitBatch;
 };
 
 // 6.6.3 Point-to-point parameters
@@ -102,6 +114,116 @@ struct STP_BRIDGE_ADDRESS
 	#endif
 };
 
+// Binary event trace, see STP_SetTraceBuffer.
+enum STP_TRACE_EVENT
+{
+	STP_TRACE_EVENT_BRIDGE_STARTED = 1,
+	STP_TRACE_EVENT_BRIDGE_STOPPED,
+	STP_TRACE_EVENT_PORT_ENABLED,
+	STP_TRACE_EVENT_PORT_DISABLED,
+	STP_TRACE_EVENT_ONE_SECOND_TICK,
+	STP_TRACE_EVENT_BPDU_RECEIVED,		// value: BPDU type, as returned by STP_GetValidatedBpduType
+	STP_TRACE_EVENT_BPDU_TRANSMITTED,	// value: BPDU type, as returned by STP_GetValidatedBpduType
+	STP_TRACE_EVENT_STATE_CHANGED,		// machine, state; value: ForceProtocolVersion
+	STP_TRACE_EVENT_TIMER_TICK,			// value: length of the tick in timer units (seconds, or 1/256 s with millisecond timers), at most 255
+	STP_TRACE_EVENT_BRIDGE_ADDRESS_SET,	// port (big-endian), tree, machine, state, value: the six bytes of the address
+	STP_TRACE_EVENT_BRIDGE_PRIORITY_SET,	// tree; value: priority / 4096
+	STP_TRACE_EVENT_PORT_PRIORITY_SET,	// port, tree; value: priority
+	STP_TRACE_EVENT_STP_VERSION_SET,	// value: STP_VERSION
+	STP_TRACE_EVENT_HELLO_TIME_SET,		// port: hello time in milliseconds
+	STP_TRACE_EVENT_MST_CONFIG_NAME_SET,	// the name itself is not in the trace
+	STP_TRACE_EVENT_MST_CONFIG_REVISION_LEVEL_SET,	// port: revision level
+	STP_TRACE_EVENT_MST_CONFIG_TABLE_SET,
+	STP_TRACE_EVENT_MST_CONFIG_TABLE_ENTRIES_SET,	// port: first VLAN number; machine, state: high and low byte of the last VLAN number
+	STP_TRACE_EVENT_PORT_ADMIN_EDGE_SET,	// port; value: adminEdge
+	STP_TRACE_EVENT_PORT_AUTO_EDGE_SET,	// port; value: autoEdge
+	STP_TRACE_EVENT_PORT_ADMIN_P2P_SET,	// port; value: STP_ADMIN_P2P
+};
+
+// Flags of a trace record.
+#define STP_TRACE_FLAG_NOTHING_CHANGED 1	// the API call set a value equal to the current one
+
+struct STP_TRACE_RECORD
+{
+	unsigned int   timestamp;
+	unsigned short port;	// 0xFFFF if the event is not specific to a port
+	unsigned char  event;	// STP_TRACE_EVENT
+	unsigned char  tree;	// 0xFF if the event is not specific to a tree
+	unsigned char  machine;	// index of the state machine for STP_TRACE_EVENT_STATE_CHANGED; see STP_TRACE_EVENT for the others
+	unsigned char  state;	// new state of the state machine for STP_TRACE_EVENT_STATE_CHANGED; see STP_TRACE_EVENT for the others
+	unsigned char  value;
+	unsigned char  flags;	// STP_TRACE_FLAG_xxx
+};
+
+// The trace buffer starts with this header, followed by recordCapacity records used as a ring.
+// The library writes the next record at index nextRecordIndex. The oldest record is at index nextRecordIndex if wrapped is set,
+// and at index 0 otherwise. (recordsWritten is only a statistic: it wraps at 2^32, so the oldest record can't be computed from it.)
+struct STP_TRACE_HEADER
+{
+	unsigned int recordCapacity;
+	unsigned int recordsWritten;
+	unsigned int nextRecordIndex;
+	unsigned int wrapped;	// set when the first record was overwritten, never cleared afterwards
+};
+
+// Snapshot of the operational state, see STP_SetSnapshotBuffer. The snapshot buffer starts with this header, followed by
+// treeCount STP_SNAPSHOT_TREE, then portCount STP_SNAPSHOT_PORT, then portCount * treeCount STP_SNAPSHOT_PORT_TREE
+// (the trees of port 0, then those of port 1 and so on). Read it with STP_ReadSnapshot.
+struct STP_SNAPSHOT_HEADER
+{
+	unsigned int  sequence;		// odd while the library is updating the snapshot
+	unsigned int  portCount;
+	unsigned int  treeCount;	// 1 + mstiCount; only the CIST is meaningful when stpVersion is not MSTP
+	unsigned char started;
+	unsigned char stpVersion;	// STP_VERSION
+	unsigned char reserved[2];
+};
+
+struct STP_SNAPSHOT_TREE
+{
+	unsigned char  rootPriorityVector[36];	// as returned by STP_GetRootPriorityVector
+	unsigned short forwardDelay;			// this and the following as returned by STP_GetRootTimes
+	unsigned short helloTime;
+	unsigned short maxAge;
+	unsigned short messageAge;
+	unsigned char  remainingHops;
+	unsigned char  reserved[3];
+};
+
+struct STP_SNAPSHOT_PORT
+{
+	unsigned char enabled;
+	unsigned char operEdge;
+	unsigned char operPointToPointMAC;
+	unsigned char reserved;
+};
+
+struct STP_SNAPSHOT_PORT_TREE
+{
+	unsigned char role;			// STP_PORT_ROLE
+	unsigned char learning;
+	unsigned char forwarding;
+	unsigned char reserved;
+};
+
+// Memory used by a bridge, in bytes, see STP_GetMemoryFootprint. The members up to and including block break down
+// the block allocated by STP_CreateBridge; each part includes the alignment padding before it.
+struct STP_MEMORY_FOOTPRINT
+{
+	unsigned int bridge;			// per-bridge and per-bridge per-tree variables
+	unsigned int ports;				// per-port variables
+	unsigned int portTrees;			// per-port per-tree variables, except for the timers
+	unsigned int portTreeTimers;	// per-port per-tree timers
+	unsigned int stateMachines;		// states of the state machines, and the lists used to schedule them
+	unsigned int mstConfigTable;	// MST Configuration Table and the partial state of its digest
+	unsigned int txTemplates;		// images of the last BPDU transmitted on each port
+	unsigned int vlanBitmaps;		// forwarding and learning VLAN bitmaps of the trees and ports
+	unsigned int block;				// size of the whole block, same as STP_GetRequiredMemorySize
+	unsigned int logBuffer;			// allocated separately; zero when the library is compiled without logging
+	unsigned int transmitBatch;		// allocated separately when the transmitBatch callback is not NULL
+	unsigned int total;
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -114,6 +236,10 @@ struct STP_BRIDGE* STP_CreateBridge (unsigned int portCount,
 									 unsigned int debugLogBufferSize);
 void STP_DestroyBridge (struct STP_BRIDGE* bridge);
 
+// Size of the memory block that STP_CreateBridge will request via the allocAndZeroMemory callback (the debug log buffer is allocated separately).
+unsigned int STP_GetRequiredMemorySize (unsigned int portCount, unsigned int mstiCount, unsigned int maxVlanNumber);
+void STP_GetMemoryFootprint (const struct STP_BRIDGE* bridge, struct STP_MEMORY_FOOTPRINT* footprintOut);
+
 void STP_StartBridge (struct STP_BRIDGE* bridge, unsigned int timestamp);
 void STP_StopBridge (struct STP_BRIDGE* bridge, unsigned int timestamp);
 unsigned int STP_IsBridgeStarted (const struct STP_BRIDGE* bridge);
@@ -121,6 +247,12 @@ unsigned int STP_IsBridgeStarted (const struct STP_BRIDGE* bridge);
 void STP_EnableLogging (struct STP_BRIDGE* bridge, unsigned int enable);
 unsigned int STP_IsLoggingEnabled (const struct STP_BRIDGE* bridge);
 
+void STP_SetTraceBuffer (struct STP_BRIDGE* bridge, void* buffer, unsigned int bufferSize);
+
+unsigned int STP_GetSnapshotBufferSize (unsigned int portCount, unsigned int mstiCount);
+void STP_SetSnapshotBuffer (struct STP_BRIDGE* bridge, void* buffer);
+unsigned int STP_ReadSnapshot (const void* buffer, void* copyOut, unsigned int bufferSize);
+
 unsigned int STP_GetPortCount (const struct STP_BRIDGE* bridge);
 unsigned int STP_GetMstiCount (const struct STP_BRIDGE* bridge);
 
@@ -130,6 +262,16 @@ void STP_SetStpVersion (struct STP_BRIDGE* bridge, enum STP_VERSION version, uns
 // Call this when you receive a BPDU.
 void STP_OnBpduReceived (struct STP_BRIDGE* bridge, unsigned int portIndex, const unsigned char* bpdu, unsigned int bpduSize, unsigned int timestamp);
 
+// Call this instead of STP_OnBpduReceived when you have several BPDUs at hand, for instance when draining a receive queue.
+// The BPDUs are processed one at a time, in order, as by STP_OnBpduReceived, but the transmissions wait for the end.
+struct STP_RECEIVED_BPDU
+{
+	unsigned int portIndex;
+	const unsigned char* bpdu;
+	unsigned int bpduSize;
+};
+void STP_OnBpdusReceived (struct STP_BRIDGE* bridge, const struct STP_RECEIVED_BPDU* entries, unsigned int entryCount, unsigned int timestamp);
+
 // Call this every time the bridge's MAC address changes while STP is running.
 void STP_SetBridgeAddress (struct STP_BRIDGE* bridge, const unsigned char* address, unsigned int timestamp);
 const struct STP_BRIDGE_ADDRESS* STP_GetBridgeAddress (const struct STP_BRIDGE* bridge);
@@ -140,6 +282,21 @@ void STP_OnPortDisabled (struct STP_BRIDGE* bridge, unsigned int portIndex, unsi
 
 void STP_OnOneSecondTick (struct STP_BRIDGE* bridge, unsigned int timestamp);
 
+// For applications that don't want to wake up every second. STP_GetNextDeadline returns after how many seconds the next
+// timer expires (0 if none is running); until then, ticks only count down timers. STP_OnSecondsElapsed then does
+// the work of that many calls to STP_OnOneSecondTick, with a single run of the state machines for the ticks before each deadline.
+unsigned int STP_GetNextDeadline (const struct STP_BRIDGE* bridge);
+void STP_OnSecondsElapsed (struct STP_BRIDGE* bridge, unsigned int seconds, unsigned int timestamp);
+
+// With millisecond timers the state machine timers count in 1/256 s instead of seconds, the Hello Time can be
+// shorter than a second, and STP_GetNextDeadline returns milliseconds. Call STP_OnTimerTick as often as the
+// resolution you need; it works without millisecond timers too, applying whole seconds only.
+void         STP_EnableMillisecondTimers (struct STP_BRIDGE* bridge, unsigned int enable);
+unsigned int STP_AreMillisecondTimersEnabled (const struct STP_BRIDGE* bridge);
+void         STP_OnTimerTick (struct STP_BRIDGE* bridge, unsigned int milliseconds, unsigned int timestamp);
+void         STP_SetHelloTime (struct STP_BRIDGE* bridge, unsigned int helloTimeMilliseconds, unsigned int timestamp);
+unsigned int STP_GetHelloTime (const struct STP_BRIDGE* bridge);
+
 // 0-61440 in steps of 4096
 void           STP_SetBridgePriority (struct STP_BRIDGE* bridge, unsigned int treeIndex, unsigned short bridgePriority, unsigned int timestamp);
 unsigned short STP_GetBridgePriority (const struct STP_BRIDGE* bridge, unsigned int treeIndex);
@@ -176,9 +333,15 @@ struct STP_CONFIG_TABLE_ENTRY
 };
 
 void STP_SetMstConfigTable (struct STP_BRIDGE* bridge, const struct STP_CONFIG_TABLE_ENTRY* entries, unsigned int entryCount, unsigned int timestamp);
+void STP_SetMstConfigTableEntries (struct STP_BRIDGE* bridge, unsigned int firstVlanNumber, unsigned int vlanCount, const unsigned char* treeIndexes, unsigned int timestamp);
 const struct STP_CONFIG_TABLE_ENTRY* STP_GetMstConfigTable (struct STP_BRIDGE* bridge, unsigned int* entryCountOut);
 unsigned int STP_GetMaxVlanNumber (const struct STP_BRIDGE* bridge);
 unsigned int STP_GetTreeIndexFromVlanNumber (const struct STP_BRIDGE* bridge, unsigned int vlanNumber);
+void STP_GetTreeIndexesFromVlanNumbers (const struct STP_BRIDGE* bridge, unsigned int firstVlanNumber, unsigned int vlanCount, unsigned char* treeIndexesOut);
+const unsigned char* STP_GetVlanBitmapForTree (const struct STP_BRIDGE* bridge, unsigned int treeIndex, unsigned int* bitmapSizeOut);
+const unsigned char* STP_GetForwardingVlanBitmapForPort (const struct STP_BRIDGE* bridge, unsigned int portIndex, unsigned int* bitmapSizeOut);
+const unsigned char* STP_GetLearningVlanBitmapForPort (const struct STP_BRIDGE* bridge, unsigned int portIndex, unsigned int* bitmapSizeOut);
+unsigned int STP_GetVlanBitmapGenerationForPort (const struct STP_BRIDGE* bridge, unsigned int portIndex);
 const struct STP_MST_CONFIG_ID* STP_GetMstConfigId (const struct STP_BRIDGE* bridge);
 
 const char* STP_GetPortRoleString (enum STP_PORT_ROLE portRole);
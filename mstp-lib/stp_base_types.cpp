@@ -8,7 +8,7 @@
 
 // ============================================================================
 // Does the same as memcmp, but used because the IAR implementation of memcmp has a bug.
-int Cmp (const void* _p1, const void* _p2, int size)
+static int CmpBytes (const void* _p1, const void* _p2, int size)
 {
     const unsigned char* p1 = (const unsigned char*) _p1;
     const unsigned char* p2 = (const unsigned char*) _p2;
@@ -28,6 +28,116 @@ int Cmp (const void* _p1, const void* _p2, int size)
     return 0;
 }
 
+// ============================================================================
+// Fast path for Cmp on compilers for which we know how to load a 64-bit big-endian value: compare eight bytes
+// at a time, and only when two words differ, look at their numeric values to see which one is greater.
+// Priority vectors (34 bytes) are compared in the tight per-port loops of updtRolesTree and betterorsameInfo.
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+	#define STP_CMP_WORDS
+	#define STP_CMP_BSWAP64(x) __builtin_bswap64(x)
+#elif defined(__GNUC__) && defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+	#define STP_CMP_WORDS
+	#define STP_CMP_BSWAP64(x) (x)
+#elif defined(_MSC_VER)
+	#include <stdlib.h>
+	#define STP_CMP_WORDS
+	#define STP_CMP_BSWAP64(x) _byteswap_uint64(x)
+#endif
+
+#ifdef STP_CMP_WORDS
+#include <string.h>
+
+static int CmpWords (const void* _p1, const void* _p2, int size)
+{
+	const unsigned char* p1 = (const unsigned char*) _p1;
+	const unsigned char* p2 = (const unsigned char*) _p2;
+
+	for (; size >= 8; size -= 8, p1 += 8, p2 += 8)
+	{
+		// memcpy because the structures we compare are not aligned; compilers turn it into a single load.
+		unsigned long long w1, w2;
+		memcpy (&w1, p1, 8);
+		memcpy (&w2, p2, 8);
+		if (w1 != w2)
+			return (STP_CMP_BSWAP64(w1) > STP_CMP_BSWAP64(w2)) ? 1 : -1;
+	}
+
+	return CmpBytes (p1, p2, size);
+}
+#endif
+
+// ============================================================================
+
+int Cmp (const void* _p1, const void* _p2, int size)
+{
+#ifdef STP_CMP_WORDS
+	int result = CmpWords (_p1, _p2, size);
+
+	// Define STP_CROSS_CHECK_CMP to check the fast path against the byte-by-byte comparison.
+	#ifdef STP_CROSS_CHECK_CMP
+	assert (result == CmpBytes (_p1, _p2, size));
+	#endif
+
+	return result;
+#else
+	return CmpBytes (_p1, _p2, size);
+#endif
+}
+
+// ============================================================================
+
+static unsigned long long LoadBigEndian64 (const unsigned char* p)
+{
+#ifdef STP_CMP_WORDS
+	unsigned long long w;
+	memcpy (&w, p, 8);
+	return STP_CMP_BSWAP64(w);
+#else
+	unsigned long long w = 0;
+	for (int i = 0; i < 8; i++)
+		w = (w << 8) | p [i];
+	return w;
+#endif
+}
+
+static unsigned int LoadBigEndian32 (const unsigned char* p)
+{
+	return ((unsigned int) p [0] << 24) | ((unsigned int) p [1] << 16) | ((unsigned int) p [2] << 8) | p [3];
+}
+
+// p points to the 22 bytes of an MSTI_PRIORITY_VECTOR, or to the last 22 bytes of a PRIORITY_VECTOR.
+static void SetMstiKey (MSTI_PRIORITY_VECTOR_KEY* key, const unsigned char* p)
+{
+	key->words [0] = LoadBigEndian64 (&p [0]);
+	key->words [1] = LoadBigEndian64 (&p [8]);
+	key->words [2] = ((unsigned long long) LoadBigEndian32 (&p [16]) << 16) | (unsigned long long) ((p [20] << 8) | p [21]);
+}
+
+// p points to the 12 bytes of a CIST_PRIORITY_PREFIX, or to the first 12 bytes of a PRIORITY_VECTOR.
+static void SetPrefixKey (CIST_PRIORITY_PREFIX_KEY* key, const unsigned char* p)
+{
+	key->rootId = LoadBigEndian64 (&p [0]);
+	key->externalRootPathCost = LoadBigEndian32 (&p [8]);
+}
+
+void MSTI_PRIORITY_VECTOR_KEY::Set (const MSTI_PRIORITY_VECTOR& vector)
+{
+	SetMstiKey (this, (const unsigned char*) &vector);
+}
+
+void CIST_PRIORITY_PREFIX_KEY::Set (const CIST_PRIORITY_PREFIX& prefix)
+{
+	SetPrefixKey (this, (const unsigned char*) &prefix);
+}
+
+void PRIORITY_VECTOR_KEY::Set (const PRIORITY_VECTOR& vector)
+{
+	const unsigned char* p = (const unsigned char*) &vector;
+
+	SetPrefixKey (&prefix, &p [0]);
+	SetMstiKey (&msti, &p [sizeof (CIST_PRIORITY_PREFIX)]);
+}
+
 // ============================================================================
 
 bool STP_BRIDGE_ADDRESS::operator== (const STP_BRIDGE_ADDRESS& rhs) const
@@ -82,13 +192,13 @@ void PORT_ID::Reset ()
 
 unsigned char PORT_ID::GetPriority () const
 {
-	assert (_low != 0); // structure was not initialized; it must have been initialized with Set()
+	assert (IsInitialized ()); // structure was not initialized; it must have been initialized with Set()
 	return _high & 0xF0;
 }
 
 void PORT_ID::SetPriority (unsigned char priority)
 {
-	assert (_low != 0); // structure was not initialized; it must have been initialized with Set()
+	assert (IsInitialized ()); // structure was not initialized; it must have been initialized with Set()
 	assert ((priority & 0x0F) == 0);
 
 	_high = priority | (_high & 0x0F);
@@ -96,14 +206,14 @@ void PORT_ID::SetPriority (unsigned char priority)
 
 unsigned short PORT_ID::GetPortNumber () const
 {
-	assert (_low != 0); // structure was not initialized; it must have been initialized with Set()
+	assert (IsInitialized ()); // structure was not initialized; it must have been initialized with Set()
 
-	return ((unsigned short) _high & 0x0F) | _low;
+	return (((unsigned short) _high & 0x0F) << 8) | _low;
 }
 
 unsigned short PORT_ID::GetPortIdentifier () const
 {
-	assert (_low != 0); // structure was not initialized; it must have been initialized with Set()
+	assert (IsInitialized ()); // structure was not initialized; it must have been initialized with Set()
 
 	unsigned short id = (((unsigned short) _high) << 8) | (unsigned short) _low;
 	return id;
@@ -111,7 +221,7 @@ unsigned short PORT_ID::GetPortIdentifier () const
 
 bool PORT_ID::IsBetterThan (const PORT_ID& rhs) const
 {
-	assert (_low != 0); // structure was not initialized; it must have been initialized with Set()
+	assert (IsInitialized ()); // structure was not initialized; it must have been initialized with Set()
 
 	unsigned short lv = (((unsigned short) this->_high) << 8) | (unsigned short) this->_low;
 	unsigned short rv = (((unsigned short) rhs._high) << 8) | (unsigned short) rhs._low;
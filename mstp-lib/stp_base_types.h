@@ -161,10 +161,10 @@ struct PORT_ID
 private:
 	unsigned char _high;
 	unsigned char _low;
-	// Valid Port Numbers are in the range 1 through 4095. Value zero in _low means that the structure contains uninitialized data.
+	// Valid Port Numbers are in the range 1 through 4095. Port Number zero means that the structure contains uninitialized data.
 
 public:
-	bool IsInitialized () const { return _low != 0; }
+	bool IsInitialized () const { return ((_high & 0x0F) | _low) != 0; }
 
 	void Set (unsigned char priority, unsigned short portNumber);
 	void Reset ();
@@ -245,6 +245,121 @@ struct PRIORITY_VECTOR
 
 // ============================================================================
 
+// The last four components of a priority vector, the only ones MSTIs have (13.10). The port trees keep their priority
+// vectors in this form, with the first two components, which only the CIST has, kept apart; see PORT_CIST_TREE.
+struct MSTI_PRIORITY_VECTOR
+{
+	BRIDGE_ID	RegionalRootId;			// c)
+	INV_UINT4	InternalRootPathCost;	// d)
+	BRIDGE_ID	DesignatedBridgeId;		// e)
+	PORT_ID		DesignatedPortId;		// f)
+};
+
+// The first two components of a priority vector, used only for the CIST.
+struct CIST_PRIORITY_PREFIX
+{
+	BRIDGE_ID	RootId;					// a)
+	INV_UINT4	ExternalRootPathCost;	// b)
+};
+
+// ============================================================================
+
+// An MSTI_PRIORITY_VECTOR packed into integers, such that comparing two keys gives the same result as comparing
+// the two vectors byte by byte: the 22 bytes of the vector go into three big-endian 64-bit words, the last of which
+// uses only its low 48 bits. PORT_TREE keeps one key next to each of its priority vectors, so the tight loops
+// of the Port Information and Port Role Selection state machines compare integers only.
+struct MSTI_PRIORITY_VECTOR_KEY
+{
+	unsigned long long words [3];
+
+	void Set (const MSTI_PRIORITY_VECTOR& vector);
+
+	int Compare (const MSTI_PRIORITY_VECTOR_KEY& rhs) const
+	{
+		for (unsigned int i = 0; i < 3; i++)
+		{
+			if (words [i] != rhs.words [i])
+				return (words [i] > rhs.words [i]) ? 1 : -1;
+		}
+
+		return 0;
+	}
+
+	bool operator== (const MSTI_PRIORITY_VECTOR_KEY& rhs) const
+	{
+		return (words [0] == rhs.words [0]) && (words [1] == rhs.words [1]) && (words [2] == rhs.words [2]);
+	}
+
+	bool operator!= (const MSTI_PRIORITY_VECTOR_KEY& rhs) const
+	{
+		return !this->operator== (rhs);
+	}
+
+	// Tells whether the Designated Bridge Identifier Bridge Address and the Designated Port Identifier Port Number
+	// components are the same, see PRIORITY_VECTOR::IsSuperiorTo. The address is the low 16 bits of the second word
+	// followed by bits 16 to 47 of the last word; the port number is the low 12 bits of the last word.
+	bool IsFromSameDesignatedPort (const MSTI_PRIORITY_VECTOR_KEY& rhs) const
+	{
+		return (((words [1] ^ rhs.words [1]) & 0xFFFFULL) == 0)
+			&& (((words [2] ^ rhs.words [2]) & 0xFFFFFFFF0FFFULL) == 0);
+	}
+};
+
+// Same as above, for a CIST_PRIORITY_PREFIX.
+struct CIST_PRIORITY_PREFIX_KEY
+{
+	unsigned long long rootId;
+	unsigned int externalRootPathCost;
+
+	void Set (const CIST_PRIORITY_PREFIX& prefix);
+
+	int Compare (const CIST_PRIORITY_PREFIX_KEY& rhs) const
+	{
+		if (rootId != rhs.rootId)
+			return (rootId > rhs.rootId) ? 1 : -1;
+
+		return (externalRootPathCost == rhs.externalRootPathCost) ? 0 : ((externalRootPathCost > rhs.externalRootPathCost) ? 1 : -1);
+	}
+
+	bool operator== (const CIST_PRIORITY_PREFIX_KEY& rhs) const
+	{
+		return (rootId == rhs.rootId) && (externalRootPathCost == rhs.externalRootPathCost);
+	}
+};
+
+// Key of a whole PRIORITY_VECTOR, made of the keys of its two parts. Used by updtRolesTree() for the root path priority vectors.
+struct PRIORITY_VECTOR_KEY
+{
+	CIST_PRIORITY_PREFIX_KEY prefix;
+	MSTI_PRIORITY_VECTOR_KEY msti;
+
+	void Set (const PRIORITY_VECTOR& vector);
+
+	int Compare (const PRIORITY_VECTOR_KEY& rhs) const
+	{
+		int result = prefix.Compare (rhs.prefix);
+		return (result != 0) ? result : msti.Compare (rhs.msti);
+	}
+
+	bool operator== (const PRIORITY_VECTOR_KEY& rhs) const
+	{
+		return (prefix == rhs.prefix) && (msti == rhs.msti);
+	}
+
+	bool operator!= (const PRIORITY_VECTOR_KEY& rhs) const
+	{
+		return !this->operator== (rhs);
+	}
+
+	bool IsBetterThan (const PRIORITY_VECTOR_KEY& rhs) const
+	{
+		return Compare (rhs) < 0;
+	}
+};
+
+// ============================================================================
+
+// Note AG: All times are in units of 1/256 second, as in BPDUs; see STP_BRIDGE::timerValue for the state machine timers.
 struct TIMES
 {
 	unsigned short ForwardDelay;
@@ -253,17 +368,31 @@ struct TIMES
 	unsigned short MessageAge;
 	unsigned char remainingHops;
 
-	bool operator!= (const TIMES& rhs) const
+	// Member by member, as the padding at the end is not always initialized.
+	bool operator== (const TIMES& rhs) const
 	{
-		return Cmp (this, &rhs, sizeof (*this)) != 0;
+		return (ForwardDelay == rhs.ForwardDelay)
+			&& (HelloTime == rhs.HelloTime)
+			&& (MaxAge == rhs.MaxAge)
+			&& (MessageAge == rhs.MessageAge)
+			&& (remainingHops == rhs.remainingHops);
 	}
 
-	bool operator== (const TIMES& rhs) const
+	bool operator!= (const TIMES& rhs) const
 	{
-		return Cmp (this, &rhs, sizeof (*this)) == 0;
+		return !this->operator== (rhs);
 	}
 };
 
+// The components of TIMES that only the CIST has; MSTIs have only remainingHops. See PORT_CIST_TREE.
+struct CIST_TIMES
+{
+	unsigned short ForwardDelay;
+	unsigned short HelloTime;
+	unsigned short MaxAge;
+	unsigned short MessageAge;
+};
+
 // ============================================================================
 
 const char* GetPortRoleName (STP_PORT_ROLE role);
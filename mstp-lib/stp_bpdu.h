@@ -6,6 +6,7 @@
 #define MSTP_LIB_BPDU_H
 
 #include "stp_base_types.h"
+#include "stp_log.h"
 #include "stp.h"
 
 // 14.2.1
@@ -106,9 +107,15 @@ enum VALIDATED_BPDU_TYPE STP_GetValidatedBpduType (const unsigned char* _bpdu, u
 
 BPDU_PORT_ROLE GetBpduPortRole (STP_PORT_ROLE role);
 
+#if STP_USE_LOG
 void DumpMstpBpdu (STP_BRIDGE* bridge, int port, int tree, const MSTP_BPDU* bpdu);
 void DumpRstpBpdu (STP_BRIDGE* bridge, int port, int tree, const MSTP_BPDU* bpdu);
 void DumpConfigBpdu (STP_BRIDGE* bridge, int port, int tree, const MSTP_BPDU* bpdu);
+#else
+inline void DumpMstpBpdu (STP_BRIDGE*, int, int, const MSTP_BPDU*) { }
+inline void DumpRstpBpdu (STP_BRIDGE*, int, int, const MSTP_BPDU*) { }
+inline void DumpConfigBpdu (STP_BRIDGE*, int, int, const MSTP_BPDU*) { }
+#endif
 
 // ============================================================================
 
@@ -8,8 +8,32 @@
 // All references of the kind XX.YY are to sections in 802.1Q-2011 pdf.
 
 #include "stp_base_types.h"
+#include "stp_log.h"
 #include "stp_port.h"
 
+// Compile-time ceiling for the mstiCount parameter of STP_CreateBridge. Builds for RSTP-only bridges can define
+// this as 0 (in the project settings / compiler command line); treeCount() then becomes the constant 1,
+// and the compiler drops the MSTI iterations from all loops over trees. MSTP with no MSTIs (only the CIST) still works.
+// The default is the maximum allowed by 802.1Q-2011 (see STP_CreateBridge).
+// Note AG: This is as far as the compile-time specialization goes. The state machines are still called through
+// the function pointers of SM_INTERFACE: each of them is in its own translation unit, so a template engine couldn't
+// inline them anyway, and SM_INTERFACE is what lets another edition of the standard be plugged in. A build that
+// wants the calls inlined can compile the library with link-time optimization. Benchmark shows both effects.
+#ifndef STP_MAX_MSTI_COUNT
+	#define STP_MAX_MSTI_COUNT 64
+#endif
+
+// Orders the accesses to the snapshot buffer (see STP_SetSnapshotBuffer) with respect to its sequence counter.
+// All those accesses are volatile, so the compiler doesn't reorder them; this needs to do something only on
+// multi-core targets whose processor reorders memory accesses. Define it to your platform's barrier if it's not below.
+#ifndef STP_MEMORY_BARRIER
+	#if defined(__GNUC__)
+		#define STP_MEMORY_BARRIER() __sync_synchronize()
+	#else
+		#define STP_MEMORY_BARRIER() ((void) 0)
+	#endif
+#endif
+
 typedef const char* (*SM_GET_STATE_NAME) (SM_STATE state);
 typedef SM_STATE (*SM_CHECK_CONDITIONS) (STP_BRIDGE* bridge, int givenPort, int givenTree, SM_STATE state);
 typedef void (*SM_INIT_STATE) (STP_BRIDGE* bridge, int givenPort, int givenTree, SM_STATE state, unsigned int timestamp);
@@ -50,8 +74,9 @@ struct BRIDGE_TREE
 {
 	// There is one instance per bridge of each of the following for the CIST, and one for each MSTI.
 private:
-	// TODO: make the address field of BridgeIdentifier common to all trees
-	BRIDGE_ID				BridgeIdentifier;	// 13.24.e) - 13.24.1
+	// Note AG: 13.24.e) BridgeIdentifier - 13.24.1 is not kept separately: it's the DesignatedBridgeId component of
+	// BridgePriority, see GetBridgeIdentifier(). The bridge address in it is the same for all trees (it's set for
+	// all of them by STP_SetBridgeAddress); only the priority component differs from one tree to another.
 	PRIORITY_VECTOR			BridgePriority;		// 13.24.f) - 13.24.2
 
 public:
@@ -60,41 +85,51 @@ public:
 	PRIORITY_VECTOR			rootPriority;		// 13.24.i) - 13.24.8
 	TIMES					rootTimes;			// 13.24.j) - 13.24.9
 
-private:
-	void UpdateBridgePriorityFromBridgeIdentifier ()
+	// Not from the standard: a tournament tree that keeps the best candidate for Root Port, so that updtRolesTree()
+	// doesn't have to look at all ports when only a few of them received new information. Entry n, for n from 1
+	// to portCount - 1, holds the better of the candidates in entries 2n and 2n + 1; entries portCount to 2*portCount - 1
+	// stand for the ports themselves and are not stored. See SelectRootPortCandidate() in 802_1Q_2011_procedures.cpp.
+	unsigned short*			rootCandidates;
+	unsigned short*			dirtyRootCandidates;		// ports whose leaf must be updated before the next selection
+	unsigned int			dirtyRootCandidateCount;
+	bool					allRootCandidatesDirty;		// rebuild the whole tournament tree instead
+	bool					designatedPrioritiesStale;	// recompute the designated priority vectors even if rootPriority didn't change
+
+	// Not from the standard: the numbers of ports of this tree with each of the PORT_TREE::Counted... flags that allSynced()
+	// and Port Role Selection look at, so that they don't have to look at all ports. See STP_BRIDGE::updateSharedStateCounts.
+	unsigned int			unsettledPortCount;
+	unsigned int			unsyncedPortCount;
+	unsigned int			unsyncedNonRootPortCount;
+	unsigned int			reselectPortCount;
+
+	const BRIDGE_ID& GetBridgeIdentifier () const
+	{
+		return BridgePriority.DesignatedBridgeId;
+	}
+
+	void SetBridgeIdentifier (const BRIDGE_ID& newBridgeIdentifier)
 	{
 		// Note: ExternalRootPathCost, InternalRootPathCost and DesignatedPortId are always zero
 		// in the BridgePriority field, so there's no need to assign them.
 
-		unsigned int treeIndex = BridgeIdentifier.GetPriority () & 0x0FFF;
+		unsigned int treeIndex = newBridgeIdentifier.GetPriority () & 0x0FFF;
 		if (treeIndex == CIST_INDEX)
 		{
-			BridgePriority.RootId = BridgeIdentifier;
+			BridgePriority.RootId = newBridgeIdentifier;
 			//BridgePriority.ExternalRootPathCost = 0;
 		}
 
-		BridgePriority.RegionalRootId = BridgeIdentifier;
+		BridgePriority.RegionalRootId = newBridgeIdentifier;
 		//BridgePriority.InternalRootPathCost = 0;
-		BridgePriority.DesignatedBridgeId = BridgeIdentifier;
+		BridgePriority.DesignatedBridgeId = newBridgeIdentifier;
 		//BridgePriority.DesignatedPortId = 0;
 	}
 
-public:
-	const BRIDGE_ID& GetBridgeIdentifier () const
-	{
-		return BridgeIdentifier;
-	}
-
-	void SetBridgeIdentifier (const BRIDGE_ID& newBridgeIdentifier)
-	{
-		BridgeIdentifier = newBridgeIdentifier;
-		UpdateBridgePriorityFromBridgeIdentifier ();
-	}
-
 	void SetBridgeIdentifier (unsigned short settablePriorityComponent, unsigned short treeIndex, const unsigned char address[6])
 	{
-		BridgeIdentifier.Set (settablePriorityComponent, treeIndex, address);
-		UpdateBridgePriorityFromBridgeIdentifier ();
+		BRIDGE_ID bridgeIdentifier;
+		bridgeIdentifier.Set (settablePriorityComponent, treeIndex, address);
+		SetBridgeIdentifier (bridgeIdentifier);
 	}
 
 	const PRIORITY_VECTOR& GetBridgePriority () const
@@ -110,16 +145,25 @@ struct STP_BRIDGE
 {
 	static const unsigned int LogIndentSize = 2;
 
+#if STP_USE_LOG
 	char* logBuffer;
 	unsigned int logBufferMaxSize;
 	unsigned int logBufferUsedSize;
 	unsigned int logIndent;
 	bool logLineStarting;
 	bool loggingEnabled;
-	bool BEGIN; // 13.23.1
-	bool started;
 	int logCurrentPort;
 	int logCurrentTree;
+#endif
+	// Binary trace, see STP_SetTraceBuffer. traceHeader is NULL when tracing is disabled.
+	STP_TRACE_HEADER* traceHeader;
+	STP_TRACE_RECORD* traceRecords;
+
+	// State snapshot for other threads, see STP_SetSnapshotBuffer. NULL when disabled.
+	volatile STP_SNAPSHOT_HEADER* snapshotHeader;
+
+	bool BEGIN; // 13.23.1
+	bool started;
 
 	STP_CALLBACKS callbacks;
 
@@ -127,27 +171,79 @@ struct STP_BRIDGE
 	unsigned int mstiCount;
 	unsigned int maxVlanNumber;
 
-	unsigned int treeCount() const { return 1 + ((ForceProtocolVersion >= STP_VERSION_MSTP) ? mstiCount : 0); }
+	unsigned int treeCount() const { return 1 + (((STP_MAX_MSTI_COUNT > 0) && (ForceProtocolVersion >= STP_VERSION_MSTP)) ? mstiCount : 0); }
+
+	// The number of trees the bridge was created with, in use or not. Like treeCount(), it's the constant 1
+	// when STP_MAX_MSTI_COUNT is 0, so loops over trees should use one of the two rather than mstiCount.
+	unsigned int allocatedTreeCount() const { return 1 + ((STP_MAX_MSTI_COUNT > 0) ? mstiCount : 0); }
 
 	BRIDGE_TREE** trees;
 	PORT** ports;
+
+	// The PORT_TREE_TIMERS of all ports and trees, in one block padded to a whole number of chunks of
+	// TreeTimerChunk timers (the padding stays zero), so that RunTimerTick can decrement them in a single pass.
+	static const unsigned int TreeTimerChunk = 8;
+	PORT_TREE_TIMERS* treeTimers;
+	unsigned int treeTimerChunkCount;
+
 	INV_UINT2* mstConfigTable;
 
+	// State of the digest computation at the start of each 64-byte block of mstConfigTable, plus one for the end
+	// of the last whole block. See ComputeMstConfigDigest in stp.cpp.
+	unsigned int (*mstConfigDigestStates) [4];
+
+	// For each tree, a bitmap of the VLANs that mstConfigTable maps to it, with VLAN v in bit (v % 8) of byte (v / 8);
+	// after them, one more bitmap with all VLANs, which is the bitmap of the CIST when not running MSTP.
+	// Each is vlanBitmapSize bytes long. See STP_GetVlanBitmapForTree in stp.cpp.
+	unsigned char* vlanBitmaps;
+	unsigned int vlanBitmapSize;
+
+	const unsigned char* getVlanBitmap (unsigned int treeIndex) const
+	{
+		if (ForceProtocolVersion < STP_VERSION_MSTP)
+			return &vlanBitmaps [(1 + mstiCount) * vlanBitmapSize];
+
+		return &vlanBitmaps [treeIndex * vlanBitmapSize];
+	}
+
 	// 13.24 Per bridge variables
 	// There is one instance per bridge component of the following variable(s):
 	STP_VERSION ForceProtocolVersion;				// 13.24.a) - 13.24.4
 	static const unsigned int TxHoldCount = 6;		// 13.24.b) - 13.24.10
-	static const unsigned short MigrateTime = 3;	// 13.24.c) - 13.24.5
+	static const unsigned short MigrateTime = 3 * 256;	// 13.24.c) - 13.24.5
 	STP_MST_CONFIG_ID MstConfigId;					// 13.24.d) - 13.24.6
 	// The above parameters ((a) through (d)) are not modified by the operation of the spanning tree protocols, but
 	// are treated as constants by the state machines. If ForceProtocolVersion or MSTConfigId are modified by
 	// management, BEGIN shall be asserted for all state machines.
 
-	// From Table 13-5 on page 356 in 802.1Q-2011
-	static const unsigned short BridgeHelloTime = 2;
-	static const unsigned short BridgeMaxAge = 20;		// 13.22.i in 802.1Q-2005 --- 17.14 in 802.1D-2004
-	static const unsigned short BridgeForwardDelay = 15;// 13.22.f in 802.1Q-2005 --- 17.14 in 802.1D-2004
-	static const unsigned short MaxHops = 20;			// 13.22.1 in 802.1Q-2005 --- 13.23.7 --- 13.37.3
+	// From Table 13-5 on page 356 in 802.1Q-2011. Times are in 1/256 s, like those in TIMES.
+	// Note AG: BridgeHelloTime is fixed at 2 s by the standard; we let management change it, see STP_SetHelloTime.
+	unsigned short BridgeHelloTime;
+	static const unsigned short DefaultBridgeHelloTime = 2 * 256;
+	static const unsigned short BridgeMaxAge = 20 * 256;		// 13.22.i in 802.1Q-2005 --- 17.14 in 802.1D-2004
+	static const unsigned short BridgeForwardDelay = 15 * 256;	// 13.22.f in 802.1Q-2005 --- 17.14 in 802.1D-2004
+	static const unsigned short MaxHops = 20;					// 13.22.1 in 802.1Q-2005 --- 13.23.7 --- 13.37.3
+
+	// Not from the standard: the state machine timers count in seconds, or in 1/256 s after STP_EnableMillisecondTimers.
+	// timerValue converts a time from TIMES to the units of the timers.
+	bool millisecondTimers;
+	unsigned int timerUnitsPerSecond() const { return millisecondTimers ? 256 : 1; }
+	unsigned short timerValue (unsigned int time) const { return (unsigned short) (millisecondTimers ? time : (time / 256)); }
+
+	// The standard decrements txCount once a second, which limits a port to TxHoldCount BPDUs a second.
+	// With a Hello Time shorter than a second that's less than the periodic BPDUs, so we decrement it once per Hello Time.
+	unsigned int txHoldPeriod() const { return (millisecondTimers && (BridgeHelloTime < 256)) ? BridgeHelloTime : timerUnitsPerSecond(); }
+
+	// By how much the TICK state of the Port Timers state machine (and DecrementTreeTimers for it) decrements the timers (in timer units) and txCount
+	// (in txHoldPeriods). Set before each tick; both are 1 for STP_OnOneSecondTick without millisecond timers.
+	unsigned short tickTimerUnits;
+	unsigned short tickTxHoldPeriods;
+
+	// Elapsed time not yet applied to the timers by STP_OnTimerTick, in 1/1000 timer units; time elapsed since
+	// the last whole second counted for tcIgnore, and since the last txHoldPeriod counted in tickTxHoldPeriods, in timer units.
+	unsigned int timerRemainder;
+	unsigned int secondRemainder;
+	unsigned int txHoldRemainder;
 
 	// Not from the standard. See long comment in 802_1Q_2011_procedures.cpp, just above CallTcCallback().
 	static const unsigned short TcIgnoreMax = 6;
@@ -159,12 +255,68 @@ struct STP_BRIDGE
 
 	const SM_INTERFACE* smInterface;
 
-	// This variable is supposed to be be accessed only while a received BPDU is being handled.
-	// When there's no received BPDU, we set it to the invalid value NULL, to cause a crash on access and signal the programming error early.
-	// (Note that the crash won't happen on some microcontrollers for which address 0 is
-	//  readable/writeable, that's why we also have asserts all around the place).
-	const MSTP_BPDU*		receivedBpduContent;
-	VALIDATED_BPDU_TYPE		receivedBpduType;
+	// Dirty-instance scheduling, see RunStateMachines() in stp.cpp.
+	// A state machine instance is re-evaluated only if its port or its tree was marked dirty since its previous evaluation.
+	// State machine transitions mark what they might affect; API functions mark what they write.
+	static const unsigned char DirtyThisPass = 1;
+	static const unsigned char DirtyNextPass = 2;
+	static const unsigned char DirtyTransmit = 4;
+	unsigned char* dirtyPorts;	// one entry per port
+	unsigned char* dirtyTrees;	// one entry per tree (CIST and all MSTIs)
+	bool dirtyMarksPending;
+
+	// Sorted indexes of the ports having DirtyThisPass or DirtyNextPass set, and of the ports having DirtyTransmit set.
+	// A pass walks these lists instead of all ports, so that handling an event on a single port (a received BPDU,
+	// a port going up or down) costs in proportion to the ports it actually affects, not to portCount.
+	unsigned short* dirtyPortList;
+	unsigned int dirtyPortListCount;
+	unsigned short* transmitPortList;
+	unsigned int transmitPortListCount;
+
+	void markPortDirty (unsigned int portIndex);
+	void markAllDirty ();
+
+	void markTreeDirty (unsigned int treeIndex)
+	{
+		dirtyTrees [treeIndex] |= DirtyNextPass;
+		dirtyMarksPending = true;
+	}
+
+	// Call markRootCandidateDirty when something changes that goes into the root path priority of a port (13.27.31 a)
+	// or into whether the port may be selected as Root Port (13.27.31 b): its portPriority, infoIs, infoInternal,
+	// path costs or port identifier. Call markAllRootCandidatesDirty when the bridge identifier of the tree changes;
+	// this also has updtRolesTree() recompute the designated priority vectors of the tree. See BRIDGE_TREE::rootCandidates.
+	void markRootCandidateDirty (unsigned int portIndex, unsigned int treeIndex);
+	void markAllRootCandidatesDirty (unsigned int treeIndex);
+
+	// Brings the counts of BRIDGE_TREE and PORT that allSynced(), allTransmitReady() and Port Role Selection read up to date
+	// with the selected, updtInfo, synced, reselect, role and selectedRole variables of a port and tree. The scheduler calls it after the transitions
+	// that change these variables (see MarkDirtyAfterTransition in stp.cpp); code that writes them anywhere else
+	// (to other ports than the one of the running state machine, or from API functions) must call it as well.
+	void updateSharedStateCounts (unsigned int portIndex, unsigned int treeIndex);
+
+	// Call this when a setting that goes into every transmitted BPDU changes (MST Configuration Identifier,
+	// protocol version, bridge address or priority). See PORT::txTemplate.
+	void invalidateTxTemplates ();
+
+	// Used only when the application provides the transmitBatch callback. Allocated separately from the bridge memory block,
+	// like the log buffer. There's one slot per port, large enough for the largest BPDU; when a port transmits again
+	// before the batch is passed to the application, the batch is passed first, so the BPDUs of a port are never reordered.
+	unsigned char* transmitBatchBuffer;
+	unsigned int transmitBatchSlotSize;
+	STP_TRANSMITTED_BPDU* transmitBatchEntries;
+	unsigned int transmitBatchCount;
+
+	// The transmit procedures call these instead of transmitGetBuffer / transmitReleaseBuffer.
+	void* getTransmitBuffer (unsigned int portIndex, unsigned int bpduSize, unsigned int timestamp);
+	void releaseTransmitBuffer (void* buffer);
+	void flushTransmitBatch (unsigned int timestamp);
+
+	// Keep PORT::forwardingVlans and PORT::learningVlans in sync with the forwarding and learning variables of the
+	// port's trees. The first sets or clears in portBitmap the VLANs of one tree, the second recomputes the bitmaps
+	// of all ports and must be called when the VLAN bitmaps of the trees change.
+	void updatePortVlanBitmap (unsigned int portIndex, unsigned char* portBitmap, unsigned int treeIndex, bool set);
+	void rebuildPortVlanBitmaps ();
 };
 
 
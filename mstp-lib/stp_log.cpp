@@ -11,6 +11,31 @@
 #include <stdio.h>
 #include <string.h>
 
+void STP_Trace (STP_BRIDGE* bridge, unsigned char event, int port, int tree, unsigned int timestamp, unsigned char machine, unsigned char state, unsigned char value, unsigned char flags)
+{
+	STP_TRACE_HEADER* header = bridge->traceHeader;
+	STP_TRACE_RECORD* record = &bridge->traceRecords [header->nextRecordIndex];
+	record->timestamp = timestamp;
+	record->port      = (unsigned short) port;
+	record->event     = event;
+	record->tree      = (unsigned char) tree;
+	record->machine   = machine;
+	record->state     = state;
+	record->value     = value;
+	record->flags     = flags;
+
+	header->nextRecordIndex++;
+	if (header->nextRecordIndex == header->recordCapacity)
+	{
+		header->nextRecordIndex = 0;
+		header->wrapped = 1;
+	}
+
+	header->recordsWritten++;
+}
+
+#if STP_USE_LOG
+
 #ifdef _MSC_VER
 	#define snprintf _snprintf
 #endif
@@ -114,6 +139,19 @@ void STP_Unindent (STP_BRIDGE* bridge)
 	bridge->logIndent -= STP_BRIDGE::LogIndentSize;
 }
 
+// Logs a time from TIMES, which is in 1/256 s: in whole seconds, as the library always did, or in seconds and
+// milliseconds if it has a fraction (which happens only with millisecond timers).
+static void LogTime (STP_BRIDGE* bridge, int port, int tree, unsigned int time)
+{
+	STP_Log (bridge, port, tree, "{D}", time / 256);
+
+	if ((time % 256) != 0)
+	{
+		unsigned int milliseconds = (time % 256) * 1000 / 256;
+		STP_Log (bridge, port, tree, ".{D}{D}{D}", milliseconds / 100, milliseconds / 10 % 10, milliseconds % 10);
+	}
+}
+
 void STP_Log (STP_BRIDGE* bridge, int port, int tree, const char* format, ...)
 {
 	char _buffer [10];
@@ -214,8 +252,15 @@ void STP_Log (STP_BRIDGE* bridge, int port, int tree, const char* format, ...)
 		else if (strncmp (format, "{TMS}", 5) == 0)
 		{
 			const TIMES* times = va_arg (ap, TIMES*);
-			STP_Log (bridge, port, tree, "MessageAge={D}, MaxAge={D}, HelloTime={D}, FwDelay={D}, remainingHops={D}",
-					  times->MessageAge, times->MaxAge, times->HelloTime, times->ForwardDelay, times->remainingHops);
+			STP_Log (bridge, port, tree, "MessageAge=");
+			LogTime (bridge, port, tree, times->MessageAge);
+			STP_Log (bridge, port, tree, ", MaxAge=");
+			LogTime (bridge, port, tree, times->MaxAge);
+			STP_Log (bridge, port, tree, ", HelloTime=");
+			LogTime (bridge, port, tree, times->HelloTime);
+			STP_Log (bridge, port, tree, ", FwDelay=");
+			LogTime (bridge, port, tree, times->ForwardDelay);
+			STP_Log (bridge, port, tree, ", remainingHops={D}", times->remainingHops);
 			format += 5;
 		}
 		else if (strncmp (format, "{D", 2) == 0)
@@ -275,3 +320,5 @@ void STP_Log (STP_BRIDGE* bridge, int port, int tree, const char* format, ...)
 
 	va_end (ap);
 }
+
+#endif
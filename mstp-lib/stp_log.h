@@ -5,8 +5,22 @@
 #ifndef MSTP_LIB_LOG_H
 #define MSTP_LIB_LOG_H
 
+// Builds that never look at the debug log can define this as 0 (in the project settings / compiler command line).
+// The LOG macros then expand to nothing, their arguments are not evaluated, the BPDU dump functions become empty,
+// and STP_CreateBridge no longer allocates the log buffer. STP_EnableLogging has no effect in such a build.
+#ifndef STP_USE_LOG
+	#define STP_USE_LOG 1
+#endif
+
 struct STP_BRIDGE;
 
+// Appends a record to the binary trace (see STP_SetTraceBuffer). This is independent of STP_USE_LOG.
+void STP_Trace (STP_BRIDGE* bridge, unsigned char event, int port, int tree, unsigned int timestamp, unsigned char machine, unsigned char state, unsigned char value, unsigned char flags = 0);
+
+#define TRACE(b,...)		((void) ( ((b)->traceHeader == 0) || (STP_Trace(b,__VA_ARGS__), 0)))
+
+#if STP_USE_LOG
+
 void STP_Log (STP_BRIDGE* bridge, int port, int tree, const char* format, ...);
 void STP_FlushLog (STP_BRIDGE* bridge);
 void STP_Indent (STP_BRIDGE* bridge);
@@ -17,4 +31,13 @@ void STP_Unindent (STP_BRIDGE* bridge);
 #define LOG_INDENT(b)		((void) ( !(b)->loggingEnabled || (STP_Indent(b), 0)))
 #define LOG_UNINDENT(b)		((void) ( !(b)->loggingEnabled || (STP_Unindent(b), 0)))
 
+#else
+
+#define LOG(b,p,t,...)		((void) 0)
+#define FLUSH_LOG(b)		((void) 0)
+#define LOG_INDENT(b)		((void) 0)
+#define LOG_UNINDENT(b)		((void) 0)
+
+#endif
+
 #endif
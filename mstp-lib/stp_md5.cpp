@@ -98,6 +98,20 @@ static void MD5Update (MD5_CTX* mdContext, const unsigned char* inBuf, unsigned
 	mdContext->i[0] += ((unsigned int)inLen << 3);
 	mdContext->i[1] += ((unsigned int)inLen >> 29);
 
+	/* whole blocks at a block boundary are decoded directly from the input, without going through the buffer */
+	if (mdi == 0) {
+		while (inLen >= 64) {
+			for (i = 0, ii = 0; i < 16; i++, ii += 4)
+				in[i] = (((unsigned int)inBuf[ii+3]) << 24) |
+				(((unsigned int)inBuf[ii+2]) << 16) |
+				(((unsigned int)inBuf[ii+1]) << 8) |
+				((unsigned int)inBuf[ii]);
+			Transform (mdContext->buf, in);
+			inBuf += 64;
+			inLen -= 64;
+		}
+	}
+
 	while (inLen--) {
 		/* add new character to buffer, increment mdi */
 		mdContext->in[mdi++] = *inBuf++;
@@ -276,6 +290,54 @@ void HMAC_MD5_Update (HMAC_MD5_CONTEXT* context, const void* text, unsigned int
 	MD5Update (context, (const unsigned char*) text, text_len);
 }
 
+void HMAC_MD5_UpdateWithZeroes (HMAC_MD5_CONTEXT* context, unsigned int text_len)
+{
+	static const unsigned char zeroes [64] = { 0 };
+
+	// complete the block that's partially filled, if any
+	unsigned int mdi = (context->i[0] >> 3) & 0x3F;
+	if (mdi != 0)
+	{
+		unsigned int len = (text_len < 64 - mdi) ? text_len : (64 - mdi);
+		MD5Update (context, zeroes, len);
+		text_len -= len;
+	}
+
+	// whole blocks of zeroes need neither copying to the input buffer nor decoding
+	unsigned int in [16];
+	memset (in, 0, sizeof in);
+	while (text_len >= 64)
+	{
+		if ((context->i[0] + (64u << 3)) < context->i[0])
+			context->i[1]++;
+		context->i[0] += (64u << 3);
+
+		Transform (context->buf, in);
+		text_len -= 64;
+	}
+
+	MD5Update (context, zeroes, text_len);
+}
+
+void HMAC_MD5_GetState (const HMAC_MD5_CONTEXT* context, unsigned int stateOut [4])
+{
+	// must be at a block boundary, with nothing left in the input buffer
+	assert (((context->i[0] >> 3) & 0x3F) == 0);
+
+	memcpy (stateOut, context->buf, 16);
+}
+
+void HMAC_MD5_SetState (HMAC_MD5_CONTEXT* context, const unsigned int state [4], unsigned int text_len)
+{
+	assert ((text_len % 64) == 0);
+
+	// the inner pad of 64 bytes hashed by HMAC_MD5_Init comes before the text
+	unsigned int len = 64 + text_len;
+	context->i[0] = len << 3;
+	context->i[1] = len >> 29;
+	memcpy (context->buf, state, 16);
+}
+
 void HMAC_MD5_End (HMAC_MD5_CONTEXT* context)
 {
 	// finish up 1st pass
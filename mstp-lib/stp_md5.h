@@ -22,4 +22,12 @@ void HMAC_MD5_Init (HMAC_MD5_CONTEXT* context);
 void HMAC_MD5_Update (HMAC_MD5_CONTEXT* context, const void* text, unsigned int text_len);
 void HMAC_MD5_End (HMAC_MD5_CONTEXT* context);
 
+// Same as HMAC_MD5_Update with a buffer full of zeroes, only faster.
+void HMAC_MD5_UpdateWithZeroes (HMAC_MD5_CONTEXT* context, unsigned int text_len);
+
+// These save and restore the state of the computation at a point where the length of the text hashed so far
+// is a multiple of 64, so that a digest can be recomputed starting from the first 64-byte block that changed.
+void HMAC_MD5_GetState (const HMAC_MD5_CONTEXT* context, unsigned int stateOut [4]);
+void HMAC_MD5_SetState (HMAC_MD5_CONTEXT* context, const unsigned int state [4], unsigned int text_len);
+
 #endif
@@ -11,6 +11,30 @@
 
 // All references are to 802.1Q-2011
 
+// 13.23 State machine timers - those of which there's one instance per port per tree.
+// Note AG: These are not kept in PORT_TREE but in an array of the bridge (STP_BRIDGE::treeTimers), with the timers
+// of all trees of a port next to each other, so that each tick decrements all of them in a single loop (RunTimerTick).
+// Keep all members of type unsigned short, as that loop treats the array as an array of unsigned short.
+struct PORT_TREE_TIMERS
+{
+	unsigned short fdWhile;			// e) - 13.23.2
+	unsigned short rrWhile;			// f) - 13.23.7
+	unsigned short rbWhile;			// g) - 13.23.5
+	unsigned short tcWhile;			// h) - 13.23.9
+	unsigned short rcvdInfoWhile;	// i) - 13.23.6
+	unsigned short tcDetected;		// j) - 13.23.8
+};
+
+// ============================================================================
+
+// Not in the standard: indexes of the priority vectors and times of a port and tree, see PORT_TREE::priorities.
+enum PORT_INFO_INDEX
+{
+	DESIGNATED_INFO,	// designatedPriority - 13.25.7, designatedTimes - 13.25.8
+	MSG_INFO,			// msgPriority - 13.25.26, msgTimes - 13.25.27
+	PORT_INFO,			// portPriority - 13.25.33, portTimes - 13.25.34
+};
+
 // 13.25
 struct PORT_TREE
 {
@@ -45,6 +69,19 @@ struct PORT_TREE
 	bool          msgFlagsAgreement      : 1;
 	bool          msgFlagsTcAckOrMaster  : 1;
 
+	// Not in the standard: tells whether this tree's part of PORT::txTemplate is up to date. See txRstp().
+	bool          txTemplateValid        : 1;
+
+	// Not in the standard: tells whether this is the PORT_CIST_TREE of its port.
+	bool          isCist                 : 1;
+
+	// Not in the standard: tells whether this port is in BRIDGE_TREE::dirtyRootCandidates. See STP_BRIDGE::markRootCandidateDirty.
+	bool          rootCandidateDirty     : 1;
+
+	// Not in the standard: the Counted... flags below with which this port and tree is included in the counts of
+	// BRIDGE_TREE and PORT. See STP_BRIDGE::updateSharedStateCounts.
+	unsigned char countedState           : 5;
+
 	INFO_IS			infoIs		: 8;	// 13.25.am) - 13.25.17
 	RCVD_INFO		rcvdInfo	: 8;	// 13.25.ax) - 13.25.39
 	STP_PORT_ROLE	role		: 8;	// 13.25.bc) - 13.25.51
@@ -52,27 +89,260 @@ struct PORT_TREE
 
 	unsigned int InternalPortPathCost;	// 13.25.an) - 13.25.18
 
-	PRIORITY_VECTOR designatedPriority; // 13.25.ag) - 13.25.7
-	PRIORITY_VECTOR msgPriority;		// 13.25.aq) - 13.25.26
-	PRIORITY_VECTOR portPriority;		// 13.25.at) - 13.25.33
+	// Keys of the vectors below (placed first for alignment), see MSTI_PRIORITY_VECTOR_KEY. After writing a vector
+	// component by component, call UpdatePriorityKey; SetPriority and CopyPriority update the keys themselves.
+	MSTI_PRIORITY_VECTOR_KEY priorityKeys [3];
+
+	// 13.25.ag) designatedPriority, 13.25.aq) msgPriority and 13.25.at) portPriority, indexed by PORT_INFO_INDEX.
+	// Note AG: Only the components that MSTIs have are kept here; the CIST keeps the other two in PORT_CIST_TREE.
+	// With many MSTIs, the port trees take most of the memory of a bridge, so MSTIs shouldn't pay for what only the CIST uses.
+	MSTI_PRIORITY_VECTOR priorities [3];
 
-	TIMES	designatedTimes;// 13.25.ah) - 13.25.8
-	TIMES	msgTimes;		// 13.25.ar) - 13.25.27
-	TIMES	portTimes;		// 13.25.au) - 13.25.34
+	// The remainingHops component of 13.25.ah) designatedTimes, 13.25.ar) msgTimes and 13.25.au) portTimes,
+	// indexed by PORT_INFO_INDEX. It's the only component MSTIs have; the CIST keeps the others in PORT_CIST_TREE.
+	unsigned char remainingHops [3];
 
 	PORT_ID portId;			// 13.25.as) - 13.25.32
 
 	// 13.23 State machine timers
-	unsigned short fdWhile;			// e) - 13.23.2
-	unsigned short rrWhile;			// f) - 13.23.7
-	unsigned short rbWhile;			// g) - 13.23.5
-	unsigned short tcWhile;			// h) - 13.23.9
-	unsigned short rcvdInfoWhile;	// i) - 13.23.6
-	unsigned short tcDetected;		// j) - 13.23.8
+	PORT_TREE_TIMERS* timers;
+
+	// Packs the variables of this port and tree that are read by state machine conditions of _other_ ports
+	// (allSynced, reRooted) or of the bridge (reselect in Port Role Selection). The scheduler in stp.cpp compares
+	// this before and after a state transition to decide whether all ports of the tree must be re-evaluated.
+	unsigned int GetSharedStateSignature () const
+	{
+		return (unsigned int) selected
+			| ((unsigned int) reselect << 1)
+			| ((unsigned int) updtInfo << 2)
+			| ((unsigned int) synced << 3)
+			| ((unsigned int) (timers->rrWhile == 0) << 4)
+			| ((unsigned int) role << 8)
+			| ((unsigned int) selectedRole << 16);
+	}
+
+	// Which counts of BRIDGE_TREE and PORT this port and tree belongs in, for allSynced, allTransmitReady and Port Role Selection.
+	static const unsigned char CountedUnsettled        = 1;	// selected is FALSE, role differs from selectedRole, or updtInfo is TRUE
+	static const unsigned char CountedUnsynced         = 2;	// synced is FALSE
+	static const unsigned char CountedUnsyncedNonRoot  = 4;	// synced is FALSE and role is not RootPort
+	static const unsigned char CountedNotTransmitReady = 8;	// selected is FALSE or updtInfo is TRUE
+	static const unsigned char CountedReselect         = 16;	// reselect is TRUE
+
+	unsigned char GetCountedState () const
+	{
+		unsigned char state = 0;
+
+		if (!selected || updtInfo)
+			state |= CountedNotTransmitReady;
+
+		if (!selected || updtInfo || (role != selectedRole))
+			state |= CountedUnsettled;
+
+		if (!synced)
+		{
+			state |= CountedUnsynced;
+			if (role != STP_PORT_ROLE_ROOT)
+				state |= CountedUnsyncedNonRoot;
+		}
+
+		if (reselect)
+			state |= CountedReselect;
+
+		return state;
+	}
+
+	// These work on the whole priority vectors and times, including the components kept in PORT_CIST_TREE for the CIST,
+	// which are zero for MSTIs. SetPriority and SetTimes return whether the value changed.
+	void GetPriority (PORT_INFO_INDEX index, PRIORITY_VECTOR* vectorOut) const;
+	bool SetPriority (PORT_INFO_INDEX index, const PRIORITY_VECTOR& vector);
+	void UpdatePriorityKey (PORT_INFO_INDEX index);
+	void CopyPriority (PORT_INFO_INDEX from, PORT_INFO_INDEX to);
+	int  ComparePriorities (PORT_INFO_INDEX lhs, PORT_INFO_INDEX rhs) const;
+	bool IsPrioritySuperiorTo (PORT_INFO_INDEX lhs, PORT_INFO_INDEX rhs) const;
+	void GetTimes (PORT_INFO_INDEX index, TIMES* timesOut) const;
+	bool SetTimes (PORT_INFO_INDEX index, const TIMES& times);
+	void CopyTimes (PORT_INFO_INDEX from, PORT_INFO_INDEX to);
+	bool AreTimesEqual (PORT_INFO_INDEX lhs, PORT_INFO_INDEX rhs) const;
+};
+
+// ============================================================================
+
+// Not in the standard: the PORT_TREE of the CIST, with the components of the priority vectors and times that only the CIST has.
+struct PORT_CIST_TREE : PORT_TREE
+{
+	// RootId and ExternalRootPathCost of designatedPriority, msgPriority and portPriority, and their keys.
+	CIST_PRIORITY_PREFIX priorityPrefixes [3];
+	CIST_PRIORITY_PREFIX_KEY priorityPrefixKeys [3];
+
+	// The components of designatedTimes, msgTimes and portTimes other than remainingHops.
+	CIST_TIMES cistTimes [3];
 };
 
 // ============================================================================
 
+inline void PORT_TREE::GetPriority (PORT_INFO_INDEX index, PRIORITY_VECTOR* vectorOut) const
+{
+	if (isCist)
+	{
+		const PORT_CIST_TREE* cistTree = static_cast<const PORT_CIST_TREE*> (this);
+		vectorOut->RootId               = cistTree->priorityPrefixes [index].RootId;
+		vectorOut->ExternalRootPathCost = cistTree->priorityPrefixes [index].ExternalRootPathCost;
+	}
+	else
+	{
+		vectorOut->RootId = BRIDGE_ID ();
+		vectorOut->ExternalRootPathCost = 0;
+	}
+
+	vectorOut->RegionalRootId       = priorities [index].RegionalRootId;
+	vectorOut->InternalRootPathCost = priorities [index].InternalRootPathCost;
+	vectorOut->DesignatedBridgeId   = priorities [index].DesignatedBridgeId;
+	vectorOut->DesignatedPortId     = priorities [index].DesignatedPortId;
+}
+
+inline bool PORT_TREE::SetPriority (PORT_INFO_INDEX index, const PRIORITY_VECTOR& vector)
+{
+	bool changed = false;
+
+	if (isCist)
+	{
+		PORT_CIST_TREE* cistTree = static_cast<PORT_CIST_TREE*> (this);
+		cistTree->priorityPrefixes [index].RootId               = vector.RootId;
+		cistTree->priorityPrefixes [index].ExternalRootPathCost = vector.ExternalRootPathCost;
+
+		CIST_PRIORITY_PREFIX_KEY previousKey = cistTree->priorityPrefixKeys [index];
+		cistTree->priorityPrefixKeys [index].Set (cistTree->priorityPrefixes [index]);
+		changed = !(cistTree->priorityPrefixKeys [index] == previousKey);
+	}
+	else
+		assert ((vector.RootId == BRIDGE_ID ()) && (vector.ExternalRootPathCost.GetValue () == 0));
+
+	priorities [index].RegionalRootId       = vector.RegionalRootId;
+	priorities [index].InternalRootPathCost = vector.InternalRootPathCost;
+	priorities [index].DesignatedBridgeId   = vector.DesignatedBridgeId;
+	priorities [index].DesignatedPortId     = vector.DesignatedPortId;
+
+	MSTI_PRIORITY_VECTOR_KEY previousKey = priorityKeys [index];
+	priorityKeys [index].Set (priorities [index]);
+	return changed || (priorityKeys [index] != previousKey);
+}
+
+inline void PORT_TREE::UpdatePriorityKey (PORT_INFO_INDEX index)
+{
+	if (isCist)
+	{
+		PORT_CIST_TREE* cistTree = static_cast<PORT_CIST_TREE*> (this);
+		cistTree->priorityPrefixKeys [index].Set (cistTree->priorityPrefixes [index]);
+	}
+
+	priorityKeys [index].Set (priorities [index]);
+}
+
+inline void PORT_TREE::CopyPriority (PORT_INFO_INDEX from, PORT_INFO_INDEX to)
+{
+	if (isCist)
+	{
+		PORT_CIST_TREE* cistTree = static_cast<PORT_CIST_TREE*> (this);
+		cistTree->priorityPrefixes [to]   = cistTree->priorityPrefixes [from];
+		cistTree->priorityPrefixKeys [to] = cistTree->priorityPrefixKeys [from];
+	}
+
+	priorities [to]   = priorities [from];
+	priorityKeys [to] = priorityKeys [from];
+}
+
+// Compares two priority vectors of this port and tree (13.9, 13.10); returns a negative value if lhs is better.
+inline int PORT_TREE::ComparePriorities (PORT_INFO_INDEX lhs, PORT_INFO_INDEX rhs) const
+{
+	if (isCist)
+	{
+		const PORT_CIST_TREE* cistTree = static_cast<const PORT_CIST_TREE*> (this);
+		int result = cistTree->priorityPrefixKeys [lhs].Compare (cistTree->priorityPrefixKeys [rhs]);
+		if (result != 0)
+			return result;
+	}
+
+	return priorityKeys [lhs].Compare (priorityKeys [rhs]);
+}
+
+// Same as PRIORITY_VECTOR::IsSuperiorTo.
+inline bool PORT_TREE::IsPrioritySuperiorTo (PORT_INFO_INDEX lhs, PORT_INFO_INDEX rhs) const
+{
+	return (ComparePriorities (lhs, rhs) < 0) || priorityKeys [lhs].IsFromSameDesignatedPort (priorityKeys [rhs]);
+}
+
+inline void PORT_TREE::GetTimes (PORT_INFO_INDEX index, TIMES* timesOut) const
+{
+	if (isCist)
+	{
+		const CIST_TIMES* cistTimes = &static_cast<const PORT_CIST_TREE*> (this)->cistTimes [index];
+		timesOut->ForwardDelay = cistTimes->ForwardDelay;
+		timesOut->HelloTime    = cistTimes->HelloTime;
+		timesOut->MaxAge       = cistTimes->MaxAge;
+		timesOut->MessageAge   = cistTimes->MessageAge;
+	}
+	else
+	{
+		timesOut->ForwardDelay = 0;
+		timesOut->HelloTime    = 0;
+		timesOut->MaxAge       = 0;
+		timesOut->MessageAge   = 0;
+	}
+
+	timesOut->remainingHops = remainingHops [index];
+}
+
+inline bool PORT_TREE::SetTimes (PORT_INFO_INDEX index, const TIMES& times)
+{
+	TIMES previousTimes;
+	GetTimes (index, &previousTimes);
+
+	if (isCist)
+	{
+		CIST_TIMES* cistTimes = &static_cast<PORT_CIST_TREE*> (this)->cistTimes [index];
+		cistTimes->ForwardDelay = times.ForwardDelay;
+		cistTimes->HelloTime    = times.HelloTime;
+		cistTimes->MaxAge       = times.MaxAge;
+		cistTimes->MessageAge   = times.MessageAge;
+	}
+	else
+		assert ((times.ForwardDelay == 0) && (times.HelloTime == 0) && (times.MaxAge == 0) && (times.MessageAge == 0));
+
+	remainingHops [index] = times.remainingHops;
+
+	return times != previousTimes;
+}
+
+inline void PORT_TREE::CopyTimes (PORT_INFO_INDEX from, PORT_INFO_INDEX to)
+{
+	if (isCist)
+	{
+		PORT_CIST_TREE* cistTree = static_cast<PORT_CIST_TREE*> (this);
+		cistTree->cistTimes [to] = cistTree->cistTimes [from];
+	}
+
+	remainingHops [to] = remainingHops [from];
+}
+
+inline bool PORT_TREE::AreTimesEqual (PORT_INFO_INDEX lhs, PORT_INFO_INDEX rhs) const
+{
+	if (isCist)
+	{
+		const CIST_TIMES* cistTimes = static_cast<const PORT_CIST_TREE*> (this)->cistTimes;
+		if ((cistTimes [lhs].ForwardDelay != cistTimes [rhs].ForwardDelay)
+			|| (cistTimes [lhs].HelloTime != cistTimes [rhs].HelloTime)
+			|| (cistTimes [lhs].MaxAge != cistTimes [rhs].MaxAge)
+			|| (cistTimes [lhs].MessageAge != cistTimes [rhs].MessageAge))
+		{
+			return false;
+		}
+	}
+
+	return remainingHops [lhs] == remainingHops [rhs];
+}
+
+// ============================================================================
+
 // 13.25
 struct PORT
 {
@@ -123,7 +393,26 @@ struct PORT
 	// One instance of the following shall be implemented per port when L2GP functionality is provided:
 	unsigned short pseudoInfoHelloWhen; // d) - 13.23.10
 
-	PORT_TREE** trees;
+	PORT_TREE** trees; // the first one is a PORT_CIST_TREE, see GetCistTree()
+	PORT_TREE_TIMERS* treeTimers; // timers of all trees of this port, see PORT_TREE_TIMERS
+
+	// Image of the RST / MST BPDU last transmitted on this port, from which txRstp() copies the fields that
+	// don't change from one BPDU to the next. Large enough for an MST BPDU with all MSTI Configuration Messages.
+	MSTP_BPDU* txTemplate;
+
+	// Not in the standard: tells whether a BPDU of this port is waiting in STP_BRIDGE::transmitBatchEntries.
+	bool inTransmitBatch;
+
+	// Not in the standard: number of MSTIs for which selected is FALSE or updtInfo is TRUE on this port, for allTransmitReady.
+	// See STP_BRIDGE::updateSharedStateCounts.
+	unsigned int notTransmitReadyMstiCount;
+
+	// Not in the standard: bitmaps of the VLANs for which this port forwards / learns, laid out like STP_BRIDGE::vlanBitmaps.
+	// Updated together with the forwarding and learning variables of the port's trees; vlanBitmapGeneration is
+	// incremented whenever either bitmap changes. See STP_GetForwardingVlanBitmapForPort.
+	unsigned char* forwardingVlans;
+	unsigned char* learningVlans;
+	unsigned int vlanBitmapGeneration;
 
 	STP_ADMIN_P2P adminPointToPointMAC;
 
@@ -138,6 +427,19 @@ struct PORT
 	//  - application calls STP_OnPortEnabled (pointToPointMAC = XXX) => the library will write XXX to this variable and keep operPointToPointMAC true.
 	//  - application calls STP_SetAdminP2P(AUTO) => the library must set operPointToPointMAC to XXX, which it reads from this variable.
 	bool detectedPointToPointMAC;
+
+	// These variables are supposed to be be accessed only while a BPDU received on this port is being handled.
+	// When there's no received BPDU, we set them to the invalid values NULL / UNKNOWN, to cause a crash on access and signal the programming error early.
+	// (Note that the crash won't happen on some microcontrollers for which address 0 is
+	//  readable/writeable, that's why we also have asserts all around the place).
+	// They're per port because STP_OnBpdusReceived hands BPDUs received on several ports to a single run of the state machines.
+	const MSTP_BPDU*		receivedBpduContent;
+	VALIDATED_BPDU_TYPE		receivedBpduType;
+
+	PORT_CIST_TREE* GetCistTree () const
+	{
+		return static_cast<PORT_CIST_TREE*> (trees [CIST_INDEX]);
+	}
 };
 
 #endif